@@ -16,6 +16,13 @@
 
 #include "xyscope-shared.h"
 #include "xyscope-ringbuffer.h"
+#include "xyscope-broadcast.h"
+#include "xyscope-downmix.h"
+#include "xyscope-convert.h"
+#include "xyscope-decimate.h"
+#include "xyscope-metrics.h"
+#include "xyscope-notify.h"
+#include "xyscope-file.h"
 
 #ifdef __APPLE__
 #import <CoreAudio/CoreAudio.h>
@@ -28,6 +35,7 @@
 #include "xyscope-compat.h"
 #else
 #include <pipewire/pipewire.h>
+#include <spa/node/io.h>
 #include <spa/param/audio/format-utils.h>
 #endif
 
@@ -37,14 +45,122 @@
 #include <unistd.h>
 #endif
 
+#include "xyscope-shm.h"
+#include "xyscope-realtime.h"
+
 /* Globals defined in xyscope.mm — needed by audioInput */
 extern int sample_rate;
+extern int capture_rate;         /* device/file rate, before decimation     */
+extern int display_rate;         /* --display-rate: decimate above this     */
 extern int frame_rate;
 extern int frames_per_buf;
 extern int draw_frames;
 extern int default_rb_size;
+extern int live_rb_size;
+extern bool input_fast;          /* --input-fast: don't pace to real time    */
+extern bool input_loop;          /* --input-loop: restart at end of file     */
+extern bool raw_capture;         /* --raw-capture: downmix off the RT thread */
+extern sample_format_t capture_format;  /* --capture-format: asked of Pipewire */
+
+/* Per-stream Pipewire scheduling (--pw-profile, --pw-quantum,
+ * --pw-rate, or the same keys in the config), so the scope can be
+ * tuned without editing the daemon-wide files in config/pipewire.
+ * Quanta are given at 48 kHz, the way node.latency counts them. */
+typedef struct {
+    const char *name;
+    unsigned int quantum;        /* node.latency, 0 = the graph's own     */
+    bool force_quantum;          /* also node.force-quantum               */
+    unsigned int rate;           /* node.force-rate with resampling off,
+                                    0 = the graph's own                   */
+} pw_stream_profile_t;
+
+static const pw_stream_profile_t pw_stream_profiles[] = {
+    { "default",     0,    false, 0 },
+    { "low-latency", 64,   true,  0 },
+    { "throughput",  1024, false, 0 },
+    { "power-save",  4096, false, 0 },
+};
+
+extern pw_stream_profile_t pw_profile;
+
+/* Named profile, then any explicit quantum or rate on top.  Returns
+ * false for an unknown name, leaving the default profile. */
+static inline bool pw_profile_resolve(const char *name, unsigned int quantum,
+                                      unsigned int rate, pw_stream_profile_t *out)
+{
+    bool found = false;
+    *out = pw_stream_profiles[0];
+    for (unsigned int i = 0; i < sizeof(pw_stream_profiles) / sizeof(pw_stream_profiles[0]); i++) {
+        if (name && !strcmp(name, pw_stream_profiles[i].name)) {
+            *out = pw_stream_profiles[i];
+            found = true;
+        }
+    }
+    if (quantum)
+        out->quantum = quantum;
+    if (rate)
+        out->rate = rate;
+    return found || !name || !name[0];
+}
+
+/* The profile's quantum in frames at the graph rate, for both
+ * node.latency and node.force-quantum.  Pipewire scales node.latency
+ * to the graph rate itself but takes node.force-quantum as given, so
+ * the two only agree when the rate is known: with a forced rate we
+ * scale to it, otherwise the graph's rate isn't known until the stream
+ * runs and the quantum is forced as 48 kHz frames. */
+static inline unsigned int pw_profile_graph_rate(const pw_stream_profile_t *p)
+{
+    return p->rate ? p->rate : 48000;
+}
 
+static inline unsigned int pw_profile_graph_quantum(const pw_stream_profile_t *p)
+{
+    return (unsigned int)(((unsigned long long)p->quantum * pw_profile_graph_rate(p)
+                           + 24000) / 48000);
+}
+
+/* Up to MAX_SOURCES streams are captured side by side, each with its
+ * own thread data, ring and reader thread.  A source is either a live
+ * capture (with an optional Pipewire target), a file (--input), or
+ * another process's shared-memory ring (--shm-input). */
+#define MAX_SOURCES 4
+
+typedef struct {
+    const char *target;          /* Pipewire target, NULL for the default */
+    const char *file;            /* play this file instead of capturing   */
+    const char *shm;             /* or read this shared-memory ring       */
+} source_t;
+
+/* --raw-capture: the Pipewire and WASAPI callbacks copy each quantum
+ * into t_data->raw exactly as delivered (every channel, interleaved),
+ * behind a header describing it, and the acquisition thread downmixes
+ * it into the frame ring afterwards (drain_raw()).  A record goes in
+ * with one commit, so the ring's head is always a record boundary. */
+#define RAW_SILENT       1u           /* no payload: the quantum is silence */
+#define RAW_MAX_CHANNELS 8            /* the raw ring holds this many for
+                                         LIVE_BUFFER_SECONDS              */
+#define RAW_CHUNK        1024         /* frames downmixed per block        */
+
+typedef struct {
+    uint32_t channels;
+    uint32_t n_frames;
+    uint32_t channel_mask;            /* 0 = count-based layout            */
+    uint32_t rate;                    /* device rate, before decimation    */
+    uint64_t capture_ns;              /* capture time of the last frame    */
+    uint32_t flags;
+    uint32_t format;                  /* sample_format_t of the payload    */
+    uint64_t first_frame;             /* frames recorded before this one,
+                                         so drain_raw() can count gaps     */
+} raw_header_t;
+
+/* Fields are grouped by who touches them so the capture callback's
+ * per-quantum stores never invalidate a line the render thread polls
+ * every frame (and vice versa).  Thread_Data is a static global array,
+ * one per source, so the alignas() groups are honoured without a
+ * special allocator. */
 typedef struct _thread_data {
+    /* Set up once by readerThread / on_param_changed, then read-mostly */
     pthread_t thread_id;
 #ifdef __APPLE__
     AudioComponentInstance audio_unit;
@@ -57,89 +173,298 @@ typedef struct _thread_data {
 #else
     struct pw_thread_loop *loop;
     struct pw_stream *stream;
+    struct spa_io_position *position;   /* graph clock, set via io_changed */
+    volatile unsigned int graph_quantum;  /* frames per cycle, as of the last */
+    volatile unsigned int graph_rate;     /* on_process (stats only)          */
 #endif
     sample_t **input_buffer;
     size_t frame_size;
-    ringbuffer_t *ringbuffer;
+    bcast_ring_t *ringbuffer;    /* one writer, any number of readers   */
     size_t rb_size;
-    pthread_mutex_t ringbuffer_lock;
-    pthread_cond_t data_ready;
     unsigned int channels;
-    volatile bool can_process;
-    volatile bool pause_scope;
-    volatile int negotiated_sample_rate;
-    timeval last_write;
+    sample_format_t sample_format;  /* what the callback receives         */
+    downmix_t downmix;           /* gain matrix for the negotiated layout */
+    bool file_input;             /* fed by runFileInput() or runShmInput(),
+                                    no device opened                      */
+    const char *file;            /* this source's input file, or NULL     */
+    const char *shm;             /* this source's shared-memory ring, or NULL */
+    unsigned int source;         /* index into Thread_Data                */
     char target[256];
+
+    /* Reader-hot: polled by the reader every window, flipped only on user
+     * input or stream state changes */
+    alignas(RB_CACHE_LINE) volatile bool can_process;
+    volatile bool pause_scope;
+
+    /* Writer-hot: stored by the capture callback every quantum (with
+     * --raw-capture, everything from decimate on belongs to drain_raw()
+     * on the acquisition thread instead) */
+    alignas(RB_CACHE_LINE) volatile unsigned long long last_write;  /* monotonic ns */
+    volatile int negotiated_sample_rate;    /* the device's, before decimation */
+    bcast_ring_t *raw;           /* --raw-capture records, or NULL        */
+    decimator_t decimate;        /* --display-rate stage, rebuilt with downmix */
+    ringbuffer_t *tags;          /* block_tag_t per committed block       */
+    unsigned long long frames_written;      /* ring frames committed so far  */
+    unsigned long long capture_ns;          /* capture time of the current
+                                               quantum's last frame           */
+    unsigned long long raw_frames;          /* recorded into `raw` so far    */
+
+    /* Drop accounting (see drop_counts_t), written only by the capture
+     * side and read by the stats */
+    unsigned long long dropped;             /* frames that didn't fit        */
+    unsigned long long tags_dropped;        /* tags the tag ring refused     */
+    unsigned long long xruns;               /* device or graph discontinuities */
+    unsigned long long xrun_frames;         /* frames they cost, where known */
+    unsigned long long drained;             /* Pipewire drained events       */
+    uint64_t next_position;                 /* where the next quantum should
+                                               start on the device's clock, 0
+                                               after a pause or at startup    */
+
+    /* drain_raw()'s cursor on `raw`, and the layout the downmix and
+     * decimator were last built for */
+    alignas(RB_CACHE_LINE) bcast_reader_t raw_reader;
+    raw_header_t raw_layout;
+    float *raw_buf;              /* RAW_CHUNK frames of raw_buf_channels
+                                    (of up to four-byte samples)          */
+    unsigned int raw_buf_channels;
+    uint64_t raw_next;           /* first_frame the next record should have */
+    unsigned long long raw_lost; /* frames lapped before they were drained */
+    unsigned long long shm_lost; /* --shm-input frames the writer lapped  */
+
+    /* Wakeup from the capture callback to the acquisition thread (its
+     * own lines) */
+    notify_t data_ready;
 } thread_data_t;
 
-extern thread_data_t Thread_Data;
+extern thread_data_t Thread_Data[MAX_SOURCES];
 
-/* Downmix an interleaved multi-channel frame to stereo using ITU-style
- * coefficients: center at -3 dB, surrounds at -3 dB into the matching
- * side, LFE dropped (it would dominate the X position). When `mask` is
- * non-zero it is interpreted as a Windows WAVEFORMATEXTENSIBLE channel
- * mask (SPEAKER_FRONT_LEFT bit, etc.) and channels are taken in mask-
- * bit order. When `mask` is 0 we assume the standard layout for the
- * channel count (quad / 5.1 / 7.1).
- *
- * Without this, an 8-channel stream from Windows speaker-fill / Atmos
- * upmixing leaves only the dry stereo on FL/FR — the trace looks
- * "skeletal" because most of the music is on the surround / center
- * channels.  See the WASAPI capture loop and the Pipewire on_process
- * callback for callers. */
-static inline void downmix_stereo(const float *frame, unsigned int ch,
-                                  unsigned int mask,
-                                  sample_t *out_l, sample_t *out_r)
+/* Signal the acquisition thread that data is ready.  Called from the
+ * realtime capture context after each commit, so it must never block:
+ * the key is the new head of the ring it wrote, and the kernel is only
+ * entered when the reader is actually parked. */
+static inline void signal_data_ready(thread_data_t *t_data)
 {
-    if (ch == 1) { *out_l = *out_r = frame[0]; return; }
-    if (ch == 2) { *out_l = frame[0]; *out_r = frame[1]; return; }
-
-    /* Fall back to assumed layouts when the source didn't provide one. */
-    if (mask == 0) {
-        switch (ch) {
-            case 4: mask = 0x033; break;  /* quad: FL FR BL BR        */
-            case 6: mask = 0x03F; break;  /* 5.1:  FL FR FC LFE BL BR */
-            case 8: mask = 0x63F; break;  /* 7.1:  + SL SR            */
-            default:
-                *out_l = frame[0];
-                *out_r = frame[1];
-                return;
-        }
-    }
-
-    static const struct { unsigned int bit; float gl, gr; } map[] = {
-        { 0x001, 1.000f, 0.000f },  /* FL  */
-        { 0x002, 0.000f, 1.000f },  /* FR  */
-        { 0x004, 0.707f, 0.707f },  /* FC  */
-        { 0x008, 0.000f, 0.000f },  /* LFE — dropped */
-        { 0x010, 0.707f, 0.000f },  /* BL  */
-        { 0x020, 0.000f, 0.707f },  /* BR  */
-        { 0x040, 0.866f, 0.500f },  /* FLC */
-        { 0x080, 0.500f, 0.866f },  /* FRC */
-        { 0x100, 0.500f, 0.500f },  /* BC  */
-        { 0x200, 0.707f, 0.000f },  /* SL  */
-        { 0x400, 0.000f, 0.707f },  /* SR  */
-    };
+    const bcast_ring_t *r = t_data->raw ? t_data->raw : t_data->ringbuffer;
+    notify_post(&t_data->data_ready, (uint32_t)r->head, t_data->last_write);
+}
+
+/* Tag the n ring frames about to be committed.  `after` is how many
+ * input frames of the current quantum follow the block's last one, to
+ * place it relative to capture_ns.  Call before the commit; a tag that
+ * doesn't fit is dropped and the reader skips a latency sample. */
+static inline void publish_tag(thread_data_t *t_data, size_t n, size_t after)
+{
+    block_tag_t tag;
+    int rate = t_data->negotiated_sample_rate > 0 ? t_data->negotiated_sample_rate
+                                                  : capture_rate;
+    t_data->frames_written += n;
+    tag.frame = t_data->frames_written;
+    tag.ns    = t_data->capture_ns - (unsigned long long)after * 1000000000ULL / rate;
+    if (t_data->tags && ringbuffer_write_space(t_data->tags) >= sizeof(tag))
+        ringbuffer_write(t_data->tags, (const char *)&tag, sizeof(tag));
+    else if (t_data->tags)
+        t_data->tags_dropped++;
+}
+
+/* Compare a quantum's start on the device's own sample clock with where
+ * the last one ended; a gap means the device or graph dropped frames
+ * before we ever saw them.  next_position is cleared whenever the
+ * callback skips quanta on purpose (paused), so those aren't counted. */
+static inline void note_position(thread_data_t *t_data, uint64_t start, uint64_t n_frames)
+{
+    if (t_data->next_position && start != t_data->next_position) {
+        t_data->xruns++;
+        if (start > t_data->next_position)
+            t_data->xrun_frames += start - t_data->next_position;
+    }
+    t_data->next_position = start + n_frames;
+}
+
+/* Set the decimation factor for a source running at `rate` */
+static inline void decimate_setup(thread_data_t *t_data, int rate)
+{
+    unsigned int factor = decimate_factor(rate, display_rate);
+    decimate_init(&t_data->decimate, factor);
+    if (factor > 1)
+        fprintf(stderr, "Decimating %d Hz by %u to %d Hz\n", rate, factor, rate / factor);
+}
+
+/* Decimate the n frames the caller wrote at decimate_input() and
+ * publish the result; `after` as for publish_tag() */
+static inline void publish_decimated(thread_data_t *t_data, size_t n, size_t after)
+{
+    decimator_t *d = &t_data->decimate;
+    size_t k = decimate_run(d, n);
+
+    ringbuffer_data_t vec[2];
+    bcast_write_reserve(t_data->ringbuffer, k * sizeof(frame_t), vec);
+    size_t n0 = vec[0].len / sizeof(frame_t);
+    if (n0 > k) n0 = k;
+    memcpy(vec[0].buf, d->out, n0 * sizeof(frame_t));
+    memcpy(vec[1].buf, d->out + n0, (k - n0) * sizeof(frame_t));
+    publish_tag(t_data, k, after);
+    bcast_write_commit(t_data->ringbuffer, k * sizeof(frame_t));
+}
+
+/* Downmix a whole quantum of interleaved samples straight into the
+ * ring and publish it with one release-store, instead of a write per
+ * frame.  Integer samples are converted on the way (downmix_native()),
+ * so they never take a separate float pass.  The layout comes from the
+ * gain matrix precomputed in t_data->downmix.  A NULL `samples` writes
+ * silence.  The ring never refuses a write: the oldest frames are
+ * overwritten, and any reader that was still behind them counts an
+ * overrun.  With --display-rate the quantum goes through the decimator
+ * in DECIMATE_CHUNK pieces first.  Returns the number of input frames
+ * consumed. */
+static inline size_t publish_native(thread_data_t *t_data, const void *samples,
+                                    sample_format_t fmt, size_t n_frames)
+{
+    const char *src = (const char *)samples;
+    const size_t stride = t_data->downmix.channels * sample_bytes(fmt);
+
+    if (t_data->decimate.factor > 1) {
+        size_t done = 0;
+        while (done < n_frames) {
+            size_t cnt = n_frames - done;
+            if (cnt > DECIMATE_CHUNK)
+                cnt = DECIMATE_CHUNK;
+            frame_t *dst = decimate_input(&t_data->decimate);
+            if (samples == NULL)
+                memset(dst, 0, cnt * sizeof(frame_t));
+            else
+                downmix_native(&t_data->downmix, src + done * stride, fmt, dst, cnt);
+            publish_decimated(t_data, cnt, n_frames - done - cnt);
+            done += cnt;
+        }
+        return done;
+    }
 
-    float L = 0.0f, R = 0.0f;
-    unsigned int idx = 0;
-    for (unsigned int m = 0; m < sizeof(map)/sizeof(map[0]) && idx < ch; m++) {
-        if (mask & map[m].bit) {
-            L += frame[idx] * map[m].gl;
-            R += frame[idx] * map[m].gr;
-            idx++;
+    ringbuffer_data_t vec[2];
+    size_t got = bcast_write_reserve(t_data->ringbuffer,
+                                     n_frames * sizeof(frame_t), vec);
+    size_t n  = got / sizeof(frame_t);
+    size_t n0 = vec[0].len / sizeof(frame_t);
+    if (n0 > n) n0 = n;
+
+    for (unsigned int v = 0; v < 2; v++) {
+        frame_t *dst  = (frame_t *)vec[v].buf;
+        size_t   cnt  = v ? n - n0 : n0;
+        size_t   base = v ? n0 : 0;
+        if (samples == NULL) {
+            memset(dst, 0, cnt * sizeof(frame_t));
+            continue;
         }
+        downmix_native(&t_data->downmix, src + base * stride, fmt, dst, cnt);
     }
-    *out_l = (sample_t)L;
-    *out_r = (sample_t)R;
+
+    publish_tag(t_data, n, n_frames - n);
+    bcast_write_commit(t_data->ringbuffer, n * sizeof(frame_t));
+    t_data->dropped += n_frames - n;
+    return n;
 }
 
-/* Signal reader thread that data is ready */
-static inline void signal_data_ready(thread_data_t *t_data)
+static inline size_t publish_frames(thread_data_t *t_data, const float *samples,
+                                    size_t n_frames)
+{
+    return publish_native(t_data, samples, SampleF32, n_frames);
+}
+
+/* RT side of --raw-capture: one header and one copy per quantum, with
+ * no downmix however many channels there are.  A NULL `samples`
+ * records silence without a payload. */
+static inline void publish_raw(thread_data_t *t_data, const void *samples,
+                               sample_format_t fmt, size_t n_frames,
+                               unsigned int channels, unsigned int channel_mask)
+{
+    raw_header_t h;
+    memset(&h, 0, sizeof(h));
+    h.channels     = channels;
+    h.n_frames     = (uint32_t)n_frames;
+    h.channel_mask = channel_mask;
+    h.rate         = (uint32_t)t_data->negotiated_sample_rate;
+    h.capture_ns   = t_data->capture_ns;
+    h.flags        = samples ? 0 : RAW_SILENT;
+    h.format       = fmt;
+    h.first_frame  = t_data->raw_frames;
+    t_data->raw_frames += n_frames;
+
+    size_t payload = samples ? n_frames * channels * sample_bytes(fmt) : 0;
+    if (sizeof(h) + payload > t_data->raw->size / 2) {
+        t_data->dropped += n_frames;  /* can't happen at sane quanta */
+        return;
+    }
+    ringbuffer_data_t vec[2];
+    bcast_write_reserve(t_data->raw, sizeof(h) + payload, vec);
+    bcast_vec_copy(vec, 0, &h, sizeof(h));
+    bcast_vec_copy(vec, sizeof(h), samples, payload);
+    bcast_write_commit(t_data->raw, sizeof(h) + payload);
+}
+
+/* Rebuild the downmix and decimator when a record's layout or rate
+ * differs from the last one's */
+static inline void raw_set_layout(thread_data_t *t_data, const raw_header_t *h)
 {
-    if (pthread_mutex_trylock(&t_data->ringbuffer_lock) == 0) {
-        pthread_cond_signal(&t_data->data_ready);
-        pthread_mutex_unlock(&t_data->ringbuffer_lock);
+    raw_header_t *l = &t_data->raw_layout;
+    if (h->channels == l->channels && h->channel_mask == l->channel_mask
+        && h->rate == l->rate)
+        return;
+    if (h->channels > t_data->raw_buf_channels) {
+        free(t_data->raw_buf);
+        t_data->raw_buf = (float *)malloc(RAW_CHUNK * h->channels * sizeof(float));
+        t_data->raw_buf_channels = h->channels;
+    }
+    downmix_init(&t_data->downmix, h->channels, h->channel_mask);
+    decimate_setup(t_data, h->rate ? (int)h->rate : capture_rate);
+    *l = *h;
+}
+
+/* Consumer side of --raw-capture, run by the acquisition thread before
+ * it reads the frame ring: downmix (and decimate) every record since
+ * the last call into the frame ring, RAW_CHUNK frames at a time, each
+ * block tagged from its record's capture time.  If the callback laps
+ * the cursor it skips to the head, the newest record boundary; the
+ * frames that cost are counted from the next record's first_frame. */
+static inline void drain_raw(thread_data_t *t_data)
+{
+    bcast_reader_t *rd = &t_data->raw_reader;
+    if (rd->ring != t_data->raw) {
+        bcast_reader_init(rd, t_data->raw);
+        t_data->raw_next = UINT64_MAX;
+    }
+
+    for (;;) {
+        unsigned long long overruns = rd->overruns;
+        raw_header_t h;
+        if (bcast_read_space(rd) < sizeof(h) && rd->overruns == overruns)
+            break;
+        if (rd->overruns == overruns
+            && bcast_read(rd, (char *)&h, sizeof(h)) == sizeof(h)) {
+            raw_set_layout(t_data, &h);
+            if (t_data->raw_next != UINT64_MAX && h.first_frame > t_data->raw_next)
+                t_data->raw_lost += h.first_frame - t_data->raw_next;
+            int rate = h.rate ? (int)h.rate : capture_rate;
+            size_t done = 0;
+            while (done < h.n_frames) {
+                size_t cnt = h.n_frames - done;
+                if (cnt > RAW_CHUNK)
+                    cnt = RAW_CHUNK;
+                const void *src = NULL;
+                if (!(h.flags & RAW_SILENT)) {
+                    size_t bytes = cnt * h.channels * sample_bytes((sample_format_t)h.format);
+                    if (bcast_read(rd, (char *)t_data->raw_buf, bytes) < bytes)
+                        break;
+                    src = t_data->raw_buf;
+                }
+                size_t after = h.n_frames - done - cnt;
+                t_data->capture_ns = h.capture_ns
+                                   - (unsigned long long)after * 1000000000ULL / rate;
+                publish_native(t_data, src, (sample_format_t)h.format, cnt);
+                done += cnt;
+            }
+            t_data->raw_next = h.first_frame + done;
+        }
+        if (rd->overruns != overruns)
+            bcast_seek(rd, rd->head_cache);
     }
 }
 
@@ -225,6 +550,11 @@ static bool initWasapiLoopback(thread_data_t *t_data, bool verbose)
         WAVEFORMATEXTENSIBLE *ext = (WAVEFORMATEXTENSIBLE *)mix_format;
         t_data->wasapi_channel_mask = ext->dwChannelMask;
     }
+    if (!t_data->raw) {
+        downmix_init(&t_data->downmix, t_data->wasapi_channels,
+                     t_data->wasapi_channel_mask);
+        decimate_setup(t_data, (int)mix_format->nSamplesPerSec);
+    }
     if (verbose)
         printf("WASAPI: %lu Hz, %u channels, %u bits, channel mask 0x%x\n",
                mix_format->nSamplesPerSec, mix_format->nChannels,
@@ -262,8 +592,7 @@ static bool initWasapiLoopback(thread_data_t *t_data, bool verbose)
     t_data->capture_client = (void *)captureClient;
 
     if (t_data->ringbuffer == NULL) {
-        t_data->ringbuffer = ringbuffer_create(t_data->frame_size * t_data->rb_size);
-        bzero(t_data->ringbuffer->buf, t_data->ringbuffer->size);
+        t_data->ringbuffer = bcast_create(t_data->frame_size * t_data->rb_size);
     }
 
     if (verbose)
@@ -283,10 +612,24 @@ static OSStatus audioInputCallback(void *inRefCon,
     thread_data_t *t_data = (thread_data_t *)inRefCon;
 
     if (t_data->pause_scope || !t_data->can_process) {
+        t_data->next_position = 0;
         return noErr;
     }
 
-    gettimeofday(&t_data->last_write, NULL);
+    t_data->last_write = monotonic_ns();
+    if (inTimeStamp && (inTimeStamp->mFlags & kAudioTimeStampSampleTimeValid))
+        note_position(t_data, (uint64_t)inTimeStamp->mSampleTime, inNumberFrames);
+
+    /* capture time of the buffer's last frame: the timestamp is the
+     * first frame's, on the host clock, so move it by the host clock's
+     * age onto monotonic_ns() */
+    t_data->capture_ns = t_data->last_write;
+    if (inTimeStamp && (inTimeStamp->mFlags & kAudioTimeStampHostTimeValid)) {
+        UInt64 host_now = AudioGetCurrentHostTime();
+        if (host_now > inTimeStamp->mHostTime)
+            t_data->capture_ns -= AudioConvertHostTimeToNanos(host_now - inTimeStamp->mHostTime);
+        t_data->capture_ns += (unsigned long long)(inNumberFrames - 1) * 1000000000ULL / capture_rate;
+    }
 
     // Use pre-allocated buffers from input_buffer
     AudioBufferList bufferList;
@@ -308,13 +651,39 @@ static OSStatus audioInputCallback(void *inRefCon,
     float *leftSamples = (float *)t_data->input_buffer[0];
     float *rightSamples = (float *)t_data->input_buffer[1];
 
-    // Write stereo frames to ringbuffer
-    for (UInt32 i = 0; i < inNumberFrames; i++) {
-        frame_t frame;
-        frame.left_channel = leftSamples[i];
-        frame.right_channel = rightSamples[i];
-        ringbuffer_write(t_data->ringbuffer, (const char *)&frame, t_data->frame_size);
+    if (t_data->decimate.factor > 1) {
+        /* interleave into the decimator a chunk at a time */
+        for (UInt32 done = 0; done < inNumberFrames; ) {
+            UInt32 cnt = inNumberFrames - done;
+            if (cnt > DECIMATE_CHUNK)
+                cnt = DECIMATE_CHUNK;
+            frame_t *dst = decimate_input(&t_data->decimate);
+            for (UInt32 i = 0; i < cnt; i++) {
+                dst[i].left_channel  = leftSamples[done + i];
+                dst[i].right_channel = rightSamples[done + i];
+            }
+            publish_decimated(t_data, cnt, inNumberFrames - done - cnt);
+            done += cnt;
+        }
+        signal_data_ready(t_data);
+        return noErr;
+    }
+
+    // Interleave stereo frames straight into the ringbuffer
+    ringbuffer_data_t vec[2];
+    size_t got = bcast_write_reserve(t_data->ringbuffer,
+                                     inNumberFrames * sizeof(frame_t), vec);
+    size_t n  = got / sizeof(frame_t);
+    size_t n0 = vec[0].len / sizeof(frame_t);
+    if (n0 > n) n0 = n;
+    for (size_t i = 0; i < n; i++) {
+        frame_t *frame = (i < n0) ? (frame_t *)vec[0].buf + i
+                                  : (frame_t *)vec[1].buf + (i - n0);
+        frame->left_channel = leftSamples[i];
+        frame->right_channel = rightSamples[i];
     }
+    publish_tag(t_data, n, inNumberFrames - n);
+    bcast_write_commit(t_data->ringbuffer, n * sizeof(frame_t));
 
     signal_data_ready(t_data);
     return noErr;
@@ -340,19 +709,32 @@ static OSStatus onSampleRateChanged(AudioObjectID inObjectID,
 }
 #elif !defined(_WIN32)
 
+/* The spa formats --capture-format can ask for, native-endian */
+static inline sample_format_t sample_format_from_spa(uint32_t fmt)
+{
+    switch (fmt) {
+        case SPA_AUDIO_FORMAT_S16:    return SampleS16;
+        case SPA_AUDIO_FORMAT_S24:    return SampleS24;
+        case SPA_AUDIO_FORMAT_S24_32: return SampleS24_32;
+        case SPA_AUDIO_FORMAT_S32:    return SampleS32;
+        default:                      return SampleF32;
+    }
+}
+
 /* Pipewire stream callback */
 static void on_process(void *userdata)
 {
     thread_data_t *t_data = (thread_data_t *)userdata;
     struct pw_buffer *b;
     struct spa_buffer *buf;
-    float *samples;
+    const void *samples;
     uint32_t n_frames;
-    frame_t frame;
 
     /* Do nothing if the scope is paused or we are not ready. */
-    if (t_data->pause_scope || !t_data->can_process)
+    if (t_data->pause_scope || !t_data->can_process) {
+        t_data->next_position = 0;
         return;
+    }
 
     b = pw_stream_dequeue_buffer(t_data->stream);
     if (b == NULL)
@@ -364,24 +746,47 @@ static void on_process(void *userdata)
         return;
     }
 
-    gettimeofday(&t_data->last_write, NULL);
-
-    /* Process interleaved stereo samples */
-    samples = (float *)buf->datas[0].data;
-    n_frames = buf->datas[0].chunk->size / (sizeof(float) * t_data->channels);
+    /* Stamp with the graph cycle's start time rather than reading the
+     * clock (until the position area shows up), so the data thread does
+     * nothing but publish into the ring. */
+    t_data->last_write = t_data->position ? t_data->position->clock.nsec
+                                          : monotonic_ns();
+    if (t_data->position) {
+        t_data->graph_quantum = (unsigned int)t_data->position->clock.duration;
+        t_data->graph_rate    = t_data->position->clock.rate.denom;
+        /* a cycle the graph skipped (xrun) leaves a hole in its clock */
+        note_position(t_data, t_data->position->clock.position,
+                      t_data->position->clock.duration);
+    }
 
-    /* mask=0 → downmix_stereo uses count-based standard layout
-     * (quad / 5.1 / 7.1).  Pipewire usually negotiates to stereo so
-     * this is rare, but covers the case where the session manager
-     * hands us a multichannel monitor source. */
-    for (uint32_t i = 0; i < n_frames; i++) {
-        downmix_stereo(samples + i * t_data->channels, t_data->channels, 0,
-                       &frame.left_channel, &frame.right_channel);
-        ringbuffer_write(t_data->ringbuffer,
-                        (const char *)&frame,
-                        t_data->frame_size);
+    /* Tag the quantum with the graph's clock: pw_time.now is this
+     * cycle's start, and delay is how long (in rate ticks) the newest
+     * sample has been travelling from the device.  Reads the stream's
+     * shared time area; no syscall. */
+    struct pw_time pt;
+    t_data->capture_ns = t_data->last_write;
+    if (pw_stream_get_time_n(t_data->stream, &pt, sizeof(pt)) == 0
+        && pt.now > 0 && pt.rate.denom > 0) {
+        int64_t delay_ns = pt.delay * 1000000000LL * pt.rate.num / pt.rate.denom;
+        t_data->capture_ns = (unsigned long long)(pt.now - delay_ns);
     }
 
+    /* Interleaved samples in the negotiated format (float unless
+     * --capture-format got an integer one) */
+    samples = buf->datas[0].data;
+    n_frames = buf->datas[0].chunk->size
+             / (sample_bytes(t_data->sample_format) * t_data->channels);
+
+    /* The downmix matrix was built in on_param_changed with mask=0,
+     * i.e. the count-based standard layout (quad / 5.1 / 7.1).
+     * Pipewire usually negotiates to stereo so this is rare, but
+     * covers the case where the session manager hands us a
+     * multichannel monitor source. */
+    if (t_data->raw)
+        publish_raw(t_data, samples, t_data->sample_format, n_frames, t_data->channels, 0);
+    else
+        publish_native(t_data, samples, t_data->sample_format, n_frames);
+
     signal_data_ready(t_data);
     pw_stream_queue_buffer(t_data->stream, b);
 }
@@ -395,13 +800,20 @@ static void on_param_changed(void *userdata, uint32_t id, const struct spa_pod *
     struct spa_audio_info_raw info;
     if (spa_format_audio_raw_parse(param, &info) >= 0 && info.rate > 0) {
         t_data->negotiated_sample_rate = info.rate;
+        t_data->sample_format = sample_format_from_spa(info.format);
         if (info.channels > 0 && info.channels != t_data->channels) {
             fprintf(stderr, "Pipewire negotiated %u channels (requested %u); using FL/FR from interleaved stream\n",
                     info.channels, t_data->channels);
             t_data->channels = info.channels;
         } else {
-            fprintf(stderr, "Pipewire negotiated format: %u Hz, %u channels\n",
-                    info.rate, info.channels);
+            fprintf(stderr, "Pipewire negotiated format: %s, %u Hz, %u channels\n",
+                    sample_format_name(t_data->sample_format), info.rate, info.channels);
+        }
+        /* with --raw-capture drain_raw() owns these and follows the
+         * records' headers instead */
+        if (!t_data->raw) {
+            downmix_init(&t_data->downmix, t_data->channels, 0);
+            decimate_setup(t_data, (int)info.rate);
         }
     }
 }
@@ -417,11 +829,31 @@ static void on_state_changed(void *userdata, enum pw_stream_state old,
             error ? error : "");
 }
 
+/* The position area carries the driver's clock for the current cycle;
+ * clock.nsec is CLOCK_MONOTONIC, the same base as monotonic_ns(). */
+static void on_io_changed(void *userdata, uint32_t id, void *area, uint32_t size)
+{
+    thread_data_t *t_data = (thread_data_t *)userdata;
+    (void)size;
+    if (id == SPA_IO_Position)
+        t_data->position = (struct spa_io_position *)area;
+}
+
+/* Capture streams rarely see this, but when they do the stream ran
+ * dry; counted next to the xruns */
+static void on_drained(void *userdata)
+{
+    thread_data_t *t_data = (thread_data_t *)userdata;
+    t_data->drained++;
+}
+
 static const struct pw_stream_events stream_events = {
     PW_VERSION_STREAM_EVENTS,
     .state_changed = on_state_changed,
+    .io_changed = on_io_changed,
     .param_changed = on_param_changed,
     .process = on_process,
+    .drained = on_drained,
 };
 
 #endif
@@ -516,38 +948,59 @@ static int detect_sample_rate() {
 }
 #endif
 
+/* Frames per publish for the file input backend — about a Pipewire
+ * quantum, so the renderer sees the same update granularity */
+#define FILE_INPUT_QUANTUM 512
+
+/* Shared-memory input: frames per publish, and how long to wait for a
+ * segment to appear (or reappear) between attempts */
+#define SHM_INPUT_QUANTUM  1024
+#define SHM_RETRY_US       200000
+
 /* The audioInput object */
 
 class audioInput
 {
 public:
     pthread_t capture_thread;
+    unsigned int source;
     bool quit;
 
-    audioInput(const char *target)
+    audioInput(unsigned int index, const char *target, const char *file,
+               const char *shm = NULL)
     {
         char saved_target[256];
         if (target && target[0])
             snprintf(saved_target, sizeof(saved_target), "%s", target);
         else
             saved_target[0] = '\0';
-        bzero(&Thread_Data, sizeof(Thread_Data));
-        memcpy(Thread_Data.target, saved_target, sizeof(Thread_Data.target));
-#ifdef _WIN32
-        InitializeCriticalSection(&Thread_Data.ringbuffer_lock);
-        InitializeConditionVariable(&Thread_Data.data_ready);
-#else
-        pthread_mutex_t ringbuffer_lock = PTHREAD_MUTEX_INITIALIZER;
-        pthread_cond_t data_ready       = PTHREAD_COND_INITIALIZER;
-        Thread_Data.ringbuffer_lock     = ringbuffer_lock;
-        Thread_Data.data_ready          = data_ready;
-#endif
+        source = index;
+        thread_data_t *t_data = getThreadData();
+        bzero(t_data, sizeof(*t_data));
+        memcpy(t_data->target, saved_target, sizeof(t_data->target));
+        t_data->file   = file;
+        t_data->shm    = shm;
+        t_data->source = index;
+        notify_init(&t_data->data_ready);
         quit = false;
         pthread_create(&capture_thread, NULL, readerThread, (void *)this);
     }
     ~audioInput()
     {
         thread_data_t *t_data = getThreadData();
+
+        /* Wait for readerThread: it has either finished setup already
+         * (CoreAudio, Pipewire) or leaves its polling loop on quit
+         * (WASAPI, file and shared-memory input). */
+        quit = true;
+        pthread_join(capture_thread, NULL);
+
+        if (t_data->file_input) {
+            bcast_free(t_data->ringbuffer);
+            ringbuffer_free(t_data->tags);
+            notify_destroy(&t_data->data_ready);
+            return;
+        }
 #ifdef __APPLE__
         if (t_data->audio_device) {
             AudioObjectPropertyAddress rateAddress = {
@@ -565,7 +1018,6 @@ public:
         }
 #elif defined(_WIN32)
         teardownWasapiLoopback(t_data);
-        DeleteCriticalSection(&t_data->ringbuffer_lock);
         CoUninitialize();
 #else
         if (t_data->stream) {
@@ -588,7 +1040,11 @@ public:
         }
 #endif
         free(t_data->input_buffer);
-        ringbuffer_free(t_data->ringbuffer);
+        bcast_free(t_data->ringbuffer);
+        bcast_free(t_data->raw);
+        free(t_data->raw_buf);
+        ringbuffer_free(t_data->tags);
+        notify_destroy(&t_data->data_ready);
     }
 
     static void* readerThread(void* arg)
@@ -599,11 +1055,29 @@ public:
         t_data->thread_id = ai->capture_thread;
         t_data->input_buffer = NULL;
         t_data->frame_size = sizeof(frame_t);
-        t_data->rb_size = default_rb_size;
+        t_data->rb_size = live_rb_size;
         t_data->channels = 2;
+        t_data->sample_format = SampleF32;
+        downmix_init(&t_data->downmix, t_data->channels, 0);
+        decimate_init(&t_data->decimate, 1);
+        t_data->tags = ringbuffer_create(BLOCK_TAGS * sizeof(block_tag_t));
+        t_data->frames_written = 0;
+        t_data->raw = NULL;
+        t_data->raw_buf = NULL;
+        t_data->raw_buf_channels = 0;
+        memset(&t_data->raw_layout, 0, sizeof(t_data->raw_layout));
         t_data->can_process = false;
         t_data->pause_scope = false;
-        gettimeofday(&t_data->last_write, NULL);
+        t_data->last_write = monotonic_ns();
+
+        if (t_data->file) {
+            ai->runFileInput();
+            return ai;
+        }
+        if (t_data->shm) {
+            ai->runShmInput();
+            return ai;
+        }
 
 #ifdef __APPLE__
         ai->setupPorts();
@@ -645,7 +1119,9 @@ public:
         {
         DWORD backoff_ms = 500;
         DWORD last_health_check = GetTickCount();
+        uint32_t rt_seen = 0;
         while (!ai->quit) {
+            rt_thread_poll(&realtime, &rt_seen, realtime.priority + RT_CAPTURE_BOOST);
             IAudioCaptureClient *capture = (IAudioCaptureClient *)t_data->capture_client;
             if (!capture) {
                 Sleep(backoff_ms);
@@ -687,7 +1163,7 @@ public:
             /* No data available -- keep polling */
             if (FAILED(hr) || packet_length == 0) {
                 if (packet_length == 0 && !t_data->pause_scope && t_data->can_process) {
-                    gettimeofday(&t_data->last_write, NULL);
+                    t_data->last_write = monotonic_ns();
                     signal_data_ready(t_data);
                 }
                 continue;
@@ -698,7 +1174,9 @@ public:
                 UINT32 num_frames = 0;
                 DWORD flags = 0;
 
-                hr = capture->GetBuffer(&data, &num_frames, &flags, NULL, NULL);
+                UINT64 qpc = 0;         /* first frame, in 100 ns QPC units */
+                UINT64 device_pos = 0;  /* first frame, on the device's clock */
+                hr = capture->GetBuffer(&data, &num_frames, &flags, &device_pos, &qpc);
                 if (WASAPI_FATAL(hr)) {
                     teardownWasapiLoopback(t_data);
                     break;
@@ -706,28 +1184,32 @@ public:
                 if (FAILED(hr)) break;
 
                 if (!t_data->pause_scope && t_data->can_process) {
-                    if (flags & AUDCLNT_BUFFERFLAGS_SILENT) {
-                        for (UINT32 i = 0; i < num_frames; i++) {
-                            frame_t frame = {0.0f, 0.0f};
-                            ringbuffer_write(t_data->ringbuffer,
-                                            (const char *)&frame, t_data->frame_size);
-                        }
-                    } else {
-                        float *samples = (float *)data;
-                        unsigned int ch = t_data->wasapi_channels;
-                        unsigned int mask = t_data->wasapi_channel_mask;
-                        for (UINT32 i = 0; i < num_frames; i++) {
-                            frame_t frame;
-                            downmix_stereo(samples + i * ch, ch, mask,
-                                           &frame.left_channel,
-                                           &frame.right_channel);
-                            ringbuffer_write(t_data->ringbuffer,
-                                            (const char *)&frame, t_data->frame_size);
-                        }
-                    }
-                    gettimeofday(&t_data->last_write, NULL);
+                    const float *samples = (flags & AUDCLNT_BUFFERFLAGS_SILENT)
+                                           ? NULL : (const float *)data;
+                    /* the engine flags a glitch even when the positions
+                     * happen to line up; the first packet after a start
+                     * always carries the flag, so that one isn't counted */
+                    unsigned long long xruns = t_data->xruns;
+                    bool running = t_data->next_position != 0;
+                    note_position(t_data, device_pos, num_frames);
+                    if ((flags & AUDCLNT_BUFFERFLAGS_DATA_DISCONTINUITY)
+                        && running && t_data->xruns == xruns)
+                        t_data->xruns++;
+                    /* QPC is monotonic_ns()'s clock on Windows */
+                    t_data->capture_ns = qpc && num_frames
+                        ? qpc * 100ULL + (unsigned long long)(num_frames - 1) * 1000000000ULL
+                                         / capture_rate
+                        : monotonic_ns();
+                    if (t_data->raw)
+                        publish_raw(t_data, samples, SampleF32, num_frames,
+                                    t_data->wasapi_channels, t_data->wasapi_channel_mask);
+                    else
+                        publish_frames(t_data, samples, num_frames);
+                    t_data->last_write = monotonic_ns();
                     signal_data_ready(t_data);
                 }
+                else
+                    t_data->next_position = 0;
 
                 capture->ReleaseBuffer(num_frames);
                 hr = capture->GetNextPacketSize(&packet_length);
@@ -739,11 +1221,11 @@ public:
             }
         }
         }
-#else
-        while (!ai->quit) {
-            usleep(1000);
-        }
 #endif
+        /* CoreAudio and Pipewire deliver audio on their own realtime
+         * threads (the AUHAL IO thread, the graph's data thread with
+         * PW_STREAM_FLAG_RT_PROCESS), so there is nothing left for this
+         * one to do: return and let the destructor join it. */
         return ai;
     }
 
@@ -754,8 +1236,13 @@ public:
 
         // Common allocation for both platforms
         t_data->input_buffer = (sample_t **)malloc(input_buffer_size);
-        t_data->ringbuffer = ringbuffer_create(t_data->frame_size * t_data->rb_size);
-        bzero(t_data->ringbuffer->buf, t_data->ringbuffer->size);
+        t_data->ringbuffer = bcast_create(t_data->frame_size * t_data->rb_size);
+#ifndef __APPLE__
+        /* CoreAudio already hands over planar stereo; raw capture is for
+         * the interleaved multichannel backends */
+        if (raw_capture)
+            t_data->raw = bcast_create(t_data->rb_size * RAW_MAX_CHANNELS * sizeof(float));
+#endif
 
 #ifdef __APPLE__
         printf("Setting up CoreAudio input...\n");
@@ -880,7 +1367,7 @@ public:
 
         // Set format to stereo float
         AudioStreamBasicDescription streamFormat;
-        streamFormat.mSampleRate = sample_rate;
+        streamFormat.mSampleRate = capture_rate;
         streamFormat.mFormatID = kAudioFormatLinearPCM;
         streamFormat.mFormatFlags = kAudioFormatFlagIsFloat | kAudioFormatFlagIsPacked | kAudioFormatFlagIsNonInterleaved;
         streamFormat.mFramesPerPacket = 1;
@@ -899,6 +1386,7 @@ public:
             fprintf(stderr, "Error: Cannot set stream format: %d\n", status);
             exit(1);
         }
+        decimate_setup(t_data, capture_rate);
 
         // Set up input callback
         AURenderCallbackStruct callbackStruct;
@@ -956,11 +1444,33 @@ public:
                 PW_KEY_NODE_DESCRIPTION,  "XY Scope visualizer",
                 PW_KEY_MEDIA_NAME,        "XY Scope capture",
                 NULL);
+        if (t_data->source > 0)
+            pw_properties_setf(props, PW_KEY_NODE_NAME, "xyscope-%u", t_data->source + 1);
         if (t_data->target[0])
             pw_properties_set(props, PW_KEY_TARGET_OBJECT, t_data->target);
         else
             pw_properties_set(props, PW_KEY_STREAM_CAPTURE_SINK, "true");
 
+        /* --pw-profile: this stream's own quantum, and optionally the
+         * graph rate with our resampler bypassed (safe only because the
+         * rate is forced, so the graph runs at it) */
+        unsigned int graph_rate    = pw_profile_graph_rate(&pw_profile);
+        unsigned int graph_quantum = pw_profile_graph_quantum(&pw_profile);
+        if (pw_profile.quantum) {
+            pw_properties_setf(props, PW_KEY_NODE_LATENCY, "%u/%u", graph_quantum, graph_rate);
+            if (pw_profile.force_quantum)
+                pw_properties_setf(props, PW_KEY_NODE_FORCE_QUANTUM, "%u", graph_quantum);
+        }
+        if (pw_profile.rate) {
+            pw_properties_setf(props, PW_KEY_NODE_RATE, "1/%u", pw_profile.rate);
+            pw_properties_setf(props, PW_KEY_NODE_FORCE_RATE, "%u", pw_profile.rate);
+            pw_properties_set(props, "resample.disable", "true");
+        }
+        if (pw_profile.quantum || pw_profile.rate)
+            fprintf(stderr, "Pipewire profile %s: quantum %u/%u%s, rate %u\n", pw_profile.name,
+                   graph_quantum, graph_rate, pw_profile.force_quantum ? " (forced)" : "",
+                   pw_profile.rate);
+
         t_data->stream = pw_stream_new_simple(
             pw_thread_loop_get_loop(t_data->loop),
             "xyscope",
@@ -974,19 +1484,35 @@ public:
             exit(1);
         }
 
-        /* Set up audio format parameters */
-        uint8_t buffer[1024];
+        /* Set up audio format parameters: --capture-format's integer
+         * format first (both 24-bit layouts for s24), then float, which
+         * Pipewire can always convert to.  It takes the first one the
+         * link accepts, so an integer-native device is read as is. */
+        uint8_t buffer[4096];
         struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
-        const struct spa_pod *params[1];
-
-        struct spa_audio_info_raw info = {};
-        info.format = SPA_AUDIO_FORMAT_F32;
-        info.rate = 0;  /* Let Pipewire negotiate native rate */
-        info.channels = t_data->channels;
-        info.position[0] = SPA_AUDIO_CHANNEL_FL;  /* Front Left */
-        info.position[1] = SPA_AUDIO_CHANNEL_FR;  /* Front Right */
-
-        params[0] = spa_format_audio_raw_build(&b, SPA_PARAM_EnumFormat, &info);
+        const struct spa_pod *params[3];
+        uint32_t formats[3];
+        uint32_t n_params = 0;
+
+        if (capture_format == SampleS16)
+            formats[n_params++] = SPA_AUDIO_FORMAT_S16;
+        else if (capture_format == SampleS24 || capture_format == SampleS24_32) {
+            formats[n_params++] = SPA_AUDIO_FORMAT_S24_32;
+            formats[n_params++] = SPA_AUDIO_FORMAT_S24;
+        }
+        else if (capture_format == SampleS32)
+            formats[n_params++] = SPA_AUDIO_FORMAT_S32;
+        formats[n_params++] = SPA_AUDIO_FORMAT_F32;
+
+        for (uint32_t p = 0; p < n_params; p++) {
+            struct spa_audio_info_raw info = {};
+            info.format = (enum spa_audio_format)formats[p];
+            info.rate = 0;  /* Let Pipewire negotiate native rate */
+            info.channels = t_data->channels;
+            info.position[0] = SPA_AUDIO_CHANNEL_FL;  /* Front Left */
+            info.position[1] = SPA_AUDIO_CHANNEL_FR;  /* Front Right */
+            params[p] = spa_format_audio_raw_build(&b, SPA_PARAM_EnumFormat, &info);
+        }
 
         /* Connect the stream */
         if (pw_stream_connect(t_data->stream,
@@ -995,7 +1521,7 @@ public:
                              (enum pw_stream_flags)(PW_STREAM_FLAG_AUTOCONNECT |
                                                    PW_STREAM_FLAG_MAP_BUFFERS |
                                                    PW_STREAM_FLAG_RT_PROCESS),
-                             params, 1) < 0) {
+                             params, n_params) < 0) {
             fprintf(stderr, "Failed to connect Pipewire stream\n");
             pw_thread_loop_unlock(t_data->loop);
             exit(1);
@@ -1005,6 +1531,216 @@ public:
 #endif
     }
 
+    /* File input backend: stand in for the capture callback, feeding
+     * the same ring with the same publish_frames() / signal_data_ready()
+     * / negotiated_sample_rate contract, so drawPlot can't tell the
+     * difference.  Paced to the file's sample rate by absolute deadline
+     * (no drift from sleep overshoot), or as fast as the history can
+     * record it with --input-fast. */
+    void runFileInput()
+    {
+        thread_data_t *t_data = getThreadData();
+        audio_file_t file;
+
+        if (!audio_file_open(&file, t_data->file))
+            exit(1);
+        printf("Input file: %s (%s, %u Hz, %u ch, %u-bit%s%s)\n", t_data->file,
+               file.kind == AudioFileFlac ? "FLAC" : "WAV", file.rate, file.channels,
+               file.bits, file.is_float ? " float" : "",
+               input_fast ? ", unpaced" : "");
+
+        t_data->file_input = true;
+        t_data->channels   = file.channels;
+        downmix_init(&t_data->downmix, file.channels, file.channel_mask);
+        decimate_setup(t_data, (int)file.rate);
+        t_data->ringbuffer = bcast_create(t_data->frame_size * t_data->rb_size);
+        t_data->negotiated_sample_rate = (int)file.rate;
+        t_data->can_process = true;
+
+        unsigned long long start = monotonic_ns();
+        unsigned long long sent  = 0;     /* frames since start */
+        bool at_end = false;
+        uint32_t rt_seen = 0;
+
+        while (!quit) {
+            rt_thread_poll(&realtime, &rt_seen, realtime.priority + RT_CAPTURE_BOOST);
+            if (t_data->pause_scope || at_end) {
+                usleep(10000);
+                start = monotonic_ns();
+                sent  = 0;
+                continue;
+            }
+
+            const float *samples;
+            size_t n = audio_file_next(&file, FILE_INPUT_QUANTUM, &samples);
+            if (n == 0) {
+                if (input_loop && file.pos > 0) {
+                    audio_file_rewind(&file);
+                    continue;
+                }
+                printf("End of input file\n");
+                at_end = true;
+                continue;
+            }
+
+            /* a real device just overwrites the oldest frames; in fast
+             * mode hold back for the ring's gate reader (the history) so
+             * every frame is recorded */
+            size_t done = 0;
+            t_data->capture_ns = monotonic_ns();
+            while (done < n && !quit) {
+                size_t room = n - done;
+                if (input_fast) {
+                    /* one frame spare for the decimator's phase */
+                    size_t gate = bcast_gate_space(t_data->ringbuffer) / sizeof(frame_t);
+                    gate = (gate ? gate - 1 : 0) * t_data->decimate.factor;
+                    if (room > gate)
+                        room = gate;
+                }
+                done += publish_frames(t_data, samples + done * file.channels, room);
+                if (!input_fast || t_data->pause_scope)
+                    break;
+                if (done < n) {
+                    signal_data_ready(t_data);
+                    usleep(1000);
+                }
+            }
+            t_data->last_write = monotonic_ns();
+            signal_data_ready(t_data);
+
+            sent += n;
+            if (!input_fast) {
+                unsigned long long due = start + sent * 1000000000ULL / file.rate;
+                unsigned long long now = monotonic_ns();
+                if (due > now)
+                    usleep((useconds_t)((due - now) / 1000));
+            }
+        }
+
+        audio_file_close(&file);
+    }
+
+    /* Shared-memory input backend: another process (a long-lived
+     * capture helper, a second xyscope with --shm-publish, a test
+     * generator) owns the ring; this thread copies from it into the
+     * source's own ring with the same publish_frames() /
+     * signal_data_ready() / negotiated_sample_rate contract as a device.
+     * It sleeps on the segment's futex between publishes rather than
+     * polling, and waits for the segment to appear or come back.
+     *
+     * On attach it starts from the oldest frames the segment still
+     * holds, gated on the history like --input-fast, so whatever the
+     * helper kept survives a restart of the GUI; after that it follows
+     * the writer like a device, never holding it up. */
+    void runShmInput()
+    {
+        thread_data_t *t_data = getThreadData();
+        shm_reader_t r;
+        frame_t *chunk = (frame_t *)malloc(SHM_INPUT_QUANTUM * sizeof(frame_t));
+        bool waiting_told = false;
+        uint32_t rt_seen = 0;
+
+        t_data->file_input = true;
+        t_data->channels   = 2;
+        downmix_init(&t_data->downmix, 2, 0);
+        t_data->ringbuffer = bcast_create(t_data->frame_size * t_data->rb_size);
+
+        while (!quit) {
+            if (!shm_reader_open(&r, t_data->shm)) {
+                if (!waiting_told)
+                    printf("Waiting for shared memory %s\n", t_data->shm);
+                waiting_told = true;
+                usleep(SHM_RETRY_US);
+                continue;
+            }
+            while (!quit && r.hdr->sample_rate == 0 && shm_reader_valid(&r))
+                usleep(10000);        /* created, nothing published yet */
+            if (!shm_reader_valid(&r)) {
+                shm_reader_close(&r);
+                continue;
+            }
+            printf("Shared-memory input: %s (pid %u, %u Hz, %.1f s ring)\n", t_data->shm,
+                   r.hdr->pid, r.hdr->sample_rate,
+                   (double)r.size / sizeof(frame_t) / (r.hdr->sample_rate ? r.hdr->sample_rate : 1));
+            waiting_told = false;
+
+            /* the renderer only attaches the history (the gate) once
+             * can_process is up, so the rate has to be set before the
+             * backfill waits for it */
+            if ((int)r.hdr->sample_rate != t_data->negotiated_sample_rate) {
+                decimate_setup(t_data, (int)r.hdr->sample_rate);
+                t_data->negotiated_sample_rate = (int)r.hdr->sample_rate;
+            }
+            t_data->can_process = true;
+
+            /* backfill only once the history is attached to gate on */
+            while (!quit && !rb_load_acquire(&t_data->ringbuffer->gate))
+                usleep(10000);
+            shm_reader_rewind(&r);
+            unsigned long long shm_lost_before = t_data->shm_lost;
+            uint64_t backfill_end = rb_load_acquire(&r.hdr->head);
+
+            while (!quit && shm_reader_valid(&r)) {
+                rt_thread_poll(&realtime, &rt_seen, realtime.priority + RT_CAPTURE_BOOST);
+                int rate = (int)r.hdr->sample_rate;
+                if (rate != t_data->negotiated_sample_rate) {
+                    decimate_setup(t_data, rate);
+                    t_data->negotiated_sample_rate = rate;
+                    t_data->can_process = true;
+                }
+                if (t_data->pause_scope) {
+                    /* like a device: what arrives while paused is gone */
+                    r.pos = rb_load_acquire(&r.hdr->head);
+                    backfill_end = 0;
+                    usleep(10000);
+                    continue;
+                }
+
+                size_t want = SHM_INPUT_QUANTUM;
+                bool backfill = r.pos < backfill_end;
+                if (backfill) {
+                    size_t gate = bcast_gate_space(t_data->ringbuffer) / sizeof(frame_t);
+                    gate = (gate ? gate - 1 : 0) * t_data->decimate.factor;
+                    if (want > gate)
+                        want = gate;
+                    if (want == 0) {
+                        signal_data_ready(t_data);
+                        usleep(1000);
+                        continue;
+                    }
+                }
+                size_t got = shm_read(&r, (char *)chunk, want * sizeof(frame_t));
+                if (got == 0) {
+                    if (shm_read_space(&r) == 0) {
+                        if (shm_reader_stale(&r))
+                            break;    /* its writer died without closing */
+                        shm_wait(&r, 100000000ULL);
+                    }
+                    continue;
+                }
+
+                /* capture time of the chunk's last frame, back from the
+                 * writer's stamp on its head */
+                uint64_t head = rb_load_acquire(&r.hdr->head);
+                unsigned long long head_ns = r.hdr->head_ns;
+                unsigned long long behind  = (head - r.pos) / sizeof(frame_t);
+                t_data->capture_ns = head_ns && rate > 0
+                                   ? head_ns - behind * 1000000000ULL / rate
+                                   : monotonic_ns();
+                publish_frames(t_data, (const float *)chunk, got / sizeof(frame_t));
+                t_data->shm_lost = r.lost / sizeof(frame_t) + shm_lost_before;
+                t_data->last_write = monotonic_ns();
+                signal_data_ready(t_data);
+            }
+
+            if (!quit)
+                printf("Shared memory %s went away; waiting for it to return\n", t_data->shm);
+            shm_reader_close(&r);
+        }
+
+        free(chunk);
+    }
+
     void quitNow()
     {
         quit = true;
@@ -1013,7 +1749,7 @@ public:
     /* accessor methods */
     thread_data_t *getThreadData(void)
     {
-        return &Thread_Data;
+        return &Thread_Data[source];
     }
 };
 
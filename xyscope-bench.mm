@@ -0,0 +1,877 @@
+/*
+ * xyscope-bench - Microbenchmarks for the audio-path kernels
+ *
+ * Runs without a display or audio device.  Each benchmark checks its
+ * result against the reference implementation before timing it, so a
+ * fast-but-wrong kernel fails loudly instead of posting a good number.
+ *
+ *   downmix   ns/frame for the per-frame downmix_stereo() versus the
+ *             block downmix_block() kernel at 2, 6 and 8 channels
+ *   convert   ns/sample for int -> float capture conversion per integer
+ *             format, and the fused convert + downmix into frames for
+ *             stereo and 5.1 S16
+ *   ring      two-thread SPSC throughput of xyscope-ringbuffer.h versus
+ *             the original ring with both indices on one line and no
+ *             cached index, for per-frame writes (calibrate) and
+ *             per-quantum writes
+ *   triple    window handoff through xyscope-triple.h with a producer
+ *             and a consumer both running flat out: every window taken
+ *             must be whole and no older than the last, and published
+ *             must equal taken plus dropped
+ *   broadcast one writer into xyscope-broadcast.h with readers at three
+ *             paces, the slowest lapped on purpose: every frame a reader
+ *             gets must sit at its own position, and frames read plus
+ *             frames lost must add up to everything written
+ *   clock     the audio/display clock recovery of xyscope-clock.h against
+ *             a simulated capture ring (quantum-sized steps, drifting
+ *             crystal, jittery refresh): after it settles the window must
+ *             never run past the head and must advance by about the true
+ *             samples per refresh every frame
+ *
+ * Usage: xyscope-bench [name ...]     (default: run everything)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <chrono>
+
+#include "xyscope-shared.h"
+#include "xyscope-ringbuffer.h"
+#include "xyscope-downmix.h"
+#include "xyscope-decimate.h"
+#include "xyscope-convert.h"
+#include "xyscope-triple.h"
+#include "xyscope-broadcast.h"
+#include "xyscope-clock.h"
+
+/* ---- Helpers ---- */
+
+static double now_ns(void)
+{
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static unsigned int rng_state = 12345;
+static float rand_sample(void)
+{
+    rng_state = rng_state * 1664525u + 1013904223u;
+    return (float)((int)(rng_state >> 8) - (1 << 23)) / (float)(1 << 23);
+}
+
+/* Keep the optimiser from discarding a result */
+static volatile float sink;
+
+/* ---- downmix ---- */
+
+#define DOWNMIX_FRAMES  4096    /* one large Pipewire quantum */
+#define DOWNMIX_REPEATS 2000
+
+static bool bench_downmix(void)
+{
+    static const unsigned int layouts[] = { 2, 6, 8 };
+    bool ok = true;
+
+    printf("downmix: %d frames x %d repeats\n", DOWNMIX_FRAMES, DOWNMIX_REPEATS);
+    printf("  %-4s %14s %14s %8s\n", "ch", "per-frame ns", "block ns", "speedup");
+
+    for (unsigned int l = 0; l < sizeof(layouts) / sizeof(layouts[0]); l++) {
+        unsigned int ch = layouts[l];
+        float   *src = (float *)malloc(DOWNMIX_FRAMES * ch * sizeof(float));
+        frame_t *ref = (frame_t *)malloc(DOWNMIX_FRAMES * sizeof(frame_t));
+        frame_t *out = (frame_t *)malloc(DOWNMIX_FRAMES * sizeof(frame_t));
+        for (unsigned int i = 0; i < DOWNMIX_FRAMES * ch; i++)
+            src[i] = rand_sample();
+
+        downmix_t dm;
+        downmix_init(&dm, ch, 0);
+
+        for (unsigned int i = 0; i < DOWNMIX_FRAMES; i++)
+            downmix_stereo(src + i * ch, ch, 0,
+                           &ref[i].left_channel, &ref[i].right_channel);
+        downmix_block(&dm, src, out, DOWNMIX_FRAMES);
+        if (memcmp(ref, out, DOWNMIX_FRAMES * sizeof(frame_t)) != 0) {
+            printf("  %-4u MISMATCH: block kernel differs from downmix_stereo()\n", ch);
+            ok = false;
+        }
+
+        double t0 = now_ns();
+        for (int r = 0; r < DOWNMIX_REPEATS; r++) {
+            for (unsigned int i = 0; i < DOWNMIX_FRAMES; i++)
+                downmix_stereo(src + i * ch, ch, 0,
+                               &ref[i].left_channel, &ref[i].right_channel);
+            sink = ref[r % DOWNMIX_FRAMES].left_channel;
+        }
+        double t1 = now_ns();
+        for (int r = 0; r < DOWNMIX_REPEATS; r++) {
+            downmix_block(&dm, src, out, DOWNMIX_FRAMES);
+            sink = out[r % DOWNMIX_FRAMES].left_channel;
+        }
+        double t2 = now_ns();
+
+        double per_frame = (t1 - t0) / ((double)DOWNMIX_FRAMES * DOWNMIX_REPEATS);
+        double block     = (t2 - t1) / ((double)DOWNMIX_FRAMES * DOWNMIX_REPEATS);
+        printf("  %-4u %14.3f %14.3f %7.2fx\n", ch, per_frame, block,
+               block > 0.0 ? per_frame / block : 0.0);
+
+        free(src);
+        free(ref);
+        free(out);
+    }
+    return ok;
+}
+
+/* ---- decimate ---- */
+
+#define DECIMATE_FRAMES  (DECIMATE_CHUNK * 16)
+#define DECIMATE_REPEATS 200
+
+/* Push src through d in pieces of `step` frames, collecting outputs */
+static size_t decimate_all(decimator_t *d, const frame_t *src, size_t n,
+                           size_t step, frame_t *out)
+{
+    size_t k = 0;
+    for (size_t i = 0; i < n; i += step) {
+        size_t cnt = n - i < step ? n - i : step;
+        memcpy(decimate_input(d), src + i, cnt * sizeof(frame_t));
+        size_t got = decimate_run(d, cnt);
+        memcpy(out + k, d->out, got * sizeof(frame_t));
+        k += got;
+    }
+    return k;
+}
+
+/* Peak output level for a full-scale sine at `freq` of the input rate */
+static float decimate_gain(decimator_t *d, double freq)
+{
+    static frame_t src[DECIMATE_FRAMES], out[DECIMATE_FRAMES];
+    for (unsigned int i = 0; i < DECIMATE_FRAMES; i++)
+        src[i].left_channel = src[i].right_channel = (float)sin(2.0 * DECIMATE_PI * freq * i);
+    decimate_init(d, d->factor);
+    size_t k = decimate_all(d, src, DECIMATE_FRAMES, DECIMATE_CHUNK, out);
+    float peak = 0.0f;
+    for (size_t i = k / 2; i < k; i++)          /* past the filter's settling */
+        peak = fmaxf(peak, fabsf(out[i].left_channel));
+    return peak;
+}
+
+static bool bench_decimate(void)
+{
+    static const unsigned int factors[] = { 2, 4, 8 };
+    static decimator_t d;
+    bool ok = true;
+
+    printf("decimate: %d frames x %d repeats\n", DECIMATE_FRAMES, DECIMATE_REPEATS);
+    printf("  %-4s %5s %14s %14s %8s %9s %9s\n", "M", "taps", "scalar ns/in", "simd ns/in",
+           "speedup", "pass dB", "stop dB");
+
+    frame_t *src = (frame_t *)malloc(DECIMATE_FRAMES * sizeof(frame_t));
+    frame_t *ref = (frame_t *)malloc(DECIMATE_FRAMES * sizeof(frame_t));
+    frame_t *out = (frame_t *)malloc(DECIMATE_FRAMES * sizeof(frame_t));
+    for (unsigned int i = 0; i < DECIMATE_FRAMES; i++) {
+        src[i].left_channel  = rand_sample();
+        src[i].right_channel = rand_sample();
+    }
+
+    for (unsigned int f = 0; f < sizeof(factors) / sizeof(factors[0]); f++) {
+        unsigned int m = factors[f];
+
+        /* scalar reference, one output at a time over the whole input */
+        decimate_init(&d, m);
+        size_t n_ref = 0;
+        double t0 = now_ns();
+        for (int r = 0; r < DECIMATE_REPEATS; r++) {
+            n_ref = 0;
+            for (size_t p = m - 1; p < DECIMATE_FRAMES; p += m) {
+                if (p + 1 < d.taps) {         /* window reaches before the input */
+                    frame_t win[DECIMATE_MAX_TAPS];
+                    size_t pad = d.taps - 1 - p;
+                    memset(win, 0, pad * sizeof(frame_t));
+                    memcpy(win + pad, src, (p + 1) * sizeof(frame_t));
+                    decimate_dot_scalar(&d, win, &ref[n_ref++]);
+                }
+                else
+                    decimate_dot_scalar(&d, src + p + 1 - d.taps, &ref[n_ref++]);
+            }
+            sink = ref[r % n_ref].left_channel;
+        }
+        double t1 = now_ns();
+        size_t n_out = 0;
+        for (int r = 0; r < DECIMATE_REPEATS; r++) {
+            decimate_init(&d, m);
+            n_out = decimate_all(&d, src, DECIMATE_FRAMES, DECIMATE_CHUNK, out);
+            sink = out[r % n_out].left_channel;
+        }
+        double t2 = now_ns();
+
+        /* SIMD sums in a different order: compare to a tolerance */
+        float err = 0.0f;
+        for (size_t i = 0; i < n_out && i < n_ref; i++)
+            err = fmaxf(err, fabsf(out[i].left_channel  - ref[i].left_channel)
+                           + fabsf(out[i].right_channel - ref[i].right_channel));
+        if (n_out != n_ref || err > 1e-5f) {
+            printf("  %-4u MISMATCH: %zu/%zu outputs, max error %g\n", m, n_out, n_ref, err);
+            ok = false;
+        }
+
+        /* odd-sized pieces must give the same stream */
+        decimate_init(&d, m);
+        size_t n_odd = decimate_all(&d, src, DECIMATE_FRAMES, 333, ref);
+        if (n_odd != n_out || memcmp(ref, out, n_out * sizeof(frame_t)) != 0) {
+            printf("  %-4u MISMATCH: output depends on chunking\n", m);
+            ok = false;
+        }
+
+        double pass = 20.0 * log10(decimate_gain(&d, 0.3 / m));
+        double stop = 20.0 * log10(decimate_gain(&d, 0.6 / m) + 1e-9);
+        double scalar = (t1 - t0) / ((double)DECIMATE_FRAMES * DECIMATE_REPEATS);
+        double simd   = (t2 - t1) / ((double)DECIMATE_FRAMES * DECIMATE_REPEATS);
+        printf("  %-4u %5u %14.3f %14.3f %7.2fx %9.2f %9.1f\n", m, d.taps, scalar, simd,
+               simd > 0.0 ? scalar / simd : 0.0, pass, stop);
+        if (pass < -0.5 || stop > -60.0) {
+            printf("  %-4u FILTER: passband or stopband out of range\n", m);
+            ok = false;
+        }
+    }
+
+    free(src);
+    free(ref);
+    free(out);
+    return ok;
+}
+
+/* ---- convert ---- */
+
+#define CONVERT_SAMPLES 8192    /* a 4096-frame stereo quantum */
+#define CONVERT_REPEATS 4000
+
+/* One sample the long way, through double, as a reference */
+static float convert_ref(const unsigned char *src, sample_format_t fmt, size_t i)
+{
+    switch (fmt) {
+        case SampleS16: {
+            int16_t v;
+            memcpy(&v, src + i * 2, 2);
+            return (float)(v / 32768.0);
+        }
+        case SampleS24: {
+            const unsigned char *b = src + i * 3;
+            int32_t v = b[0] | (b[1] << 8) | (b[2] << 16);
+            if (v & 0x800000) v -= 0x1000000;
+            return (float)(v / 8388608.0);
+        }
+        case SampleS24_32: {
+            int32_t v;
+            memcpy(&v, src + i * 4, 4);
+            v &= 0xffffff;
+            if (v & 0x800000) v -= 0x1000000;
+            return (float)(v / 8388608.0);
+        }
+        default: {
+            int32_t v;
+            memcpy(&v, src + i * 4, 4);
+            return (float)(v / 2147483648.0);
+        }
+    }
+}
+
+static bool bench_convert(void)
+{
+    static const sample_format_t formats[] = { SampleS16, SampleS24, SampleS24_32, SampleS32 };
+    bool ok = true;
+
+    printf("convert: %d samples x %d repeats\n", CONVERT_SAMPLES, CONVERT_REPEATS);
+    printf("  %-7s %14s\n", "format", "ns/sample");
+
+    unsigned char *src = (unsigned char *)malloc(CONVERT_SAMPLES * 4);
+    float *ref = (float *)malloc(CONVERT_SAMPLES * sizeof(float));
+    float *out = (float *)malloc(CONVERT_SAMPLES * sizeof(float));
+    for (unsigned int i = 0; i < CONVERT_SAMPLES * 4; i++) {
+        rng_state = rng_state * 1664525u + 1013904223u;
+        src[i] = (unsigned char)(rng_state >> 24);
+    }
+
+    for (unsigned int f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+        sample_format_t fmt = formats[f];
+        for (unsigned int i = 0; i < CONVERT_SAMPLES; i++)
+            ref[i] = convert_ref(src, fmt, i);
+        convert_block(src, fmt, out, CONVERT_SAMPLES);
+        if (memcmp(ref, out, CONVERT_SAMPLES * sizeof(float)) != 0) {
+            printf("  %-7s MISMATCH: convert_block() differs from the reference\n",
+                   sample_format_name(fmt));
+            ok = false;
+        }
+
+        double t0 = now_ns();
+        for (int r = 0; r < CONVERT_REPEATS; r++) {
+            convert_block(src, fmt, out, CONVERT_SAMPLES);
+            sink = out[r % CONVERT_SAMPLES];
+        }
+        double t1 = now_ns();
+        printf("  %-7s %14.3f\n", sample_format_name(fmt),
+               (t1 - t0) / ((double)CONVERT_SAMPLES * CONVERT_REPEATS));
+    }
+
+    /* fused S16 -> frames versus convert-then-downmix, per frame */
+    printf("  %-7s %14s %14s %8s\n", "s16->fr", "two-pass ns", "fused ns", "speedup");
+    static const unsigned int layouts[] = { 2, 6 };
+    for (unsigned int l = 0; l < sizeof(layouts) / sizeof(layouts[0]); l++) {
+        unsigned int ch = layouts[l];
+        size_t n = CONVERT_SAMPLES / ch;
+        downmix_t dm;
+        downmix_init(&dm, ch, 0);
+        frame_t *fr_ref = (frame_t *)malloc(n * sizeof(frame_t));
+        frame_t *fr_out = (frame_t *)malloc(n * sizeof(frame_t));
+
+        double t0 = now_ns();
+        for (int r = 0; r < CONVERT_REPEATS; r++) {
+            convert_block(src, SampleS16, ref, n * ch);
+            downmix_block(&dm, ref, fr_ref, n);
+            sink = fr_ref[r % n].left_channel;
+        }
+        double t1 = now_ns();
+        for (int r = 0; r < CONVERT_REPEATS; r++) {
+            downmix_native(&dm, src, SampleS16, fr_out, n);
+            sink = fr_out[r % n].left_channel;
+        }
+        double t2 = now_ns();
+        if (memcmp(fr_ref, fr_out, n * sizeof(frame_t)) != 0) {
+            printf("  %-7u MISMATCH: fused downmix differs\n", ch);
+            ok = false;
+        }
+        double two   = (t1 - t0) / ((double)n * CONVERT_REPEATS);
+        double fused = (t2 - t1) / ((double)n * CONVERT_REPEATS);
+        printf("  %u ch    %14.3f %14.3f %7.2fx\n", ch, two, fused,
+               fused > 0.0 ? two / fused : 0.0);
+        free(fr_ref);
+        free(fr_out);
+    }
+
+    free(src);
+    free(ref);
+    free(out);
+    return ok;
+}
+
+/* ---- ring ---- */
+
+/* The ring as it was before the cache-line split: both indices share a
+ * line and every space check acquire-loads the other side's index. */
+typedef struct {
+    char   *buf;
+    size_t  size;
+    size_t  write_ptr;
+    size_t  read_ptr;
+} legacy_rb_t;
+
+static legacy_rb_t *legacy_rb_create(size_t size)
+{
+    legacy_rb_t *rb = (legacy_rb_t *)malloc(sizeof(legacy_rb_t));
+    size_t power_of_two = 1;
+    while (power_of_two < size) power_of_two <<= 1;
+    rb->size = power_of_two;
+    rb->buf = (char *)malloc(rb->size);
+    rb->write_ptr = 0;
+    rb->read_ptr = 0;
+    return rb;
+}
+
+static void legacy_rb_free(legacy_rb_t *rb)
+{
+    free(rb->buf);
+    free(rb);
+}
+
+static inline size_t legacy_rb_write(legacy_rb_t *rb, const char *src, size_t cnt)
+{
+    size_t w = rb->write_ptr;
+    size_t free_cnt = (rb_load_acquire(&rb->read_ptr) - w - 1) & (rb->size - 1);
+    size_t to_write = cnt > free_cnt ? free_cnt : cnt;
+    size_t n1 = to_write;
+    if (w + to_write > rb->size)
+        n1 = rb->size - w;
+    memcpy(rb->buf + w, src, n1);
+    if (to_write > n1)
+        memcpy(rb->buf, src + n1, to_write - n1);
+    rb_store_release(&rb->write_ptr, (w + to_write) & (rb->size - 1));
+    return to_write;
+}
+
+static inline size_t legacy_rb_read(legacy_rb_t *rb, char *dest, size_t cnt)
+{
+    size_t r = rb->read_ptr;
+    size_t avail = (rb_load_acquire(&rb->write_ptr) - r) & (rb->size - 1);
+    size_t to_read = cnt > avail ? avail : cnt;
+    size_t n1 = to_read;
+    if (r + to_read > rb->size)
+        n1 = rb->size - r;
+    memcpy(dest, rb->buf + r, n1);
+    if (to_read > n1)
+        memcpy(dest + n1, rb->buf, to_read - n1);
+    rb_store_release(&rb->read_ptr, (r + to_read) & (rb->size - 1));
+    return to_read;
+}
+
+struct legacy_ring_ops {
+    typedef legacy_rb_t rb_t;
+    static rb_t  *create(size_t size) { return legacy_rb_create(size); }
+    static void   destroy(rb_t *rb)   { legacy_rb_free(rb); }
+    static size_t write(rb_t *rb, const char *src, size_t cnt)
+        { return legacy_rb_write(rb, src, cnt); }
+    static size_t read(rb_t *rb, char *dest, size_t cnt)
+        { return legacy_rb_read(rb, dest, cnt); }
+};
+
+struct padded_ring_ops {
+    typedef ringbuffer_t rb_t;
+    static rb_t  *create(size_t size) { return ringbuffer_create(size); }
+    static void   destroy(rb_t *rb)   { ringbuffer_free(rb); }
+    static size_t write(rb_t *rb, const char *src, size_t cnt)
+        { return ringbuffer_write(rb, src, cnt); }
+    static size_t read(rb_t *rb, char *dest, size_t cnt)
+        { return ringbuffer_read(rb, dest, cnt); }
+};
+
+#define RING_FRAMES     (1 << 14)   /* ring capacity */
+#define RING_TOTAL      (1 << 24)   /* frames pushed per run */
+
+template <class Ops>
+struct ring_job {
+    typename Ops::rb_t *rb;
+    size_t chunk;                   /* frames per write / read call */
+    bool   ok;
+};
+
+/* Each frame carries its sequence number in the left channel's bits so
+ * the consumer can prove nothing was lost, duplicated or reordered. */
+static inline frame_t seq_frame(unsigned int n)
+{
+    frame_t f;
+    memcpy(&f.left_channel, &n, sizeof(n));
+    f.right_channel = 0.0f;
+    return f;
+}
+
+/* Both ends work in bytes: with one byte of the ring kept empty, a
+ * call can move a partial frame, and the next call picks up the rest. */
+template <class Ops>
+static void *ring_producer(void *arg)
+{
+    ring_job<Ops> *job = (ring_job<Ops> *)arg;
+    frame_t *chunk = (frame_t *)malloc(job->chunk * sizeof(frame_t));
+    unsigned int n = 0;
+    while (n < RING_TOTAL) {
+        size_t want = job->chunk;
+        if (want > RING_TOTAL - n) want = RING_TOTAL - n;
+        for (size_t i = 0; i < want; i++)
+            chunk[i] = seq_frame(n + (unsigned int)i);
+        size_t done = 0, bytes = want * sizeof(frame_t);
+        while (done < bytes) {
+            size_t got = Ops::write(job->rb, (const char *)chunk + done,
+                                    bytes - done);
+            if (got == 0)
+                sched_yield();
+            done += got;
+        }
+        n += (unsigned int)want;
+    }
+    free(chunk);
+    return NULL;
+}
+
+template <class Ops>
+static void *ring_consumer(void *arg)
+{
+    ring_job<Ops> *job = (ring_job<Ops> *)arg;
+    size_t chunk_bytes = job->chunk * sizeof(frame_t);
+    frame_t *chunk = (frame_t *)malloc(chunk_bytes);
+    size_t have = 0;
+    unsigned int n = 0;
+    job->ok = true;
+    while (n < RING_TOTAL) {
+        size_t got = Ops::read(job->rb, (char *)chunk + have, chunk_bytes - have);
+        if (got == 0) {
+            sched_yield();
+            continue;
+        }
+        have += got;
+        size_t frames = have / sizeof(frame_t);
+        for (size_t i = 0; i < frames; i++) {
+            unsigned int seq;
+            memcpy(&seq, &chunk[i].left_channel, sizeof(seq));
+            if (seq != n + i)
+                job->ok = false;
+        }
+        n += (unsigned int)frames;
+        have -= frames * sizeof(frame_t);
+        memmove(chunk, chunk + frames, have);
+    }
+    free(chunk);
+    return NULL;
+}
+
+/* Returns Mframes/s, or a negative value if the stream was corrupted */
+template <class Ops>
+static double ring_run(size_t chunk)
+{
+    ring_job<Ops> job;
+    job.rb    = Ops::create(RING_FRAMES * sizeof(frame_t));
+    job.chunk = chunk;
+    job.ok    = false;
+
+    pthread_t prod, cons;
+    double t0 = now_ns();
+    pthread_create(&cons, NULL, ring_consumer<Ops>, &job);
+    pthread_create(&prod, NULL, ring_producer<Ops>, &job);
+    pthread_join(prod, NULL);
+    pthread_join(cons, NULL);
+    double t1 = now_ns();
+
+    Ops::destroy(job.rb);
+    if (!job.ok)
+        return -1.0;
+    return RING_TOTAL / ((t1 - t0) * 1e-3);
+}
+
+static bool bench_ring(void)
+{
+    static const size_t chunks[] = { 1, 64, 1024 };
+    bool ok = true;
+
+    printf("ring: %d frames through a %d-frame ring, two threads\n",
+           RING_TOTAL, RING_FRAMES);
+    printf("  %-6s %14s %14s %8s\n", "chunk", "legacy Mf/s", "padded Mf/s", "speedup");
+
+    for (unsigned int c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+        double legacy = ring_run<legacy_ring_ops>(chunks[c]);
+        double padded = ring_run<padded_ring_ops>(chunks[c]);
+        if (legacy < 0.0 || padded < 0.0) {
+            printf("  %-6zu MISMATCH: consumer saw frames out of sequence (%s)\n",
+                   chunks[c], padded < 0.0 ? "padded" : "legacy");
+            ok = false;
+            continue;
+        }
+        printf("  %-6zu %14.1f %14.1f %7.2fx\n", chunks[c], legacy, padded,
+               padded / legacy);
+    }
+    return ok;
+}
+
+/* ---- Triple buffer ---- */
+
+#define TRIPLE_FRAMES   1024        /* frames per window */
+#define TRIPLE_TOTAL    (1 << 20)   /* windows published */
+
+typedef struct {
+    triple_t t;
+    frame_t *buf[3];
+    volatile bool done;
+    double publish_ns;
+} triple_job_t;
+
+/* Every frame of window n carries n, so a torn window shows up as a
+ * mix of sequence numbers */
+static void *triple_producer(void *arg)
+{
+    triple_job_t *job = (triple_job_t *)arg;
+    double t0 = now_ns();
+    for (unsigned int n = 1; n <= TRIPLE_TOTAL; n++) {
+        frame_t *w = (frame_t *)triple_back(&job->t);
+        frame_t f = seq_frame(n);
+        for (unsigned int i = 0; i < TRIPLE_FRAMES; i++)
+            w[i] = f;
+        triple_publish(&job->t);
+    }
+    job->publish_ns = (now_ns() - t0) / TRIPLE_TOTAL;
+    rb_store_release(&job->done, true);
+    return NULL;
+}
+
+static bool triple_check(const frame_t *w, unsigned int *last)
+{
+    unsigned int first, seq;
+    memcpy(&first, &w[0].left_channel, sizeof(first));
+    for (unsigned int i = 1; i < TRIPLE_FRAMES; i++) {
+        memcpy(&seq, &w[i].left_channel, sizeof(seq));
+        if (seq != first)
+            return false;
+    }
+    if (first < *last)
+        return false;
+    *last = first;
+    return true;
+}
+
+static bool bench_triple(void)
+{
+    triple_job_t job;
+    for (unsigned int k = 0; k < 3; k++)
+        job.buf[k] = (frame_t *)calloc(TRIPLE_FRAMES, sizeof(frame_t));
+    triple_init(&job.t, job.buf[0], job.buf[1], job.buf[2]);
+    job.done = false;
+
+    printf("triple: %d windows of %d frames, producer and consumer flat out\n",
+           TRIPLE_TOTAL, TRIPLE_FRAMES);
+
+    pthread_t prod;
+    unsigned int last = 0;
+    bool ok = true;
+    double t0 = now_ns();
+    pthread_create(&prod, NULL, triple_producer, &job);
+    while (!rb_load_acquire(&job.done))
+        if (!triple_check((const frame_t *)triple_take(&job.t), &last))
+            ok = false;
+    pthread_join(prod, NULL);
+    if (!triple_check((const frame_t *)triple_take(&job.t), &last))
+        ok = false;
+    double t1 = now_ns();
+
+    const triple_t *t = &job.t;
+    unsigned long long takes = t->taken + t->repeated;
+    printf("  published %llu, taken %llu, dropped %llu, repeated %llu\n",
+           t->published, t->taken, t->dropped, t->repeated);
+    printf("  %.1f ns/publish, %.1f ns/take\n", job.publish_ns,
+           takes ? (t1 - t0) / takes : 0.0);
+    if (!ok)
+        printf("  MISMATCH: consumer saw a torn or out-of-order window\n");
+    if (last != TRIPLE_TOTAL || t->published != t->taken + t->dropped) {
+        printf("  MISMATCH: newest window %u, or counts don't add up\n", last);
+        ok = false;
+    }
+
+    for (unsigned int k = 0; k < 3; k++)
+        free(job.buf[k]);
+    return ok;
+}
+
+/* ---- Broadcast ring ---- */
+
+#define BCAST_RING      (1 << 16)   /* bytes: 8192 frames */
+#define BCAST_QUANTUM   256         /* frames per write */
+#define BCAST_TOTAL     (1 << 22)   /* frames written */
+#define BCAST_READERS   3
+
+typedef struct {
+    bcast_ring_t *ring;
+    volatile bool done;
+    double write_ns;
+} bcast_job_t;
+
+typedef struct {
+    bcast_job_t *job;
+    bcast_reader_t rd;
+    size_t chunk;                   /* frames per read call */
+    unsigned int nap_us;            /* pause after each read */
+    unsigned long long frames;      /* frames read */
+    bool ok;
+} bcast_cursor_t;
+
+/* Frame n of the stream carries n, so it must turn up at byte n * 8 */
+static void *bcast_writer(void *arg)
+{
+    bcast_job_t *job = (bcast_job_t *)arg;
+    frame_t chunk[BCAST_QUANTUM];
+    double t0 = now_ns();
+    for (unsigned int n = 0; n < BCAST_TOTAL; n += BCAST_QUANTUM) {
+        for (unsigned int i = 0; i < BCAST_QUANTUM; i++)
+            chunk[i] = seq_frame(n + i);
+        bcast_write(job->ring, (const char *)chunk, sizeof(chunk));
+        if ((n / BCAST_QUANTUM) % 16 == 0)
+            sched_yield();
+    }
+    job->write_ns = (now_ns() - t0) / (BCAST_TOTAL / BCAST_QUANTUM);
+    rb_store_release(&job->done, true);
+    return NULL;
+}
+
+static void *bcast_consumer(void *arg)
+{
+    bcast_cursor_t *c = (bcast_cursor_t *)arg;
+    frame_t *buf = (frame_t *)malloc(c->chunk * sizeof(frame_t));
+    for (;;) {
+        bool done = rb_load_acquire(&c->job->done);
+        size_t got = bcast_read(&c->rd, (char *)buf, c->chunk * sizeof(frame_t));
+        if (got == 0) {
+            if (done && c->rd.pos == rb_load_acquire(&c->job->ring->head))
+                break;
+            sched_yield();
+            continue;
+        }
+        for (size_t i = 0; i < got / sizeof(frame_t); i++) {
+            unsigned int seq;
+            memcpy(&seq, &buf[i].left_channel, sizeof(seq));
+            if (seq != (c->rd.pos - got) / sizeof(frame_t) + i)
+                c->ok = false;
+        }
+        c->frames += got / sizeof(frame_t);
+        if (c->nap_us)
+            usleep(c->nap_us);
+    }
+    free(buf);
+    return NULL;
+}
+
+static bool bench_broadcast(void)
+{
+    static const size_t chunks[BCAST_READERS] = { 512, 1024, 2048 };
+    static const unsigned int naps[BCAST_READERS] = { 0, 0, 2000 };
+    bcast_job_t job;
+    bcast_cursor_t cur[BCAST_READERS];
+    pthread_t writer, readers[BCAST_READERS];
+    bool ok = true;
+
+    job.ring = bcast_create(BCAST_RING);
+    job.done = false;
+    printf("broadcast: %d frames in %d-frame writes, %d KB ring, %d readers\n",
+           BCAST_TOTAL, BCAST_QUANTUM, BCAST_RING / 1024, BCAST_READERS);
+
+    for (unsigned int k = 0; k < BCAST_READERS; k++) {
+        cur[k].job    = &job;
+        cur[k].chunk  = chunks[k];
+        cur[k].nap_us = naps[k];
+        cur[k].frames = 0;
+        cur[k].ok     = true;
+        bcast_reader_init(&cur[k].rd, job.ring);
+        pthread_create(&readers[k], NULL, bcast_consumer, &cur[k]);
+    }
+    pthread_create(&writer, NULL, bcast_writer, &job);
+    pthread_join(writer, NULL);
+    for (unsigned int k = 0; k < BCAST_READERS; k++)
+        pthread_join(readers[k], NULL);
+
+    printf("  %.1f ns/write of %d frames\n", job.write_ns, BCAST_QUANTUM);
+    printf("  %-8s %6s %12s %12s %9s\n", "reader", "chunk", "read", "lost", "overruns");
+    for (unsigned int k = 0; k < BCAST_READERS; k++) {
+        const bcast_cursor_t *c = &cur[k];
+        unsigned long long lost = c->rd.lost / sizeof(frame_t);
+        printf("  %-8u %6zu %12llu %12llu %9llu\n", k, c->chunk, c->frames, lost,
+               c->rd.overruns);
+        if (!c->ok)
+            printf("  MISMATCH: reader %u got a frame out of place\n", k);
+        if (c->frames + lost != BCAST_TOTAL) {
+            printf("  MISMATCH: reader %u read + lost != written\n", k);
+            ok = false;
+        }
+        ok = ok && c->ok;
+    }
+
+    bcast_free(job.ring);
+    return ok;
+}
+
+/* ---- Clock recovery ---- */
+
+#define CLOCK_SECONDS 120.0
+#define CLOCK_SETTLE  20.0              /* seconds ignored while it locks */
+
+typedef struct {
+    double sample_rate;                 /* nominal */
+    double ppm;                         /* how far the audio clock is off */
+    double refresh;                     /* actual display rate */
+    int frame_rate;                     /* what the display mode reports */
+    unsigned int quantum;
+} clock_case_t;
+
+/* Deterministic: refresh times jitter by up to +-0.5 ms, as a render
+ * thread's wakeups do; the head is the last whole quantum delivered */
+static bool clock_run(const clock_case_t *k)
+{
+    clock_dll_t d;
+    double fs = k->sample_rate * (1.0 + k->ppm * 1e-6);
+    double truth = fs / k->refresh;
+    double prev = 0.0, worst = 0.0, sum = 0.0, sum2 = 0.0;
+    unsigned long long frames = 0, overrun = 0;
+    bool ok = true;
+
+    clock_dll_init(&d, k->sample_rate, k->frame_rate);
+    rng_state = 12345;
+    for (unsigned long long f = 0; f < CLOCK_SECONDS * k->refresh; f++) {
+        double t = f / k->refresh + rand_sample() * 0.0005;
+        if (t < 0.0) t = 0.0;
+        unsigned long long head = (unsigned long long)(t * fs) / k->quantum * k->quantum;
+        double end = clock_dll_update(&d, head);
+        if (t >= CLOCK_SETTLE) {
+            double adv = end - prev;
+            double dev = fabs(adv - truth);
+            if (dev > worst) worst = dev;
+            if (end > (double)head) overrun++;
+            sum  += adv;
+            sum2 += adv * adv;
+            frames++;
+        }
+        prev = end;
+    }
+
+    double mean = sum / frames;
+    double sd   = sqrt(sum2 / frames - mean * mean);
+    printf("  %6.0f Hz %+4.0f ppm, %7.3f Hz refresh, quantum %4u: %9.3f frames/refresh"
+           " (true %9.3f, naive %d), sd %.2f, worst %.1f, %llu past head, %llu relocks\n",
+           k->sample_rate, k->ppm, k->refresh, k->quantum, d.rate, truth,
+           (int)k->sample_rate / k->frame_rate, sd, worst, overrun, d.relocks);
+    if (overrun) {
+        printf("  MISMATCH: window ran past the head\n");
+        ok = false;
+    }
+    if (worst > truth * 0.1 || fabs(mean - truth) > truth * 1e-4 || d.relocks) {
+        printf("  MISMATCH: advance did not track the writer\n");
+        ok = false;
+    }
+    return ok;
+}
+
+static bool bench_clock(void)
+{
+    static const clock_case_t cases[] = {
+        { 44100.0,  35.0, 144.0,  144, 256  },
+        { 48000.0, -20.0, 59.94,  60,  1024 },
+        { 96000.0,  80.0, 120.0,  120, 4096 },
+        { 48000.0,   0.0, 165.0,  165, 64   },
+    };
+    bool ok = true;
+
+    printf("clock: %.0f s per case, first %.0f s to settle\n", CLOCK_SECONDS, CLOCK_SETTLE);
+    for (unsigned int i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+        ok = clock_run(&cases[i]) && ok;
+    return ok;
+}
+
+/* ---- Driver ---- */
+
+typedef struct {
+    const char *name;
+    bool (*run)(void);
+} bench_t;
+
+static const bench_t benches[] = {
+    { "downmix",   bench_downmix },
+    { "decimate",  bench_decimate },
+    { "convert",   bench_convert },
+    { "ring",      bench_ring },
+    { "triple",    bench_triple },
+    { "broadcast", bench_broadcast },
+    { "clock",     bench_clock },
+};
+
+int main(int argc, char *argv[])
+{
+    unsigned int n_benches = sizeof(benches) / sizeof(benches[0]);
+    bool ok = true;
+
+    for (unsigned int b = 0; b < n_benches; b++) {
+        bool selected = (argc < 2);
+        for (int i = 1; i < argc; i++)
+            if (!strcmp(argv[i], benches[b].name))
+                selected = true;
+        if (!selected)
+            continue;
+        if (!benches[b].run())
+            ok = false;
+        printf("\n");
+    }
+    return ok ? 0 : 1;
+}
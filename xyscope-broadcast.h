@@ -0,0 +1,232 @@
+/*
+ *  xyscope-broadcast.h
+ *  Single-writer, many-reader broadcast ring: one copy of the captured
+ *  frames, read by any number of independent cursors.
+ *
+ *  Copyright (c) 2006-2007 by Chris Reaume <chris@flatlan.net>
+ *    All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+
+#ifndef XYSCOPE_BROADCAST_H
+#define XYSCOPE_BROADCAST_H
+
+#include <stdint.h>
+#include "xyscope-ringbuffer.h"
+
+#if defined(__GNUC__) || defined(__clang__)
+#define bcast_store(ptr, v)     __atomic_store_n(ptr, v, __ATOMIC_RELAXED)
+#define bcast_load(ptr)         __atomic_load_n(ptr, __ATOMIC_RELAXED)
+#define bcast_fence_release()   __atomic_thread_fence(__ATOMIC_RELEASE)
+#define bcast_fence_acquire()   __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#else
+#define bcast_store(ptr, v)     InterlockedExchange64((volatile LONG64 *)(ptr), (LONG64)(v))
+#define bcast_load(ptr)         ((uint64_t)InterlockedCompareExchange64((volatile LONG64 *)(ptr), 0, 0))
+#define bcast_fence_release()   MemoryBarrier()
+#define bcast_fence_acquire()   MemoryBarrier()
+#endif
+
+/* Unlike ringbuffer_t, the writer never looks at its readers: it always
+ * has the whole ring, and overwrites the oldest bytes as it goes, so a
+ * slow or stalled reader can never hold up the capture callback.
+ *
+ * Positions are byte counts since the ring was created (64-bit, so
+ * they never wrap) and the offset in buf is just pos & (size - 1).
+ * Before touching the storage the writer announces how far it is about
+ * to write (claim); after copying out, a reader checks the claim to
+ * learn whether any of what it copied was overwritten underneath it,
+ * seqlock-style.  A reader that falls a whole ring behind skips ahead
+ * and counts an overrun. */
+typedef struct {
+    /* Read-only after bcast_create() */
+    alignas(RB_CACHE_LINE) char *buf;
+    size_t size;
+
+    /* Writer-owned, loaded by every reader */
+    alignas(RB_CACHE_LINE) uint64_t head;   /* bytes published            */
+    uint64_t claim;                         /* head + bytes being written */
+
+    /* Optional cursor position of one reader that must see everything,
+     * for writers that can afford to wait for it (see bcast_gate_space) */
+    const uint64_t *gate;
+} bcast_ring_t;
+
+/* One consumer's cursor.  Readers are independent: each lives wherever
+ * its owner likes and needs no registration with the writer. */
+typedef struct {
+    const bcast_ring_t *ring;
+    uint64_t pos;                     /* next byte to read                 */
+    uint64_t head_cache;              /* head as of the last refresh       */
+    unsigned long long overruns;      /* times it was lapped by the writer */
+    unsigned long long lost;          /* bytes overwritten before reading  */
+} bcast_reader_t;
+
+static inline bcast_ring_t *bcast_create(size_t size)
+{
+    bcast_ring_t *r = (bcast_ring_t *)rb_aligned_alloc(sizeof(bcast_ring_t));
+    size_t power_of_two = 1;
+    while (power_of_two < size) power_of_two <<= 1;
+    memset(r, 0, sizeof(*r));
+    r->size = power_of_two;
+    r->buf  = (char *)calloc(1, r->size);
+    return r;
+}
+
+static inline void bcast_free(bcast_ring_t *r)
+{
+    if (r) {
+        free(r->buf);
+        rb_aligned_free(r);
+    }
+}
+
+/* ---- Writer ---- */
+
+/* Reserve cnt bytes (at most the ring size) at the head, as one or two
+ * contiguous regions like ringbuffer_write_reserve().  Never fails and
+ * never waits: the bytes handed out are the oldest in the ring. */
+static inline size_t bcast_write_reserve(bcast_ring_t *r, size_t cnt,
+                                         ringbuffer_data_t vec[2])
+{
+    size_t to_write = cnt > r->size ? r->size : cnt;
+    size_t w = (size_t)(r->head & (r->size - 1));
+
+    bcast_store(&r->claim, r->head + to_write);
+    bcast_fence_release();            /* claim lands before the data */
+
+    vec[0].buf = r->buf + w;
+    if (w + to_write > r->size) {
+        vec[0].len = r->size - w;
+        vec[1].buf = r->buf;
+        vec[1].len = to_write - vec[0].len;
+    } else {
+        vec[0].len = to_write;
+        vec[1].buf = NULL;
+        vec[1].len = 0;
+    }
+    return to_write;
+}
+
+static inline void bcast_write_commit(bcast_ring_t *r, size_t cnt)
+{
+    rb_store_release(&r->head, r->head + cnt);
+}
+
+/* Bytes that can be written before lapping the gate reader.  Realtime
+ * writers never ask; a file being fed flat out does, so the history
+ * records every frame of it. */
+static inline size_t bcast_gate_space(const bcast_ring_t *r)
+{
+    if (!r->gate)
+        return r->size;
+    uint64_t behind = r->head - rb_load_acquire(r->gate);
+    return behind < r->size ? (size_t)(r->size - behind) : 0;
+}
+
+/* Copy n bytes to offset `off` of a reservation, across the wrap, so
+ * a record can be assembled from several pieces before one commit */
+static inline void bcast_vec_copy(const ringbuffer_data_t vec[2], size_t off,
+                                  const void *src, size_t n)
+{
+    const char *s = (const char *)src;
+    if (off < vec[0].len) {
+        size_t n0 = vec[0].len - off < n ? vec[0].len - off : n;
+        memcpy(vec[0].buf + off, s, n0);
+        s += n0;
+        n -= n0;
+        off = 0;
+    }
+    else
+        off -= vec[0].len;
+    if (n)
+        memcpy(vec[1].buf + off, s, n);
+}
+
+static inline size_t bcast_write(bcast_ring_t *r, const char *src, size_t cnt)
+{
+    ringbuffer_data_t vec[2];
+    size_t n = bcast_write_reserve(r, cnt, vec);
+    bcast_vec_copy(vec, 0, src, n);
+    bcast_write_commit(r, n);
+    return n;
+}
+
+/* ---- Readers ---- */
+
+/* Attach a cursor at the current head: it sees only what comes next */
+static inline void bcast_reader_init(bcast_reader_t *rd, const bcast_ring_t *r)
+{
+    memset(rd, 0, sizeof(*rd));
+    rd->ring = r;
+    rd->pos  = rd->head_cache = rb_load_acquire(&r->head);
+}
+
+/* Lapped: move up to half a ring behind the head, which leaves the
+ * writer that much room before it catches the cursor again */
+static inline void bcast_resync(bcast_reader_t *rd, uint64_t head)
+{
+    uint64_t to = head - rd->ring->size / 2;
+    rd->overruns++;
+    rd->lost += to - rd->pos;
+    rd->pos = to;
+}
+
+/* Refresh the view of the head and return the bytes readable from the
+ * cursor, skipping ahead first if the writer has lapped it */
+static inline size_t bcast_read_space(bcast_reader_t *rd)
+{
+    rd->head_cache = rb_load_acquire(&rd->ring->head);
+    if (rd->head_cache - rd->pos > rd->ring->size)
+        bcast_resync(rd, rd->head_cache);
+    return (size_t)(rd->head_cache - rd->pos);
+}
+
+/* Move the cursor to absolute position pos, clamped to what the ring
+ * still holds as of the last refresh.  Backwards is fine: the bytes are
+ * still there until the writer claims them. */
+static inline void bcast_seek(bcast_reader_t *rd, uint64_t pos)
+{
+    uint64_t oldest = rd->head_cache > rd->ring->size
+                    ? rd->head_cache - rd->ring->size : 0;
+    if (pos > rd->head_cache) pos = rd->head_cache;
+    if (pos < oldest)         pos = oldest;
+    rd->pos = pos;
+}
+
+/* Copy up to cnt bytes from the cursor and advance past them.  Returns
+ * 0, counting an overrun, if the writer overwrote any of them while
+ * they were being copied; the cursor has then moved on past the damage. */
+static inline size_t bcast_read(bcast_reader_t *rd, char *dest, size_t cnt)
+{
+    const bcast_ring_t *r = rd->ring;
+    size_t avail = (size_t)(rd->head_cache - rd->pos);
+    if (avail < cnt)
+        avail = bcast_read_space(rd);
+    size_t n = cnt > avail ? avail : cnt;
+    if (n == 0)
+        return 0;
+
+    size_t p  = (size_t)(rd->pos & (r->size - 1));
+    size_t n1 = p + n > r->size ? r->size - p : n;
+    memcpy(dest, r->buf + p, n1);
+    if (n1 < n)
+        memcpy(dest + n1, r->buf, n - n1);
+
+    bcast_fence_acquire();            /* the copy happens before the check */
+    uint64_t claim = bcast_load(&r->claim);
+    if (claim - rd->pos > r->size) {
+        bcast_resync(rd, claim);
+        rd->head_cache = rb_load_acquire(&r->head);
+        if (rd->pos > rd->head_cache)
+            rd->pos = rd->head_cache;
+        return 0;
+    }
+    rd->pos += n;
+    return n;
+}
+
+#endif /* XYSCOPE_BROADCAST_H */
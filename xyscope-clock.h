@@ -0,0 +1,99 @@
+/*
+ *  xyscope-clock.h
+ *  Audio/display clock recovery: a delay-locked loop that moves each
+ *  live window along by the measured samples per refresh, fractionally,
+ *  instead of snapping it to wherever the capture ring's head landed.
+ *
+ *  Copyright (c) 2006-2007 by Chris Reaume <chris@flatlan.net>
+ *    All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+
+#ifndef XYSCOPE_CLOCK_H
+#define XYSCOPE_CLOCK_H
+
+#include <math.h>
+#include <string.h>
+
+#define CLOCK_DLL_BANDWIDTH  0.1     /* loop bandwidth, Hz                */
+#define CLOCK_DLL_RESET      8.0      /* refreshes of error before relock  */
+#define CLOCK_MARGIN_DECAY   0.9995   /* per refresh, for the head's steps */
+
+/* The ring's head only moves a whole quantum at a time, and the audio
+ * and display clocks never divide evenly (44.1 kHz at 144 Hz, a 59.94 Hz
+ * panel, or just two crystals that disagree by a few ppm), so a window
+ * that always ends at the head advances 0, 1024, 0, 0, 1024 ... frames
+ * per refresh: visible judder.
+ *
+ * Like JACK's DLL, but stepped once per displayed frame rather than per
+ * period: pos advances by rate each refresh, and a second-order loop
+ * steers pos and rate towards the writer's position.  The target sits
+ * `margin` frames behind the head, the largest step the head has taken
+ * lately, so the loop's mean position never runs past data that has
+ * arrived.  A ramp settles with no steady-state error, so rate converges
+ * on the true samples-per-refresh ratio, fractional part and all. */
+typedef struct {
+    double pos;                       /* read end, ring frames              */
+    double rate;                      /* ring frames per refresh            */
+    double nominal;                   /* sample_rate / frame_rate           */
+    double b, c;                      /* loop coefficients                  */
+    double margin;                    /* frames kept behind the head        */
+    unsigned long long last_head;
+    bool locked;
+    unsigned long long relocks;       /* resets after a jump or a stall     */
+} clock_dll_t;
+
+static inline void clock_dll_init(clock_dll_t *d, double sample_rate, double frame_rate)
+{
+    double w = 2.0 * M_PI * CLOCK_DLL_BANDWIDTH / frame_rate;
+    memset(d, 0, sizeof(*d));
+    d->nominal = sample_rate / frame_rate;
+    d->rate    = d->nominal;
+    d->b       = sqrt(2.0) * w;
+    d->c       = w * w;
+}
+
+/* One displayed frame: head is one past the newest frame the writer has
+ * delivered, in ring frames.  Returns where this frame's window should
+ * end; the caller still clamps it to the data it has. */
+static inline double clock_dll_update(clock_dll_t *d, unsigned long long head)
+{
+    double step = d->last_head ? (double)(head - d->last_head) : 0.0;
+    d->last_head = head;
+    d->margin *= CLOCK_MARGIN_DECAY;
+    if (step > d->margin)
+        d->margin = step;
+
+    double target = (double)head - d->margin;
+    double e = target - (d->pos + d->rate);
+    if (!d->locked || fabs(e) > CLOCK_DLL_RESET * d->nominal) {
+        /* a delay change, a pause or a stalled source; or starting up,
+         * which lasts until the head has moved once and the margin is
+         * known */
+        if (d->locked)
+            d->relocks++;
+        d->pos    = target;
+        d->rate   = d->nominal;
+        d->locked = d->margin > 0.0;
+        return d->pos;
+    }
+
+    d->pos  += d->rate + d->b * e;
+    d->rate += d->c * e;
+    if (d->rate < d->nominal * 0.5) d->rate = d->nominal * 0.5;
+    if (d->rate > d->nominal * 2.0) d->rate = d->nominal * 2.0;
+    return d->pos;
+}
+
+/* Measured drift of the audio clock against the display, in ppm of the
+ * nominal ratio */
+static inline double clock_dll_ppm(const clock_dll_t *d)
+{
+    return d->nominal > 0.0 ? (d->rate / d->nominal - 1.0) * 1e6 : 0.0;
+}
+
+#endif /* XYSCOPE_CLOCK_H */
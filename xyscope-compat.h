@@ -31,27 +31,11 @@ typedef unsigned int useconds_t;
 
 /* pthreads compatibility using Win32 primitives */
 typedef CRITICAL_SECTION pthread_mutex_t;
-typedef CONDITION_VARIABLE pthread_cond_t;
 typedef HANDLE pthread_t;
 
-#define PTHREAD_CANCEL_ASYNCHRONOUS 0
-#define pthread_setcanceltype(t, o) ((void)0)
-
 static inline int pthread_mutex_lock(pthread_mutex_t *m) { EnterCriticalSection(m); return 0; }
 static inline int pthread_mutex_trylock(pthread_mutex_t *m) { return TryEnterCriticalSection(m) ? 0 : 1; }
 static inline int pthread_mutex_unlock(pthread_mutex_t *m) { LeaveCriticalSection(m); return 0; }
-static inline int pthread_cond_signal(pthread_cond_t *c) { WakeConditionVariable(c); return 0; }
-
-static int pthread_cond_timedwait(pthread_cond_t *c, pthread_mutex_t *m, const struct timespec *abstime) {
-    struct timeval now;
-    gettimeofday(&now, NULL);
-    long ms = (long)((abstime->tv_sec - now.tv_sec) * 1000 +
-                      abstime->tv_nsec / 1000000 - now.tv_usec / 1000);
-    if (ms < 0) ms = 0;
-    if (ms > 1000) ms = 1000;
-    SleepConditionVariableCS(c, m, (DWORD)ms);
-    return 0;
-}
 
 struct w32_thread_info {
     void *(*func)(void *);
@@ -76,6 +60,13 @@ static int pthread_create(pthread_t *t, const void *attr, void *(*func)(void *),
     return *t ? 0 : -1;
 }
 
+static inline int pthread_join(pthread_t t, void **ret) {
+    (void)ret;
+    WaitForSingleObject(t, INFINITE);
+    CloseHandle(t);
+    return 0;
+}
+
 /* WASAPI COM GUIDs (explicit for MSVC and MinGW compatibility) */
 static const GUID XYSCOPE_CLSID_MMDeviceEnumerator = {0xBCDE0395, 0xE52F, 0x467C, {0x8E, 0x3D, 0xC4, 0x57, 0x92, 0x91, 0x69, 0x2E}};
 static const GUID XYSCOPE_IID_IMMDeviceEnumerator = {0xA95664D2, 0x9614, 0x4F35, {0xA7, 0x46, 0xDE, 0x8D, 0xB6, 0x36, 0x17, 0xE6}};
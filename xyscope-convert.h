@@ -0,0 +1,114 @@
+/*
+ *  xyscope-convert.h
+ *  Integer capture formats (--capture-format): int -> float conversion,
+ *  fused with the downmix so integer quanta go straight into the ring.
+ *
+ *  Copyright (c) 2006-2007 by Chris Reaume <chris@flatlan.net>
+ *    All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+
+#ifndef XYSCOPE_CONVERT_H
+#define XYSCOPE_CONVERT_H
+
+#include <stdint.h>
+#include "xyscope-shared.h"
+#include "xyscope-downmix.h"
+
+#define CONVERT_CHUNK 2048            /* samples converted per stack block */
+
+/* Native-endian samples as the capture backend hands them over */
+typedef enum {
+    SampleF32    = 0,
+    SampleS16    = 1,
+    SampleS24    = 2,                 /* packed, 3 bytes                   */
+    SampleS24_32 = 3,                 /* low 24 bits of an int32           */
+    SampleS32    = 4
+} sample_format_t;
+
+static inline size_t sample_bytes(sample_format_t fmt)
+{
+    switch (fmt) {
+        case SampleS16: return 2;
+        case SampleS24: return 3;
+        default:        return 4;
+    }
+}
+
+static inline const char *sample_format_name(sample_format_t fmt)
+{
+    switch (fmt) {
+        case SampleS16:    return "S16";
+        case SampleS24:    return "S24";
+        case SampleS24_32: return "S24_32";
+        case SampleS32:    return "S32";
+        default:           return "F32";
+    }
+}
+
+/* Convert n samples (not frames) of fmt to float.  Full scale maps to
+ * [-1, 1), exactly like the WAV reader. */
+static inline void convert_block(const void *src, sample_format_t fmt,
+                                 float *dst, size_t n)
+{
+    const unsigned char *b = (const unsigned char *)src;
+    switch (fmt) {
+        case SampleS16:
+            for (size_t i = 0; i < n; i++)
+                dst[i] = (float)((const int16_t *)src)[i] * (1.0f / 32768.0f);
+            break;
+        case SampleS24:
+            for (size_t i = 0; i < n; i++, b += 3) {
+                int32_t v = (int32_t)(((uint32_t)b[0] << 8) | ((uint32_t)b[1] << 16) |
+                                      ((uint32_t)b[2] << 24)) >> 8;
+                dst[i] = (float)v * (1.0f / 8388608.0f);
+            }
+            break;
+        case SampleS24_32:
+            for (size_t i = 0; i < n; i++) {
+                int32_t v = (int32_t)((uint32_t)((const int32_t *)src)[i] << 8) >> 8;
+                dst[i] = (float)v * (1.0f / 8388608.0f);
+            }
+            break;
+        case SampleS32:
+            for (size_t i = 0; i < n; i++)
+                dst[i] = (float)((const int32_t *)src)[i] * (1.0f / 2147483648.0f);
+            break;
+        default:
+            memcpy(dst, src, n * sizeof(float));
+            break;
+    }
+}
+
+/* Downmix n frames of fmt samples into dst.  Float goes straight to the
+ * downmix kernel, and plain stereo is converted straight into dst (its
+ * frames are already L/R pairs), so neither takes an extra pass;
+ * anything else is converted a stack block at a time and downmixed
+ * from there while it is still in cache. */
+static inline void downmix_native(const downmix_t *d, const void *src,
+                                  sample_format_t fmt, frame_t *dst, size_t n)
+{
+    if (fmt == SampleF32) {
+        downmix_block(d, (const float *)src, dst, n);
+        return;
+    }
+    if (d->mode == DownmixCopy && d->channels == 2) {
+        convert_block(src, fmt, (float *)dst, n * 2);
+        return;
+    }
+
+    float tmp[CONVERT_CHUNK];
+    const size_t per    = CONVERT_CHUNK / d->channels;
+    const size_t stride = d->channels * sample_bytes(fmt);
+    for (size_t i = 0; i < n; i += per) {
+        size_t cnt = n - i < per ? n - i : per;
+        convert_block((const char *)src + i * stride, fmt, tmp, cnt * d->channels);
+        downmix_block(d, tmp, dst + i, cnt);
+    }
+}
+
+#endif /* XYSCOPE_CONVERT_H */
@@ -0,0 +1,197 @@
+/*
+ *  xyscope-decimate.h
+ *  Streaming low-pass/decimate stage between capture and the ring, for
+ *  sources far above the display's useful bandwidth (--display-rate).
+ *
+ *  Copyright (c) 2006-2007 by Chris Reaume <chris@flatlan.net>
+ *    All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+
+#ifndef XYSCOPE_DECIMATE_H
+#define XYSCOPE_DECIMATE_H
+
+#include "xyscope-shared.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DECIMATE_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define DECIMATE_HAVE_AVX 1
+#include <immintrin.h>
+#endif
+
+#define DECIMATE_MAX_FACTOR     8
+#define DECIMATE_TAPS_PER_PHASE 32    /* filter length / factor            */
+#define DECIMATE_MAX_TAPS       (DECIMATE_TAPS_PER_PHASE * DECIMATE_MAX_FACTOR)
+#define DECIMATE_CHUNK          1024  /* input frames per decimate_run()   */
+#define DECIMATE_PI             3.14159265358979323846
+
+/* Power-of-two factor M with a windowed-sinc FIR of 32 * M taps, cut
+ * off at 0.42 of the output Nyquist: flat through the audible band at
+ * the rates this is meant for (192 kHz -> 48 kHz keeps 16 kHz), with
+ * what little aliasing there is folded into the top of the output band.
+ *
+ * Polyphase in the sense that matters here: only every Mth output is
+ * ever computed, straight from the input, so the cost is taps / M
+ * multiply-adds per input frame.  Everything lives inline (no heap), so
+ * the capture callback can run it: the caller writes up to
+ * DECIMATE_CHUNK frames at decimate_input(), and decimate_run() filters
+ * them against the taps - 1 frames of history kept in front. */
+typedef struct {
+    unsigned int factor;              /* 1 = pass through                  */
+    unsigned int taps;
+    unsigned int phase;               /* new frames to skip before the next
+                                         output's window ends             */
+    float coef[2 * DECIMATE_MAX_TAPS];                /* each tap twice, L/R */
+    frame_t buf[DECIMATE_MAX_TAPS - 1 + DECIMATE_CHUNK];
+    frame_t out[DECIMATE_CHUNK / 2];
+} decimator_t;
+
+/* Largest power-of-two factor that keeps `rate` at or above `target`
+ * (0 = no decimation) */
+static inline unsigned int decimate_factor(int rate, int target)
+{
+    unsigned int m = 1;
+    while (target > 0 && m < DECIMATE_MAX_FACTOR && rate / (int)(m * 2) >= target)
+        m *= 2;
+    return m;
+}
+
+/* The rate the ring and everything downstream of it run at */
+static inline int decimate_rate(int rate, int target)
+{
+    return rate / (int)decimate_factor(rate, target);
+}
+
+/* Build the filter and clear the history.  No allocation, so it is safe
+ * wherever downmix_init() is. */
+static inline void decimate_init(decimator_t *d, unsigned int factor)
+{
+    if (factor > DECIMATE_MAX_FACTOR)
+        factor = DECIMATE_MAX_FACTOR;
+    d->factor = factor > 1 ? factor : 1;
+    d->taps   = d->factor > 1 ? DECIMATE_TAPS_PER_PHASE * d->factor : 0;
+    d->phase  = d->taps ? d->factor - 1 : 0;
+    memset(d->buf, 0, sizeof(d->buf));
+    if (!d->taps)
+        return;
+
+    /* Blackman-windowed sinc.  The filter is symmetric, so the reversed
+     * taps the dot product wants are the taps themselves. */
+    const double fc  = 0.42 / d->factor;      /* cycles per input frame */
+    const double mid = (d->taps - 1) / 2.0;
+    double sum = 0.0;
+    double h[DECIMATE_MAX_TAPS];
+    for (unsigned int j = 0; j < d->taps; j++) {
+        double x = j - mid;
+        double s = x == 0.0 ? 2.0 * fc : sin(2.0 * DECIMATE_PI * fc * x) / (DECIMATE_PI * x);
+        double w = 0.42 - 0.5 * cos(2.0 * DECIMATE_PI * j / (d->taps - 1))
+                 + 0.08 * cos(4.0 * DECIMATE_PI * j / (d->taps - 1));
+        h[j] = s * w;
+        sum += h[j];
+    }
+    for (unsigned int j = 0; j < d->taps; j++)
+        d->coef[j * 2] = d->coef[j * 2 + 1] = (float)(h[j] / sum);
+}
+
+/* Where the caller writes the next (up to DECIMATE_CHUNK) frames */
+static inline frame_t *decimate_input(decimator_t *d)
+{
+    return d->buf + d->taps - 1;
+}
+
+/* One output: the taps frames starting at x against the coefficients.
+ * Lanes hold L/R of two (SSE) or four (AVX) consecutive frames and are
+ * folded together at the end. */
+static inline void decimate_dot_scalar(const decimator_t *d, const frame_t *x,
+                                       frame_t *y)
+{
+    float l = 0.0f, r = 0.0f;
+    for (unsigned int i = 0; i < d->taps; i++) {
+        l += x[i].left_channel  * d->coef[i * 2];
+        r += x[i].right_channel * d->coef[i * 2];
+    }
+    y->left_channel  = (sample_t)l;
+    y->right_channel = (sample_t)r;
+}
+
+#ifdef DECIMATE_HAVE_SSE2
+static inline void decimate_dot_sse2(const decimator_t *d, const frame_t *x,
+                                     frame_t *y)
+{
+    const float *xs = (const float *)x;
+    __m128 a0 = _mm_setzero_ps(), a1 = _mm_setzero_ps();
+    for (unsigned int i = 0; i < d->taps * 2; i += 8) {
+        a0 = _mm_add_ps(a0, _mm_mul_ps(_mm_loadu_ps(xs + i),     _mm_loadu_ps(d->coef + i)));
+        a1 = _mm_add_ps(a1, _mm_mul_ps(_mm_loadu_ps(xs + i + 4), _mm_loadu_ps(d->coef + i + 4)));
+    }
+    a0 = _mm_add_ps(a0, a1);
+    a0 = _mm_add_ps(a0, _mm_movehl_ps(a0, a0));
+    _mm_storel_pi((__m64 *)y, a0);
+}
+#endif
+
+#ifdef DECIMATE_HAVE_AVX
+__attribute__((target("avx")))
+static inline void decimate_dot_avx(const decimator_t *d, const frame_t *x,
+                                    frame_t *y)
+{
+    const float *xs = (const float *)x;
+    __m256 a0 = _mm256_setzero_ps(), a1 = _mm256_setzero_ps();
+    for (unsigned int i = 0; i < d->taps * 2; i += 16) {
+        a0 = _mm256_add_ps(a0, _mm256_mul_ps(_mm256_loadu_ps(xs + i),     _mm256_loadu_ps(d->coef + i)));
+        a1 = _mm256_add_ps(a1, _mm256_mul_ps(_mm256_loadu_ps(xs + i + 8), _mm256_loadu_ps(d->coef + i + 8)));
+    }
+    a0 = _mm256_add_ps(a0, a1);
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(a0), _mm256_extractf128_ps(a0, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    _mm_storel_pi((__m64 *)y, s);
+}
+
+static inline bool decimate_cpu_has_avx(void)
+{
+    static int has = -1;
+    if (has < 0) {
+        __builtin_cpu_init();
+        has = __builtin_cpu_supports("avx") ? 1 : 0;
+    }
+    return has == 1;
+}
+#endif
+
+/* Filter the n frames just written at decimate_input() into d->out and
+ * return how many outputs that made (about n / factor).  Output phase
+ * carries across calls, so any chunking gives the same stream. */
+static inline size_t decimate_run(decimator_t *d, size_t n)
+{
+    size_t k = 0, p = d->phase;
+
+    /* taps is a multiple of 32, so the SIMD loops need no tail */
+#ifdef DECIMATE_HAVE_AVX
+    if (decimate_cpu_has_avx()) {
+        for (; p < n; p += d->factor)
+            decimate_dot_avx(d, d->buf + p, &d->out[k++]);
+    }
+#endif
+#ifdef DECIMATE_HAVE_SSE2
+    for (; p < n; p += d->factor)
+        decimate_dot_sse2(d, d->buf + p, &d->out[k++]);
+#else
+    for (; p < n; p += d->factor)
+        decimate_dot_scalar(d, d->buf + p, &d->out[k++]);
+#endif
+    d->phase = (unsigned int)(p - n);
+
+    /* keep the newest taps - 1 frames as the next call's history */
+    memmove(d->buf, d->buf + n, (d->taps - 1) * sizeof(frame_t));
+    return k;
+}
+
+#endif /* XYSCOPE_DECIMATE_H */
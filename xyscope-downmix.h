@@ -0,0 +1,271 @@
+/*
+ *  xyscope-downmix.h
+ *  Multichannel-to-stereo downmix: per-frame reference and a block
+ *  kernel driven by a gain matrix precomputed once per layout.
+ *
+ *  Copyright (c) 2006-2007 by Chris Reaume <chris@flatlan.net>
+ *    All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+
+#ifndef XYSCOPE_DOWNMIX_H
+#define XYSCOPE_DOWNMIX_H
+
+#include "xyscope-shared.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DOWNMIX_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define DOWNMIX_HAVE_AVX2 1
+#include <immintrin.h>
+#endif
+
+/* Speaker map in WAVEFORMATEXTENSIBLE mask-bit order */
+typedef struct { unsigned int bit; float gl, gr; } downmix_speaker_t;
+
+static const downmix_speaker_t downmix_speaker_map[] = {
+    { 0x001, 1.000f, 0.000f },  /* FL  */
+    { 0x002, 0.000f, 1.000f },  /* FR  */
+    { 0x004, 0.707f, 0.707f },  /* FC  */
+    { 0x008, 0.000f, 0.000f },  /* LFE — dropped */
+    { 0x010, 0.707f, 0.000f },  /* BL  */
+    { 0x020, 0.000f, 0.707f },  /* BR  */
+    { 0x040, 0.866f, 0.500f },  /* FLC */
+    { 0x080, 0.500f, 0.866f },  /* FRC */
+    { 0x100, 0.500f, 0.500f },  /* BC  */
+    { 0x200, 0.707f, 0.000f },  /* SL  */
+    { 0x400, 0.000f, 0.707f },  /* SR  */
+};
+#define DOWNMIX_NUM_SPEAKERS \
+    (sizeof(downmix_speaker_map) / sizeof(downmix_speaker_map[0]))
+
+/* Fall back to assumed layouts when the source didn't provide one. */
+static inline unsigned int downmix_default_mask(unsigned int ch)
+{
+    switch (ch) {
+        case 4:  return 0x033;  /* quad: FL FR BL BR        */
+        case 6:  return 0x03F;  /* 5.1:  FL FR FC LFE BL BR */
+        case 8:  return 0x63F;  /* 7.1:  + SL SR            */
+        default: return 0;
+    }
+}
+
+/* Downmix an interleaved multi-channel frame to stereo using ITU-style
+ * coefficients: center at -3 dB, surrounds at -3 dB into the matching
+ * side, LFE dropped (it would dominate the X position). When `mask` is
+ * non-zero it is interpreted as a Windows WAVEFORMATEXTENSIBLE channel
+ * mask (SPEAKER_FRONT_LEFT bit, etc.) and channels are taken in mask-
+ * bit order. When `mask` is 0 we assume the standard layout for the
+ * channel count (quad / 5.1 / 7.1).
+ *
+ * Without this, an 8-channel stream from Windows speaker-fill / Atmos
+ * upmixing leaves only the dry stereo on FL/FR — the trace looks
+ * "skeletal" because most of the music is on the surround / center
+ * channels.
+ *
+ * This is the per-frame reference; the capture paths use the block
+ * kernel below, which must stay bit-identical to it. */
+static inline void downmix_stereo(const float *frame, unsigned int ch,
+                                  unsigned int mask,
+                                  sample_t *out_l, sample_t *out_r)
+{
+    if (ch == 1) { *out_l = *out_r = frame[0]; return; }
+    if (ch == 2) { *out_l = frame[0]; *out_r = frame[1]; return; }
+
+    if (mask == 0) {
+        mask = downmix_default_mask(ch);
+        if (mask == 0) {
+            *out_l = frame[0];
+            *out_r = frame[1];
+            return;
+        }
+    }
+
+    float L = 0.0f, R = 0.0f;
+    unsigned int idx = 0;
+    for (unsigned int m = 0; m < DOWNMIX_NUM_SPEAKERS && idx < ch; m++) {
+        if (mask & downmix_speaker_map[m].bit) {
+            L += frame[idx] * downmix_speaker_map[m].gl;
+            R += frame[idx] * downmix_speaker_map[m].gr;
+            idx++;
+        }
+    }
+    *out_l = (sample_t)L;
+    *out_r = (sample_t)R;
+}
+
+
+/* ---- Block kernel ---- */
+
+typedef enum {
+    DownmixMono   = 0,   /* L = R = ch0                      */
+    DownmixCopy   = 1,   /* L = ch0, R = ch1 (stereo/unknown) */
+    DownmixMatrix = 2    /* dense 2 x active gain matrix      */
+} downmix_mode_e;
+
+typedef struct {
+    unsigned int channels;   /* interleaved stride of the input        */
+    unsigned int active;     /* leading channels that feed the matrix  */
+    unsigned int mode;       /* downmix_mode_e                         */
+    unsigned int mask;       /* layout the matrix was built from       */
+    float gain_l[DOWNMIX_NUM_SPEAKERS];
+    float gain_r[DOWNMIX_NUM_SPEAKERS];
+} downmix_t;
+
+/* Flatten the speaker map for one negotiated layout.  Call whenever
+ * the channel count or mask changes (on_param_changed, WASAPI init),
+ * never per buffer.  Channels are matched to map entries exactly as
+ * downmix_stereo() walks them, so channel idx always lands in column
+ * idx and the kernel accumulates in the same order. */
+static inline void downmix_init(downmix_t *d, unsigned int ch, unsigned int mask)
+{
+    memset(d, 0, sizeof(*d));
+    d->channels = ch;
+    if (ch <= 1) {
+        d->channels = 1;
+        d->mode     = DownmixMono;
+        return;
+    }
+    if (ch > 2 && mask == 0)
+        mask = downmix_default_mask(ch);
+    if (ch == 2 || mask == 0) {
+        d->mode = DownmixCopy;
+        return;
+    }
+    d->mode = DownmixMatrix;
+    d->mask = mask;
+    for (unsigned int m = 0; m < DOWNMIX_NUM_SPEAKERS && d->active < ch; m++) {
+        if (mask & downmix_speaker_map[m].bit) {
+            d->gain_l[d->active] = downmix_speaker_map[m].gl;
+            d->gain_r[d->active] = downmix_speaker_map[m].gr;
+            d->active++;
+        }
+    }
+}
+
+static inline void downmix_matrix_scalar(const downmix_t *d, const float *src,
+                                         frame_t *dst, size_t n)
+{
+    const unsigned int ch = d->channels;
+    for (size_t i = 0; i < n; i++) {
+        const float *f = src + i * ch;
+        float L = 0.0f, R = 0.0f;
+        for (unsigned int c = 0; c < d->active; c++) {
+            L += f[c] * d->gain_l[c];
+            R += f[c] * d->gain_r[c];
+        }
+        dst[i].left_channel  = (sample_t)L;
+        dst[i].right_channel = (sample_t)R;
+    }
+}
+
+/* The SIMD kernels vectorise across frames, not channels: each lane
+ * owns one frame and accumulates its channels in the same order as
+ * the scalar loop, so the result is bit-identical (no horizontal adds,
+ * no FMA contraction of the separate multiply and add). */
+#ifdef DOWNMIX_HAVE_SSE2
+static inline size_t downmix_matrix_sse2(const downmix_t *d, const float *src,
+                                         frame_t *dst, size_t n)
+{
+    const unsigned int ch = d->channels;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const float *f = src + i * ch;
+        __m128 L = _mm_setzero_ps();
+        __m128 R = _mm_setzero_ps();
+        for (unsigned int c = 0; c < d->active; c++) {
+            __m128 x = _mm_set_ps(f[3 * ch + c], f[2 * ch + c],
+                                  f[ch + c],     f[c]);
+            L = _mm_add_ps(L, _mm_mul_ps(x, _mm_set1_ps(d->gain_l[c])));
+            R = _mm_add_ps(R, _mm_mul_ps(x, _mm_set1_ps(d->gain_r[c])));
+        }
+        _mm_storeu_ps((float *)(dst + i),     _mm_unpacklo_ps(L, R));
+        _mm_storeu_ps((float *)(dst + i + 2), _mm_unpackhi_ps(L, R));
+    }
+    return i;
+}
+#endif
+
+#ifdef DOWNMIX_HAVE_AVX2
+__attribute__((target("avx2")))
+static inline size_t downmix_matrix_avx2(const downmix_t *d, const float *src,
+                                         frame_t *dst, size_t n)
+{
+    const int ch = (int)d->channels;
+    const __m256i stride = _mm256_setr_epi32(0, ch, 2 * ch, 3 * ch,
+                                             4 * ch, 5 * ch, 6 * ch, 7 * ch);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const float *f = src + i * ch;
+        __m256 L = _mm256_setzero_ps();
+        __m256 R = _mm256_setzero_ps();
+        for (unsigned int c = 0; c < d->active; c++) {
+            __m256 x = _mm256_i32gather_ps(f + c, stride, 4);
+            L = _mm256_add_ps(L, _mm256_mul_ps(x, _mm256_set1_ps(d->gain_l[c])));
+            R = _mm256_add_ps(R, _mm256_mul_ps(x, _mm256_set1_ps(d->gain_r[c])));
+        }
+        /* unpack interleaves within 128-bit lanes: lo = frames 0,1,4,5
+         * and hi = frames 2,3,6,7; permute back into frame order. */
+        __m256 lo = _mm256_unpacklo_ps(L, R);
+        __m256 hi = _mm256_unpackhi_ps(L, R);
+        _mm256_storeu_ps((float *)(dst + i),
+                         _mm256_permute2f128_ps(lo, hi, 0x20));
+        _mm256_storeu_ps((float *)(dst + i + 4),
+                         _mm256_permute2f128_ps(lo, hi, 0x31));
+    }
+    return i;
+}
+
+static inline bool downmix_cpu_has_avx2(void)
+{
+    static int has = -1;
+    if (has < 0) {
+        __builtin_cpu_init();
+        has = __builtin_cpu_supports("avx2") ? 1 : 0;
+    }
+    return has == 1;
+}
+#endif
+
+/* Downmix n interleaved frames from src into dst.  Picks the widest
+ * kernel the CPU supports and finishes the tail with the scalar loop. */
+static inline void downmix_block(const downmix_t *d, const float *src,
+                                 frame_t *dst, size_t n)
+{
+    size_t i = 0;
+    switch (d->mode) {
+        case DownmixMono:
+            for (; i < n; i++)
+                dst[i].left_channel = dst[i].right_channel = src[i * d->channels];
+            return;
+        case DownmixCopy:
+            if (d->channels == 2) {
+                memcpy(dst, src, n * sizeof(frame_t));
+                return;
+            }
+            for (; i < n; i++) {
+                dst[i].left_channel  = src[i * d->channels];
+                dst[i].right_channel = src[i * d->channels + 1];
+            }
+            return;
+        default:
+            break;
+    }
+#ifdef DOWNMIX_HAVE_AVX2
+    if (downmix_cpu_has_avx2())
+        i = downmix_matrix_avx2(d, src, dst, n);
+#endif
+#ifdef DOWNMIX_HAVE_SSE2
+    i += downmix_matrix_sse2(d, src + i * d->channels, dst + i, n - i);
+#endif
+    downmix_matrix_scalar(d, src + i * d->channels, dst + i, n - i);
+}
+
+#endif /* XYSCOPE_DOWNMIX_H */
@@ -0,0 +1,419 @@
+/*
+ *  xyscope-file.h
+ *  Memory-mapped WAV (and, with libFLAC, FLAC) reader for the file
+ *  input backend (--input).
+ *
+ *  Copyright (c) 2006-2007 by Chris Reaume <chris@flatlan.net>
+ *    All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+
+#ifndef XYSCOPE_FILE_H
+#define XYSCOPE_FILE_H
+
+#include <stdint.h>
+#include "xyscope-shared.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#ifdef HAVE_FLAC
+#include <FLAC/stream_decoder.h>
+#endif
+
+/* Frames converted per audio_file_next() call at most */
+#define AUDIO_FILE_CHUNK 4096
+#define AUDIO_FILE_MAX_RATE 1000000   /* Hz; anything above is a bad header */
+
+typedef enum {
+    AudioFileWav  = 0,
+    AudioFileFlac = 1
+} audio_file_kind_e;
+
+typedef struct {
+    unsigned int kind;           /* audio_file_kind_e */
+    const unsigned char *map;    /* whole file, read-only */
+    size_t map_len;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+
+    unsigned int rate;
+    unsigned int channels;
+    unsigned int channel_mask;   /* WAVE_FORMAT_EXTENSIBLE mask, or 0 */
+    unsigned int bits;
+    bool is_float;
+
+    /* WAV: PCM payload inside the mapping */
+    const unsigned char *data;
+    size_t data_frames;
+    size_t pos;                  /* next frame to hand out */
+
+    /* Conversion target for anything that isn't aligned float32 */
+    float *scratch;
+    size_t scratch_frames;
+
+#ifdef HAVE_FLAC
+    FLAC__StreamDecoder *flac;
+    size_t flac_pos;             /* read offset into the mapping */
+    size_t flac_have;            /* decoded frames waiting in scratch */
+    size_t flac_next;            /* first of those not yet handed out */
+#endif
+} audio_file_t;
+
+/* The rate paces playback and sizes the decimator, so 0 (a division
+ * by zero) or nonsense has to be refused before anything uses it */
+static inline bool audio_file_rate_ok(const audio_file_t *f, const char *path)
+{
+    if (f->rate == 0 || f->rate > AUDIO_FILE_MAX_RATE) {
+        fprintf(stderr, "%s: unusable sample rate %u Hz\n", path, f->rate);
+        return false;
+    }
+    return true;
+}
+
+static inline unsigned int file_le16(const unsigned char *p)
+{
+    return (unsigned int)p[0] | ((unsigned int)p[1] << 8);
+}
+
+static inline unsigned int file_le32(const unsigned char *p)
+{
+    return (unsigned int)p[0] | ((unsigned int)p[1] << 8) |
+           ((unsigned int)p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+static inline bool audio_file_reserve(audio_file_t *f, size_t frames)
+{
+    if (frames <= f->scratch_frames)
+        return true;
+    float *p = (float *)realloc(f->scratch, frames * f->channels * sizeof(float));
+    if (!p)
+        return false;
+    f->scratch = p;
+    f->scratch_frames = frames;
+    return true;
+}
+
+/* Walk the RIFF chunks for "fmt " and "data" */
+static inline bool audio_file_parse_wav(audio_file_t *f, const char *path)
+{
+    const unsigned char *p   = f->map + 12;
+    const unsigned char *end = f->map + f->map_len;
+    unsigned int format = 0, block_align = 0;
+    bool have_fmt = false;
+
+    while (p + 8 <= end) {
+        unsigned int id_len = file_le32(p + 4);
+        const unsigned char *body = p + 8;
+        size_t avail = (size_t)(end - body);
+        size_t len   = id_len < avail ? id_len : avail;
+
+        if (!memcmp(p, "fmt ", 4) && len >= 16) {
+            format        = file_le16(body);
+            f->channels   = file_le16(body + 2);
+            f->rate       = file_le32(body + 4);
+            block_align   = file_le16(body + 12);
+            f->bits       = file_le16(body + 14);
+            /* WAVE_FORMAT_EXTENSIBLE: real format is the sub-format GUID's
+             * first two bytes, and it carries the speaker mask */
+            if (format == 0xFFFE && len >= 40) {
+                f->channel_mask = file_le32(body + 20);
+                format          = file_le16(body + 24);
+            }
+            have_fmt = true;
+        }
+        else if (!memcmp(p, "data", 4) && have_fmt) {
+            f->data = body;
+            if (block_align)
+                f->data_frames = len / block_align;
+            break;
+        }
+        p = body + len + (len & 1);      /* chunks are word aligned */
+    }
+
+    if (!have_fmt || !f->data) {
+        fprintf(stderr, "%s: no fmt/data chunk, not a usable WAV file\n", path);
+        return false;
+    }
+    f->is_float = (format == 3);
+    if (!((format == 1 && (f->bits == 8 || f->bits == 16 || f->bits == 24 || f->bits == 32)) ||
+          (format == 3 && f->bits == 32))) {
+        fprintf(stderr, "%s: unsupported WAV encoding (format %u, %u bits)\n",
+                path, format, f->bits);
+        return false;
+    }
+    if (f->channels == 0 || block_align != f->channels * (f->bits / 8)) {
+        fprintf(stderr, "%s: inconsistent WAV block alignment\n", path);
+        return false;
+    }
+    return audio_file_rate_ok(f, path);
+}
+
+#ifdef HAVE_FLAC
+static FLAC__StreamDecoderReadStatus audio_file_flac_read(const FLAC__StreamDecoder *dec,
+                                                          FLAC__byte buffer[], size_t *bytes,
+                                                          void *client)
+{
+    (void)dec;
+    audio_file_t *f = (audio_file_t *)client;
+    size_t left = f->map_len - f->flac_pos;
+    if (left == 0) {
+        *bytes = 0;
+        return FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM;
+    }
+    if (*bytes > left)
+        *bytes = left;
+    memcpy(buffer, f->map + f->flac_pos, *bytes);
+    f->flac_pos += *bytes;
+    return FLAC__STREAM_DECODER_READ_STATUS_CONTINUE;
+}
+
+/* Planar integer block -> interleaved float in scratch */
+static FLAC__StreamDecoderWriteStatus audio_file_flac_write(const FLAC__StreamDecoder *dec,
+                                                            const FLAC__Frame *frame,
+                                                            const FLAC__int32 *const buffer[],
+                                                            void *client)
+{
+    (void)dec;
+    audio_file_t *f = (audio_file_t *)client;
+    unsigned int n  = frame->header.blocksize;
+    unsigned int ch = f->channels;
+    float scale = 1.0f / (float)(1u << (frame->header.bits_per_sample - 1));
+
+    if (frame->header.channels != ch || !audio_file_reserve(f, n))
+        return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+    for (unsigned int i = 0; i < n; i++)
+        for (unsigned int c = 0; c < ch; c++)
+            f->scratch[i * ch + c] = (float)buffer[c][i] * scale;
+    f->flac_have = n;
+    f->flac_next = 0;
+    return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+}
+
+static void audio_file_flac_metadata(const FLAC__StreamDecoder *dec,
+                                     const FLAC__StreamMetadata *meta, void *client)
+{
+    (void)dec;
+    audio_file_t *f = (audio_file_t *)client;
+    if (meta->type == FLAC__METADATA_TYPE_STREAMINFO) {
+        f->rate        = meta->data.stream_info.sample_rate;
+        f->channels    = meta->data.stream_info.channels;
+        f->bits        = meta->data.stream_info.bits_per_sample;
+        f->data_frames = (size_t)meta->data.stream_info.total_samples;
+    }
+}
+
+static void audio_file_flac_error(const FLAC__StreamDecoder *dec,
+                                  FLAC__StreamDecoderErrorStatus status, void *client)
+{
+    (void)dec;
+    (void)client;
+    fprintf(stderr, "FLAC decode error: %s\n", FLAC__StreamDecoderErrorStatusString[status]);
+}
+
+static inline bool audio_file_open_flac(audio_file_t *f, const char *path)
+{
+    f->flac = FLAC__stream_decoder_new();
+    if (!f->flac ||
+        FLAC__stream_decoder_init_stream(f->flac, audio_file_flac_read, NULL, NULL, NULL, NULL,
+                                         audio_file_flac_write, audio_file_flac_metadata,
+                                         audio_file_flac_error, f)
+            != FLAC__STREAM_DECODER_INIT_STATUS_OK ||
+        !FLAC__stream_decoder_process_until_end_of_metadata(f->flac) ||
+        f->channels == 0) {
+        fprintf(stderr, "%s: could not start FLAC decoder\n", path);
+        return false;
+    }
+    return audio_file_rate_ok(f, path);
+}
+#endif
+
+static inline void audio_file_close(audio_file_t *f)
+{
+#ifdef HAVE_FLAC
+    if (f->flac)
+        FLAC__stream_decoder_delete(f->flac);
+#endif
+#ifdef _WIN32
+    if (f->map)
+        UnmapViewOfFile(f->map);
+    if (f->mapping)
+        CloseHandle(f->mapping);
+    if (f->file && f->file != INVALID_HANDLE_VALUE)
+        CloseHandle(f->file);
+#else
+    if (f->map)
+        munmap((void *)f->map, f->map_len);
+    if (f->fd >= 0)
+        close(f->fd);
+#endif
+    free(f->scratch);
+    memset(f, 0, sizeof(*f));
+#ifndef _WIN32
+    f->fd = -1;
+#endif
+}
+
+/* Map the whole file and read its header.  Errors are reported on
+ * stderr; on failure everything is released again. */
+static inline bool audio_file_open(audio_file_t *f, const char *path)
+{
+    memset(f, 0, sizeof(*f));
+#ifdef _WIN32
+    f->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                          OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    LARGE_INTEGER size;
+    if (f->file == INVALID_HANDLE_VALUE || !GetFileSizeEx(f->file, &size)) {
+        fprintf(stderr, "%s: cannot open\n", path);
+        audio_file_close(f);
+        return false;
+    }
+    f->map_len = (size_t)size.QuadPart;
+    f->mapping = CreateFileMappingA(f->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (f->mapping)
+        f->map = (const unsigned char *)MapViewOfFile(f->mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+    struct stat st;
+    f->fd = open(path, O_RDONLY);
+    if (f->fd < 0 || fstat(f->fd, &st) < 0) {
+        fprintf(stderr, "%s: cannot open\n", path);
+        audio_file_close(f);
+        return false;
+    }
+    f->map_len = (size_t)st.st_size;
+    if (f->map_len > 0) {
+        void *m = mmap(NULL, f->map_len, PROT_READ, MAP_PRIVATE, f->fd, 0);
+        if (m != MAP_FAILED) {
+            f->map = (const unsigned char *)m;
+            madvise(m, f->map_len, MADV_SEQUENTIAL);
+        }
+    }
+#endif
+    if (!f->map || f->map_len < 12) {
+        fprintf(stderr, "%s: cannot map file\n", path);
+        audio_file_close(f);
+        return false;
+    }
+
+    bool ok = false;
+    if (!memcmp(f->map, "RIFF", 4) && !memcmp(f->map + 8, "WAVE", 4)) {
+        f->kind = AudioFileWav;
+        ok = audio_file_parse_wav(f, path);
+    }
+    else if (!memcmp(f->map, "fLaC", 4)) {
+        f->kind = AudioFileFlac;
+#ifdef HAVE_FLAC
+        ok = audio_file_open_flac(f, path);
+#else
+        fprintf(stderr, "%s: FLAC input needs a build with libFLAC\n", path);
+#endif
+    }
+    else {
+        fprintf(stderr, "%s: not a WAV or FLAC file\n", path);
+    }
+
+    if (ok && !audio_file_reserve(f, AUDIO_FILE_CHUNK))
+        ok = false;
+    if (!ok) {
+        audio_file_close(f);
+        return false;
+    }
+    return true;
+}
+
+/* Return to the first frame (for --input-loop) */
+static inline void audio_file_rewind(audio_file_t *f)
+{
+    f->pos = 0;
+#ifdef HAVE_FLAC
+    if (f->flac) {
+        f->flac_pos  = 0;
+        f->flac_have = 0;
+        f->flac_next = 0;
+        FLAC__stream_decoder_reset(f->flac);
+        FLAC__stream_decoder_process_until_end_of_metadata(f->flac);
+    }
+#endif
+}
+
+/* Hand out up to max_frames interleaved float frames in *out and
+ * return how many; 0 means end of file.  Aligned float32 WAV data is
+ * returned straight from the mapping; everything else is converted
+ * into scratch, which stays valid until the next call. */
+static inline size_t audio_file_next(audio_file_t *f, size_t max_frames, const float **out)
+{
+    if (max_frames > AUDIO_FILE_CHUNK)
+        max_frames = AUDIO_FILE_CHUNK;
+
+#ifdef HAVE_FLAC
+    if (f->kind == AudioFileFlac) {
+        while (f->flac_next >= f->flac_have) {
+            if (FLAC__stream_decoder_get_state(f->flac) == FLAC__STREAM_DECODER_END_OF_STREAM ||
+                !FLAC__stream_decoder_process_single(f->flac))
+                return 0;
+        }
+        size_t n = f->flac_have - f->flac_next;
+        if (n > max_frames)
+            n = max_frames;
+        *out = f->scratch + f->flac_next * f->channels;
+        f->flac_next += n;
+        f->pos += n;
+        return n;
+    }
+#endif
+
+    size_t n = f->data_frames - f->pos;
+    if (n > max_frames)
+        n = max_frames;
+    if (n == 0)
+        return 0;
+
+    const unsigned int ch = f->channels;
+    const unsigned char *src = f->data + f->pos * ch * (f->bits / 8);
+    const size_t count = n * ch;
+    float *dst = f->scratch;
+
+    if (f->is_float) {
+        if (((uintptr_t)src & (sizeof(float) - 1)) == 0) {
+            *out = (const float *)src;
+            f->pos += n;
+            return n;
+        }
+        memcpy(dst, src, count * sizeof(float));
+    }
+    else if (f->bits == 16) {
+        for (size_t i = 0; i < count; i++, src += 2)
+            dst[i] = (float)(int16_t)file_le16(src) * (1.0f / 32768.0f);
+    }
+    else if (f->bits == 24) {
+        for (size_t i = 0; i < count; i++, src += 3) {
+            int32_t v = (int32_t)(((uint32_t)src[0] << 8) | ((uint32_t)src[1] << 16) |
+                                  ((uint32_t)src[2] << 24)) >> 8;
+            dst[i] = (float)v * (1.0f / 8388608.0f);
+        }
+    }
+    else if (f->bits == 32) {
+        for (size_t i = 0; i < count; i++, src += 4)
+            dst[i] = (float)(int32_t)file_le32(src) * (1.0f / 2147483648.0f);
+    }
+    else {
+        for (size_t i = 0; i < count; i++, src++)
+            dst[i] = ((float)src[0] - 128.0f) * (1.0f / 128.0f);
+    }
+    *out = dst;
+    f->pos += n;
+    return n;
+}
+
+#endif /* XYSCOPE_FILE_H */
@@ -0,0 +1,224 @@
+/*
+ *  xyscope-history.h
+ *  Compressed rewind history: block-floating-point int16 copy of
+ *  everything that has passed through the live ring.
+ *
+ *  Copyright (c) 2006-2007 by Chris Reaume <chris@flatlan.net>
+ *    All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+
+#ifndef XYSCOPE_HISTORY_H
+#define XYSCOPE_HISTORY_H
+
+#include <stdint.h>
+#include "xyscope-shared.h"
+#include "xyscope-broadcast.h"
+#include "xyscope-pyramid.h"
+#include "xyscope-spool.h"
+
+/* Frames per block.  Each block stores 16-bit mantissas plus one shared
+ * exponent per channel, so a quiet passage keeps full 16-bit resolution
+ * relative to its own peak: about half the size of float32 frames at
+ * well beyond display precision. */
+#define HISTORY_BLOCK 256
+
+typedef struct {
+    int16_t s[HISTORY_BLOCK * 2];     /* interleaved L/R mantissas */
+    int8_t  exp[2];                   /* per-channel exponent      */
+} history_block_t;
+
+/* Frames are addressed by absolute index since the history was created
+ * (long long, so no wrap in practice).  Owned by the trace's
+ * acquisition thread until a pause hands it to the renderer:
+ * history_ingest() copies whole blocks out of the live ring through
+ * the history's own cursor, and paused drawing decodes from here
+ * instead of seeking the ring backwards.  Frames the writer overwrote
+ * before the cursor got to them (a pause, a long stall) are skipped,
+ * not padded, so the history stays gapless in its own frame count. */
+typedef struct {
+    history_block_t *blocks;
+    size_t n_blocks;                  /* capacity                          */
+    unsigned long long written;       /* blocks encoded so far             */
+    bcast_reader_t reader;            /* cursor on the live ring           */
+    pyramid_t pyramid;                /* min/max/RMS, one leaf per block   */
+    spool_t *spool;                   /* older blocks on disk, or NULL     */
+} history_t;
+
+static inline void history_init(history_t *h, size_t frames)
+{
+    memset(h, 0, sizeof(*h));
+    h->n_blocks = (frames + HISTORY_BLOCK - 1) / HISTORY_BLOCK;
+    /* malloc, not calloc+bzero: pages are only touched as blocks are
+     * written, so a short session never pays for the full minute */
+    h->blocks = (history_block_t *)malloc(h->n_blocks * sizeof(history_block_t));
+    pyramid_init(&h->pyramid, h->n_blocks);
+}
+
+static inline void history_free(history_t *h)
+{
+    free(h->blocks);
+    h->blocks = NULL;
+    pyramid_free(&h->pyramid);
+}
+
+/* First frame still held, and one past the newest encoded frame */
+static inline long long history_begin(const history_t *h)
+{
+    unsigned long long first = h->written > h->n_blocks ? h->written - h->n_blocks : 0;
+    return (long long)(first * HISTORY_BLOCK);
+}
+
+static inline long long history_end(const history_t *h)
+{
+    return (long long)(h->written * HISTORY_BLOCK);
+}
+
+/* First frame reachable at all, counting the spool */
+static inline long long history_oldest(const history_t *h)
+{
+    long long begin = history_begin(h);
+    if (h->spool) {
+        unsigned long long first = spool_begin(h->spool);
+        if (first != (unsigned long long)-1 && (long long)(first * HISTORY_BLOCK) < begin)
+            begin = (long long)(first * HISTORY_BLOCK);
+    }
+    return begin;
+}
+
+/* Absolute index one past the newest frame in the live ring, as of the
+ * last history_ingest() */
+static inline long long history_live_end(const history_t *h)
+{
+    if (!h->reader.ring)
+        return history_end(h);
+    uint64_t pending = h->reader.head_cache - h->reader.pos;
+    return history_end(h) + (long long)(pending / sizeof(frame_t));
+}
+
+static inline void history_encode_block(history_block_t *blk, const frame_t *src)
+{
+    for (unsigned int c = 0; c < 2; c++) {
+        const float *x = (const float *)src + c;
+        float peak = 0.0f;
+        for (unsigned int i = 0; i < HISTORY_BLOCK; i++) {
+            float a = fabsf(x[i * 2]);
+            if (a > peak) peak = a;
+        }
+        /* peak = m * 2^e with m in [0.5, 1): every |x| * 2^(15-e) < 32768 */
+        int e = 0;
+        frexpf(peak, &e);
+        if (e < -112) e = -112;
+        if (e >  127) e =  127;
+        blk->exp[c] = (int8_t)e;
+        float scale = ldexpf(1.0f, 15 - e);
+        for (unsigned int i = 0; i < HISTORY_BLOCK; i++) {
+            long v = lrintf(x[i * 2] * scale);
+            if (v >  32767) v =  32767;
+            if (v < -32768) v = -32768;
+            blk->s[i * 2 + c] = (int16_t)v;
+        }
+    }
+}
+
+/* Encode every whole block the writer has published since the last
+ * call.  The cursor starts at the head the first time it sees a ring
+ * (or a new one after a reinit).  A partial block stays in the ring
+ * until it fills. */
+static inline void history_ingest(history_t *h, const bcast_ring_t *r)
+{
+    const size_t blk_bytes = HISTORY_BLOCK * sizeof(frame_t);
+
+    if (h->reader.ring != r)
+        bcast_reader_init(&h->reader, r);
+    bcast_read_space(&h->reader);
+    if (!h->blocks) {
+        bcast_seek(&h->reader, h->reader.head_cache);
+        return;
+    }
+
+    while (h->reader.head_cache - h->reader.pos >= blk_bytes) {
+        frame_t tmp[HISTORY_BLOCK];
+        if (bcast_read(&h->reader, (char *)tmp, blk_bytes) < blk_bytes)
+            continue;                 /* overwritten mid-copy: cursor moved on */
+        history_block_t *blk = &h->blocks[h->written % h->n_blocks];
+        history_encode_block(blk, tmp);
+        pyramid_push(&h->pyramid, tmp, HISTORY_BLOCK);
+        if (h->spool)
+            spool_push(h->spool, h->written, blk);
+        h->written++;
+    }
+}
+
+/* Block b from RAM, falling back to the spool once it has aged out.
+ * Spooled blocks are copied into *scratch, since the spool writer may
+ * reuse their slot while they are being decoded. */
+static inline const history_block_t *history_block(const history_t *h,
+                                                   unsigned long long b,
+                                                   history_block_t *scratch)
+{
+    if (b >= h->written)
+        return NULL;
+    if (h->blocks && (long long)(b * HISTORY_BLOCK) >= history_begin(h))
+        return &h->blocks[b % h->n_blocks];
+    if (h->spool && spool_copy_block(h->spool, b, scratch))
+        return scratch;
+    return NULL;
+}
+
+/* Decode frames [start, start + n) into dst.  Frames neither in memory
+ * nor on the spool come back as silence.  Returns n. */
+static inline size_t history_read(const history_t *h, long long start,
+                                  frame_t *dst, size_t n)
+{
+    size_t i = 0;
+    history_block_t scratch;
+
+    while (i < n) {
+        long long f = start + (long long)i;
+        if (f < 0) {
+            dst[i].left_channel = dst[i].right_channel = 0.0f;
+            i++;
+            continue;
+        }
+        unsigned long long b = (unsigned long long)f / HISTORY_BLOCK;
+        size_t off = (size_t)(f - (long long)(b * HISTORY_BLOCK));
+        size_t cnt = HISTORY_BLOCK - off;
+        if (cnt > n - i) cnt = n - i;
+
+        const history_block_t *blk = history_block(h, b, &scratch);
+        if (!blk) {
+            memset(dst + i, 0, cnt * sizeof(frame_t));
+            i += cnt;
+            continue;
+        }
+        const float sl = ldexpf(1.0f, blk->exp[0] - 15);
+        const float sr = ldexpf(1.0f, blk->exp[1] - 15);
+        for (size_t k = 0; k < cnt; k++) {
+            dst[i + k].left_channel  = (sample_t)(blk->s[(off + k) * 2]     * sl);
+            dst[i + k].right_channel = (sample_t)(blk->s[(off + k) * 2 + 1] * sr);
+        }
+        i += cnt;
+    }
+    return n;
+}
+
+/* Min/max/RMS of frames [start, end), to block resolution (the blocks
+ * the span touches), without decoding any samples.  Returns false if
+ * none of it is still held. */
+static inline bool history_summary(const history_t *h, long long start,
+                                   long long end, pyramid_node_t *out)
+{
+    if (start < 0) start = 0;
+    if (end <= start)
+        return false;
+    unsigned long long first = (unsigned long long)start / HISTORY_BLOCK;
+    unsigned long long last  = ((unsigned long long)end + HISTORY_BLOCK - 1) / HISTORY_BLOCK;
+    return pyramid_query(&h->pyramid, first, last, out) > 0;
+}
+
+#endif /* XYSCOPE_HISTORY_H */
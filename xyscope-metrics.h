@@ -0,0 +1,262 @@
+/*
+ *  xyscope-metrics.h
+ *  Capture-clock block tags, the capture-to-screen latency window and
+ *  the drop accounting behind the stats overlay and --metrics-file.
+ *
+ *  Copyright (c) 2006-2007 by Chris Reaume <chris@flatlan.net>
+ *    All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+
+#ifndef XYSCOPE_METRICS_H
+#define XYSCOPE_METRICS_H
+
+#include <stdio.h>
+#include "xyscope-shared.h"
+#include "xyscope-ringbuffer.h"
+
+#define BLOCK_TAGS 64                 /* tags in flight and remembered      */
+
+/* Written by the capture side for every block it commits to the ring,
+ * just before the commit, so the reader always holds the tag for any
+ * data it can see.  Frames are counted in ring frames since the ring
+ * was created, so a ring position (bcast_ring_t head or a cursor) is
+ * just frame * sizeof(frame_t). */
+typedef struct {
+    unsigned long long frame;         /* one past the block's last frame   */
+    unsigned long long ns;            /* capture time of that last frame,
+                                         on the monotonic_ns() clock       */
+} block_tag_t;
+
+/* Render-side memory of the newest tags, drained from the capture
+ * side's tag ring every frame */
+typedef struct {
+    block_tag_t tag[BLOCK_TAGS];
+    unsigned long long count;         /* tags seen so far                  */
+} tag_log_t;
+
+static inline void tag_log_drain(tag_log_t *log, ringbuffer_t *tags)
+{
+    block_tag_t t;
+    while (ringbuffer_read_space(tags) >= sizeof(t)) {
+        ringbuffer_read(tags, (char *)&t, sizeof(t));
+        log->tag[log->count++ % BLOCK_TAGS] = t;
+    }
+}
+
+/* Capture time of frame f at `rate` frames per second, from the tag of
+ * the block holding it (or the nearest one remembered) */
+static inline bool tag_log_time(const tag_log_t *log, unsigned long long f,
+                                int rate, unsigned long long *ns)
+{
+    if (log->count == 0 || rate <= 0)
+        return false;
+    unsigned long long first = log->count > BLOCK_TAGS ? log->count - BLOCK_TAGS : 0;
+    const block_tag_t *t = &log->tag[(log->count - 1) % BLOCK_TAGS];
+    for (unsigned long long i = log->count - 1; i > first; i--) {
+        const block_tag_t *prev = &log->tag[(i - 1) % BLOCK_TAGS];
+        if (prev->frame <= f)
+            break;
+        t = prev;
+    }
+    double back = ((double)t->frame - 1.0 - (double)f) * 1e9 / rate;
+    *ns = (unsigned long long)((double)t->ns - back);
+    return true;
+}
+
+
+/* ---- Latency window ---- */
+
+#define LATENCY_WINDOW   2048         /* most recent samples kept          */
+#define LATENCY_SUB      16           /* histogram buckets per octave      */
+#define LATENCY_OCTAVES  24           /* 1 usec .. ~16 s                   */
+#define LATENCY_BUCKETS  (LATENCY_SUB * LATENCY_OCTAVES)
+
+/* Sliding window of capture-to-screen latencies in usec.  Each sample
+ * also lands in a log-spaced histogram (about 4% wide buckets) and is
+ * taken back out when it leaves the window, so percentiles never need
+ * a sort. */
+typedef struct {
+    float sample[LATENCY_WINDOW];
+    unsigned int hist[LATENCY_BUCKETS];
+    unsigned int n;                   /* samples in the window             */
+    unsigned int pos;                 /* next slot to overwrite            */
+} latency_window_t;
+
+static inline void latency_reset(latency_window_t *w)
+{
+    memset(w, 0, sizeof(*w));
+}
+
+static inline unsigned int latency_bucket(float usec)
+{
+    if (usec < 1.0f)
+        return 0;
+    int e = 0;
+    float m = frexpf(usec, &e);       /* usec = m * 2^e, m in [0.5, 1) */
+    int b = (e - 1) * LATENCY_SUB + (int)((m * 2.0f - 1.0f) * LATENCY_SUB);
+    return b < LATENCY_BUCKETS ? (unsigned int)b : LATENCY_BUCKETS - 1;
+}
+
+/* Lower edge of bucket b in usec */
+static inline double latency_bucket_floor(unsigned int b)
+{
+    return ldexp(1.0 + (double)(b % LATENCY_SUB) / LATENCY_SUB, b / LATENCY_SUB);
+}
+
+static inline void latency_add(latency_window_t *w, float usec)
+{
+    if (w->n == LATENCY_WINDOW)
+        w->hist[latency_bucket(w->sample[w->pos])]--;
+    else
+        w->n++;
+    w->sample[w->pos] = usec;
+    w->hist[latency_bucket(usec)]++;
+    w->pos = (w->pos + 1) % LATENCY_WINDOW;
+}
+
+static inline double latency_max(const latency_window_t *w)
+{
+    float m = 0.0f;
+    for (unsigned int i = 0; i < w->n; i++)
+        if (w->sample[i] > m)
+            m = w->sample[i];
+    return m;
+}
+
+/* p-quantile (0..1) in usec, interpolated within its bucket and never
+ * above the window's actual maximum */
+static inline double latency_percentile(const latency_window_t *w, double p)
+{
+    if (w->n == 0)
+        return 0.0;
+    double rank = p * (w->n - 1) + 1.0;
+    double top  = latency_max(w);
+    unsigned int seen = 0;
+    for (unsigned int b = 0; b < LATENCY_BUCKETS; b++) {
+        if (!w->hist[b])
+            continue;
+        if (seen + w->hist[b] >= rank) {
+            double lo = latency_bucket_floor(b), hi = latency_bucket_floor(b + 1);
+            double v  = lo + (hi - lo) * (rank - seen) / w->hist[b];
+            return v < top ? v : top;
+        }
+        seen += w->hist[b];
+    }
+    return top;
+}
+
+
+/* ---- Drop accounting ---- */
+
+#define ADVANCE_BUCKETS 20            /* 0, then powers of two to 2^18     */
+
+/* How far each live frame's window moved along the ring from the last
+ * one's, so a lossless run can be told from one that merely looks
+ * smooth.  Windows are draw_frames long and normally overlap; frames
+ * between two windows that neither showed were skipped, and a window
+ * that didn't move forward repeated the last. */
+typedef struct {
+    unsigned long long frames;        /* live frames counted               */
+    unsigned long long skipped;       /* ring frames no window showed      */
+    unsigned long long repeated;      /* frames that showed nothing new    */
+    unsigned long long clamped;       /* frames the clock recovery asked
+                                         for data the window didn't hold   */
+    unsigned long long hist[ADVANCE_BUCKETS];  /* 0: none or backwards,
+                                         b: [2^(b-1), 2^b) ring frames     */
+    unsigned long long last_end;      /* last window's end, 0 = none       */
+    unsigned long long backlog;       /* --lossless: frames left to draw   */
+    unsigned long long backlog_max;
+    unsigned long long grown;         /* frames drawn with a grown window  */
+} advance_stats_t;
+
+static inline unsigned int advance_bucket(long long adv)
+{
+    unsigned int b = 0;
+    if (adv <= 0)
+        return 0;
+    while (b + 1 < ADVANCE_BUCKETS && (1LL << b) <= adv)
+        b++;
+    return b;
+}
+
+/* A live frame's window ending at ring frame `end`, `window` long */
+static inline void advance_add(advance_stats_t *a, unsigned long long end,
+                               size_t window, bool clamped)
+{
+    if (a->last_end) {
+        long long adv = (long long)(end - a->last_end);
+        a->hist[advance_bucket(adv)]++;
+        if (adv <= 0)
+            a->repeated++;
+        else if ((unsigned long long)adv > window)
+            a->skipped += adv - window;
+    }
+    if (clamped)
+        a->clamped++;
+    a->frames++;
+    a->last_end = end;
+}
+
+/* Everywhere a frame can go missing between the device and the screen,
+ * summed over the primary source for the overlay and --metrics-file */
+typedef struct {
+    unsigned long long xruns;         /* device or graph discontinuities   */
+    unsigned long long xrun_frames;   /* frames they cost, where known     */
+    unsigned long long drained;       /* Pipewire drained events           */
+    unsigned long long dropped;       /* frames the capture side couldn't fit */
+    unsigned long long overruns;      /* ring readers lapped by the writer */
+    unsigned long long lost;          /* frames overwritten before the
+                                         history (or raw drain) read them  */
+    unsigned long long tags_dropped;  /* block tags the tag ring refused   */
+    const advance_stats_t *advance;
+} drop_counts_t;
+
+/* One JSON object per line: the summary, then the non-empty histogram
+ * buckets as [lower edge usec, count] pairs, the drop counters, and the
+ * non-empty window advance buckets as [lower edge frames, count] */
+static inline void latency_dump(FILE *f, const latency_window_t *w,
+                                unsigned long long now_ns, double fps,
+                                double wake_avg_us, double wake_max_us,
+                                unsigned long long wake_lost,
+                                unsigned long long win_dropped,
+                                unsigned long long win_repeated,
+                                const drop_counts_t *d)
+{
+    fprintf(f, "{\"t\":%.3f,\"fps\":%.1f,\"n\":%u,\"p50_us\":%.1f,\"p99_us\":%.1f,"
+               "\"max_us\":%.1f,\"wake_avg_us\":%.1f,\"wake_max_us\":%.1f,\"wake_lost\":%llu,"
+               "\"win_dropped\":%llu,\"win_repeated\":%llu,\"hist\":[",
+            now_ns * 1e-9, fps, w->n, latency_percentile(w, 0.5),
+            latency_percentile(w, 0.99), latency_max(w), wake_avg_us, wake_max_us,
+            wake_lost, win_dropped, win_repeated);
+    bool first = true;
+    for (unsigned int b = 0; b < LATENCY_BUCKETS; b++) {
+        if (!w->hist[b])
+            continue;
+        fprintf(f, "%s[%.1f,%u]", first ? "" : ",", latency_bucket_floor(b), w->hist[b]);
+        first = false;
+    }
+    fprintf(f, "],\"xruns\":%llu,\"xrun_frames\":%llu,\"drained\":%llu,\"dropped\":%llu,"
+               "\"overruns\":%llu,\"lost\":%llu,\"tags_dropped\":%llu,\"skipped\":%llu,"
+               "\"repeated\":%llu,\"clamped\":%llu,\"backlog\":%llu,\"backlog_max\":%llu,"
+               "\"grown\":%llu,\"advance\":[",
+            d->xruns, d->xrun_frames, d->drained, d->dropped, d->overruns, d->lost,
+            d->tags_dropped, d->advance->skipped, d->advance->repeated, d->advance->clamped,
+            d->advance->backlog, d->advance->backlog_max, d->advance->grown);
+    first = true;
+    for (unsigned int b = 0; b < ADVANCE_BUCKETS; b++) {
+        if (!d->advance->hist[b])
+            continue;
+        fprintf(f, "%s[%llu,%llu]", first ? "" : ",", b ? 1ULL << (b - 1) : 0ULL,
+                d->advance->hist[b]);
+        first = false;
+    }
+    fprintf(f, "]}\n");
+    fflush(f);
+}
+
+#endif /* XYSCOPE_METRICS_H */
@@ -0,0 +1,177 @@
+/*
+ *  xyscope-notify.h
+ *  Lock-free "new audio" wakeup from the capture thread to the renderer.
+ *
+ *  Copyright (c) 2006-2007 by Chris Reaume <chris@flatlan.net>
+ *    All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+
+#ifndef XYSCOPE_NOTIFY_H
+#define XYSCOPE_NOTIFY_H
+
+#include <stdint.h>
+#include "xyscope-shared.h"
+#include "xyscope-ringbuffer.h"
+
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#include <mach/semaphore.h>
+#elif !defined(_WIN32)
+#include <errno.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+/* The writer publishes a 32-bit key (the ring's write index) after
+ * every commit; the reader sleeps until the key differs from the one
+ * it last consumed.  The writer only enters the kernel when the reader
+ * has announced it is parked, and never takes a lock, so a wakeup can't
+ * be dropped because the renderer happens to be busy.
+ *
+ * On Linux the reader sleeps on the key itself with a futex, which
+ * re-checks it atomically.  macOS (Mach semaphore) and Windows (auto-
+ * reset event) sleep on a separate object; a post that races with the
+ * reader going to sleep leaves the object signalled, so the sleep
+ * returns at once and the loop re-checks the key. */
+
+#if defined(__GNUC__) || defined(__clang__)
+#define notify_store(ptr, val) __atomic_store_n(ptr, val, __ATOMIC_SEQ_CST)
+#define notify_load(ptr)       __atomic_load_n(ptr, __ATOMIC_SEQ_CST)
+#define notify_fence()         __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#else
+#define notify_store(ptr, val) InterlockedExchange((volatile LONG *)(ptr), (LONG)(val))
+#define notify_load(ptr)       ((uint32_t)InterlockedCompareExchange((volatile LONG *)(ptr), 0, 0))
+#define notify_fence()         MemoryBarrier()
+#endif
+
+typedef struct {
+    /* Writer-owned */
+    alignas(RB_CACHE_LINE) uint32_t key;
+    volatile unsigned long long post_ns;  /* monotonic_ns() of the latest post */
+
+    /* Reader-owned (the writer only peeks at `waiting`) */
+    alignas(RB_CACHE_LINE) uint32_t waiting;
+    uint32_t seen;                    /* key consumed by the last wait */
+#if defined(__APPLE__)
+    semaphore_t sem;
+#elif defined(_WIN32)
+    HANDLE event;
+#endif
+
+    /* Stats, updated by the reader */
+    unsigned long long sleeps;        /* waits that had to park            */
+    unsigned long long timeouts;      /* parked and no data arrived        */
+    unsigned long long lost;          /* data arrived but no wake came     */
+    unsigned long long lat_last_ns;   /* post -> reader running            */
+    unsigned long long lat_max_ns;
+    double             lat_avg_ns;
+} notify_t;
+
+static inline void notify_init(notify_t *n)
+{
+    memset(n, 0, sizeof(*n));
+#if defined(__APPLE__)
+    semaphore_create(mach_task_self(), &n->sem, SYNC_POLICY_FIFO, 0);
+#elif defined(_WIN32)
+    n->event = CreateEvent(NULL, FALSE, FALSE, NULL);
+#endif
+}
+
+static inline void notify_destroy(notify_t *n)
+{
+#if defined(__APPLE__)
+    semaphore_destroy(mach_task_self(), n->sem);
+#elif defined(_WIN32)
+    CloseHandle(n->event);
+#endif
+}
+
+/* Sleep for at most ns while the key still equals `seen`.  Returns
+ * true if the sleep ran out rather than being woken. */
+static inline bool notify_sleep(notify_t *n, uint32_t seen, unsigned long long ns)
+{
+#if defined(__APPLE__)
+    (void)seen;
+    mach_timespec_t ts = { (unsigned int)(ns / 1000000000ULL),
+                           (clock_res_t)(ns % 1000000000ULL) };
+    return semaphore_timedwait(n->sem, ts) == KERN_OPERATION_TIMED_OUT;
+#elif defined(_WIN32)
+    (void)seen;
+    DWORD ms = (DWORD)((ns + 999999ULL) / 1000000ULL);
+    return WaitForSingleObject(n->event, ms) == WAIT_TIMEOUT;
+#else
+    struct timespec ts;
+    ts.tv_sec  = (time_t)(ns / 1000000000ULL);
+    ts.tv_nsec = (long)(ns % 1000000000ULL);
+    long r = syscall(SYS_futex, &n->key, FUTEX_WAIT_PRIVATE, seen, &ts, NULL, 0);
+    return r == -1 && errno == ETIMEDOUT;
+#endif
+}
+
+static inline void notify_wake(notify_t *n)
+{
+#if defined(__APPLE__)
+    semaphore_signal(n->sem);
+#elif defined(_WIN32)
+    SetEvent(n->event);
+#else
+    syscall(SYS_futex, &n->key, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+#endif
+}
+
+/* Writer: publish a new key, stamped with the monotonic_ns() time the
+ * data was captured.  Wait-free unless the reader is parked. */
+static inline void notify_post(notify_t *n, uint32_t key, unsigned long long now_ns)
+{
+    n->post_ns = now_ns;
+    notify_store(&n->key, key);
+    if (notify_load(&n->waiting))
+        notify_wake(n);
+}
+
+/* Reader: return as soon as the key has moved past the last one seen,
+ * sleeping up to timeout_ns for it.  Returns false on timeout. */
+static inline bool notify_wait(notify_t *n, unsigned long long timeout_ns)
+{
+    uint32_t seen = n->seen;
+    uint32_t key  = notify_load(&n->key);
+    if (key != seen) {
+        n->seen = key;
+        return true;
+    }
+
+    unsigned long long now      = monotonic_ns();
+    unsigned long long deadline = now + timeout_ns;
+    bool timed_out = false;
+
+    n->sleeps++;
+    notify_store(&n->waiting, 1);
+    while ((key = notify_load(&n->key)) == seen && now < deadline) {
+        timed_out = notify_sleep(n, seen, deadline - now);
+        now = monotonic_ns();
+    }
+    notify_store(&n->waiting, 0);
+
+    if (key == seen) {
+        n->timeouts++;
+        return false;
+    }
+    if (timed_out)
+        n->lost++;
+
+    unsigned long long post = n->post_ns;
+    n->lat_last_ns = now > post ? now - post : 0;
+    if (n->lat_last_ns > n->lat_max_ns)
+        n->lat_max_ns = n->lat_last_ns;
+    n->lat_avg_ns += ((double)n->lat_last_ns - n->lat_avg_ns) * 0.05;
+    n->seen = key;
+    return true;
+}
+
+#endif /* XYSCOPE_NOTIFY_H */
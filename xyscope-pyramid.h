@@ -0,0 +1,168 @@
+/*
+ *  xyscope-pyramid.h
+ *  Min/max/RMS mip pyramid over the rewind history, for scrubbing and
+ *  the paused timeline overview.
+ *
+ *  Copyright (c) 2006-2007 by Chris Reaume <chris@flatlan.net>
+ *    All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+
+#ifndef XYSCOPE_PYRAMID_H
+#define XYSCOPE_PYRAMID_H
+
+#include "xyscope-shared.h"
+
+#define PYRAMID_MAX_LEVELS 32
+
+/* Summary of a span of frames, per channel */
+typedef struct {
+    float min[2];
+    float max[2];
+    float ms[2];                      /* mean square */
+} pyramid_node_t;
+
+/* Level 0 has one node per leaf (a fixed run of frames, one history
+ * block); each node on level k merges two on level k-1, so it covers
+ * 2^k leaves.  Every level is a ring indexed by absolute node number,
+ * sized to hold just more than `leaves` worth, so old nodes fall off as
+ * the history wraps.  A level-k node is written the moment its last
+ * leaf arrives: pushing a leaf costs O(1) amortized and nothing is ever
+ * rescanned. */
+typedef struct {
+    pyramid_node_t *level[PYRAMID_MAX_LEVELS];
+    size_t slots[PYRAMID_MAX_LEVELS];
+    unsigned int levels;
+    size_t leaves;                    /* leaves retained                */
+    unsigned long long written;       /* leaves pushed so far           */
+    pyramid_node_t *storage;
+} pyramid_t;
+
+static inline void pyramid_init(pyramid_t *p, size_t leaves)
+{
+    size_t total = 0;
+
+    memset(p, 0, sizeof(*p));
+    p->leaves = leaves;
+    while (p->levels < PYRAMID_MAX_LEVELS
+           && (p->levels == 0 || ((size_t)1 << p->levels) <= leaves)) {
+        p->slots[p->levels] = (leaves >> p->levels) + 2;
+        total += p->slots[p->levels];
+        p->levels++;
+    }
+    p->storage = (pyramid_node_t *)malloc(total * sizeof(pyramid_node_t));
+    if (!p->storage) {
+        p->levels = 0;
+        return;
+    }
+    total = 0;
+    for (unsigned int k = 0; k < p->levels; k++) {
+        p->level[k] = p->storage + total;
+        total += p->slots[k];
+    }
+}
+
+static inline void pyramid_free(pyramid_t *p)
+{
+    free(p->storage);
+    p->storage = NULL;
+    p->levels  = 0;
+}
+
+static inline pyramid_node_t *pyramid_node(const pyramid_t *p, unsigned int k,
+                                           unsigned long long j)
+{
+    return &p->level[k][j % p->slots[k]];
+}
+
+/* Fold b (covering wb leaves) into a (covering wa) */
+static inline void pyramid_merge(pyramid_node_t *a, double wa,
+                                 const pyramid_node_t *b, double wb)
+{
+    for (unsigned int c = 0; c < 2; c++) {
+        if (b->min[c] < a->min[c]) a->min[c] = b->min[c];
+        if (b->max[c] > a->max[c]) a->max[c] = b->max[c];
+        a->ms[c] = (float)((a->ms[c] * wa + b->ms[c] * wb) / (wa + wb));
+    }
+}
+
+/* Append one leaf summarizing n interleaved stereo frames */
+static inline void pyramid_push(pyramid_t *p, const frame_t *src, size_t n)
+{
+    if (!p->levels)
+        return;
+
+    pyramid_node_t *leaf = pyramid_node(p, 0, p->written);
+    for (unsigned int c = 0; c < 2; c++) {
+        const float *x = (const float *)src + c;
+        float lo = x[0], hi = x[0];
+        double sq = 0.0;
+        for (size_t i = 0; i < n; i++) {
+            float v = x[i * 2];
+            if (v < lo) lo = v;
+            if (v > hi) hi = v;
+            sq += (double)v * v;
+        }
+        leaf->min[c] = lo;
+        leaf->max[c] = hi;
+        leaf->ms[c]  = (float)(sq / (double)n);
+    }
+
+    /* complete every parent whose last leaf this was */
+    unsigned long long idx = p->written++;
+    for (unsigned int k = 1; k < p->levels; k++) {
+        unsigned long long span = 1ULL << k;
+        if ((idx + 1) % span)
+            break;
+        unsigned long long j = idx >> k;
+        pyramid_node_t *dst = pyramid_node(p, k, j);
+        *dst = *pyramid_node(p, k - 1, j * 2);
+        pyramid_merge(dst, 1.0, pyramid_node(p, k - 1, j * 2 + 1), 1.0);
+    }
+}
+
+/* Oldest leaf still retained */
+static inline unsigned long long pyramid_begin(const pyramid_t *p)
+{
+    return p->written > p->leaves ? p->written - p->leaves : 0;
+}
+
+/* Summarize leaves [first, last), clamped to what is retained, by
+ * walking the largest aligned nodes that fit: at most two per level,
+ * so O(log n) nodes whatever the span.  Returns the number of leaves
+ * covered (0 leaves *out untouched). */
+static inline unsigned long long pyramid_query(const pyramid_t *p,
+                                               unsigned long long first,
+                                               unsigned long long last,
+                                               pyramid_node_t *out)
+{
+    unsigned long long begin = pyramid_begin(p);
+    unsigned long long covered = 0;
+
+    if (first < begin)
+        first = begin;
+    if (last > p->written)
+        last = p->written;
+
+    while (first < last && p->levels) {
+        unsigned int k = 0;
+        while (k + 1 < p->levels
+               && (first & ((2ULL << k) - 1)) == 0
+               && first + (2ULL << k) <= last)
+            k++;
+        const pyramid_node_t *node = pyramid_node(p, k, first >> k);
+        if (covered == 0)
+            *out = *node;
+        else
+            pyramid_merge(out, (double)covered, node, (double)(1ULL << k));
+        covered += 1ULL << k;
+        first   += 1ULL << k;
+    }
+    return covered;
+}
+
+#endif /* XYSCOPE_PYRAMID_H */
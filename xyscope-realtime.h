@@ -0,0 +1,294 @@
+/*
+ *  xyscope-realtime.h
+ *  --realtime: realtime scheduling for our own threads (directly, or
+ *  through rtkit), locked and pre-faulted memory, and CPU pinning.
+ *
+ *  Copyright (c) 2006-2007 by Chris Reaume <chris@flatlan.net>
+ *    All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+
+#ifndef XYSCOPE_REALTIME_H
+#define XYSCOPE_REALTIME_H
+
+#include <stdint.h>
+#include <errno.h>
+#include "xyscope-shared.h"
+
+#ifdef __APPLE__
+#include <pthread.h>
+#include <sys/mman.h>
+#include <mach/mach.h>
+#include <mach/mach_time.h>
+#include <mach/thread_policy.h>
+#elif !defined(_WIN32)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <pipewire/pipewire.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define rt_count(ptr)   __atomic_fetch_add(ptr, 1, __ATOMIC_RELAXED)
+#define rt_load(ptr)    __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define rt_store(ptr, v) __atomic_store_n(ptr, v, __ATOMIC_RELEASE)
+#else
+#define rt_count(ptr)   InterlockedIncrement((volatile LONG *)(ptr))
+#define rt_load(ptr)    ((uint32_t)InterlockedCompareExchange((volatile LONG *)(ptr), 0, 0))
+#define rt_store(ptr, v) InterlockedExchange((volatile LONG *)(ptr), (LONG)(v))
+#endif
+
+#define RT_DEFAULT_PRIORITY 10        /* render and DSP; SCHED_FIFO 1-99   */
+#define RT_ACQUIRE_BOOST    5         /* acquisition threads, above render */
+#define RT_CAPTURE_BOOST    10        /* our own capture loops, above all  */
+#define RT_MAX_CPUS         64
+#define RT_MAX_REGIONS      64        /* rt_lock_region() calls tracked    */
+
+/* Nothing here is done until the primary source is running: on
+ * Pipewire the rtkit path goes through the client context's thread
+ * utils (module-rt, loaded by default), which only exist once a stream
+ * has been set up.  Then rt_request() bumps `generation`, and each of
+ * our threads promotes and pins itself the next time it calls
+ * rt_thread_poll(); threads started later (after a reconfiguration) do
+ * it on their first call.  Capture callbacks on Pipewire's data loop
+ * and CoreAudio's IO thread are already realtime and left alone.
+ *
+ * The outcome is counted here for the stats overlay. */
+typedef struct {
+    const void *p;
+    size_t len;
+} rt_region_t;
+
+typedef struct {
+    bool enabled;                     /* --realtime                        */
+    int priority;                     /* --rt-priority, render thread      */
+    const char *cpus;                 /* --cpus list, NULL = any           */
+    uint64_t cpu_mask;                /* parsed from cpus                  */
+    unsigned long long period_ns;     /* display frame, for macOS' policy  */
+    uint32_t generation;              /* bumped by rt_request()            */
+
+    uint32_t threads;                 /* threads that asked                */
+    uint32_t threads_rt;              /* promoted directly                 */
+    uint32_t threads_rtkit;           /* promoted through rtkit            */
+    uint32_t threads_pinned;
+    int sched_errno;                  /* why the last promotion failed     */
+    int pin_errno;                    /* why the last pinning failed       */
+    bool locked_all;                  /* mlockall() took everything        */
+    size_t locked_bytes;              /* otherwise, the regions we locked  */
+    int lock_errno;                   /* why locking (all or some) failed  */
+    rt_region_t regions[RT_MAX_REGIONS];
+    unsigned int n_regions;
+} realtime_t;
+
+extern realtime_t realtime;
+
+/* "0-3,6" -> bits 0, 1, 2, 3 and 6.  Returns false on a malformed list
+ * or a CPU past RT_MAX_CPUS. */
+static inline bool rt_parse_cpus(const char *list, uint64_t *mask)
+{
+    const char *p = list;
+    *mask = 0;
+    while (*p) {
+        char *end;
+        long lo = strtol(p, &end, 10), hi = lo;
+        if (end == p || lo < 0)
+            return false;
+        p = end;
+        if (*p == '-') {
+            hi = strtol(p + 1, &end, 10);
+            if (end == p + 1 || hi < lo)
+                return false;
+            p = end;
+        }
+        if (hi >= RT_MAX_CPUS)
+            return false;
+        for (long c = lo; c <= hi; c++)
+            *mask |= 1ULL << c;
+        if (*p == ',')
+            p++;
+        else if (*p)
+            return false;
+    }
+    return *mask != 0;
+}
+
+/* Start promoting: called once the primary source is up */
+static inline void rt_request(realtime_t *rt)
+{
+    rt_store(&rt->generation, rt_load(&rt->generation) + 1);
+}
+
+/* Make the calling thread realtime at `prio`.  Linux tries SCHED_FIFO
+ * first (enough with CAP_SYS_NICE or an rtprio limit), then rtkit
+ * through Pipewire; macOS uses a time-constraint policy sized to the
+ * display frame, Windows a higher thread priority. */
+static inline void rt_promote_self(realtime_t *rt, int prio)
+{
+#ifdef _WIN32
+    int level = prio >= rt->priority + RT_CAPTURE_BOOST ? THREAD_PRIORITY_TIME_CRITICAL
+                                                        : THREAD_PRIORITY_HIGHEST;
+    if (SetThreadPriority(GetCurrentThread(), level))
+        rt_count(&rt->threads_rt);
+    else
+        rt->sched_errno = (int)GetLastError();
+#elif defined(__APPLE__)
+    mach_timebase_info_data_t tb;
+    mach_timebase_info(&tb);
+    double to_abs = (double)tb.denom / tb.numer;
+    unsigned long long period = rt->period_ns ? rt->period_ns : 16666667ULL;
+    thread_time_constraint_policy_data_t policy;
+    policy.period      = (uint32_t)(period * to_abs);
+    policy.computation = (uint32_t)(period / 4 * to_abs);
+    policy.constraint  = (uint32_t)(period / 2 * to_abs);
+    policy.preemptible = 1;
+    kern_return_t kr = thread_policy_set(pthread_mach_thread_np(pthread_self()),
+                                         THREAD_TIME_CONSTRAINT_POLICY,
+                                         (thread_policy_t)&policy,
+                                         THREAD_TIME_CONSTRAINT_POLICY_COUNT);
+    (void)prio;
+    if (kr == KERN_SUCCESS)
+        rt_count(&rt->threads_rt);
+    else
+        rt->sched_errno = (int)kr;
+#else
+    struct sched_param sp;
+    int max = sched_get_priority_max(SCHED_FIFO);
+    memset(&sp, 0, sizeof(sp));
+    sp.sched_priority = prio > max ? max : prio;
+#ifdef SCHED_RESET_ON_FORK
+    int policy = SCHED_FIFO | SCHED_RESET_ON_FORK;
+#else
+    int policy = SCHED_FIFO;
+#endif
+    int err = pthread_setschedparam(pthread_self(), policy, &sp);
+    if (err == 0) {
+        rt_count(&rt->threads_rt);
+        return;
+    }
+    /* rtkit caps the priority it grants; Pipewire asks for no more */
+    if (pw_thread_utils_acquire_rt((struct spa_thread *)pthread_self(), sp.sched_priority) == 0) {
+        rt_count(&rt->threads_rtkit);
+        return;
+    }
+    rt->sched_errno = err;
+#endif
+}
+
+/* Pin the calling thread to rt->cpu_mask */
+static inline void rt_pin_self(realtime_t *rt)
+{
+    if (!rt->cpu_mask)
+        return;
+#ifdef _WIN32
+    if (SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)rt->cpu_mask))
+        rt_count(&rt->threads_pinned);
+    else
+        rt->pin_errno = (int)GetLastError();
+#elif defined(__APPLE__)
+    rt->pin_errno = ENOTSUP;          /* only affinity tags, no binding */
+#else
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int c = 0; c < RT_MAX_CPUS; c++) {
+        if (rt->cpu_mask & (1ULL << c))
+            CPU_SET(c, &set);
+    }
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err == 0)
+        rt_count(&rt->threads_pinned);
+    else
+        rt->pin_errno = err;
+#endif
+}
+
+/* Called from each of our threads' loops: promote and pin once per
+ * request.  *seen is the thread's own, starting at 0. */
+static inline void rt_thread_poll(realtime_t *rt, uint32_t *seen, int prio)
+{
+    if (!rt->enabled)
+        return;
+    uint32_t g = rt_load(&rt->generation);
+    if (g == *seen)
+        return;
+    *seen = g;
+    rt_count(&rt->threads);
+    rt_promote_self(rt, prio);
+    rt_pin_self(rt);
+}
+
+/* Lock everything mapped so far, faulting it in: the rings, the
+ * history (malloc'd lazily, so this is when its pages are first
+ * touched), the windows and the vertex buffers.  Only Linux has a
+ * usable mlockall(); elsewhere, or when RLIMIT_MEMLOCK refuses it,
+ * the caller locks its hot regions one by one with rt_lock_region(). */
+static inline bool rt_lock_all(realtime_t *rt)
+{
+#if !defined(__APPLE__) && !defined(_WIN32)
+    if (mlockall(MCL_CURRENT) == 0) {
+        rt->locked_all = true;
+        return true;
+    }
+    rt->lock_errno = errno;
+#else
+    (void)rt;
+#endif
+    return false;
+}
+
+static inline void rt_lock_region(realtime_t *rt, const void *p, size_t len)
+{
+    if (!p || !len)
+        return;
+    if (rt->n_regions == RT_MAX_REGIONS) {
+        rt->lock_errno = ENOMEM;
+        return;
+    }
+#ifdef _WIN32
+    /* VirtualLock is bounded by the working set: grow it to fit */
+    SIZE_T lo, hi;
+    HANDLE self = GetCurrentProcess();
+    if (GetProcessWorkingSetSize(self, &lo, &hi))
+        SetProcessWorkingSetSize(self, lo + len, hi + len);
+    if (!VirtualLock((LPVOID)p, len)) {
+        rt->lock_errno = (int)GetLastError();
+        return;
+    }
+#else
+    if (mlock(p, len) != 0) {
+        rt->lock_errno = errno;
+        return;
+    }
+#endif
+    rt->regions[rt->n_regions].p   = p;
+    rt->regions[rt->n_regions].len = len;
+    rt->n_regions++;
+    rt->locked_bytes += len;
+}
+
+/* Undo every rt_lock_region() before locking a new set.  A reconfiguration
+ * may have freed some of them since: unlocking a range that is no longer
+ * mapped just fails, and one the heap has handed out again was not
+ * locked by anyone else. */
+static inline void rt_unlock_regions(realtime_t *rt)
+{
+    for (unsigned int i = 0; i < rt->n_regions; i++) {
+        const rt_region_t *r = &rt->regions[i];
+#ifdef _WIN32
+        SIZE_T lo, hi;
+        HANDLE self = GetCurrentProcess();
+        VirtualUnlock((LPVOID)r->p, r->len);
+        if (GetProcessWorkingSetSize(self, &lo, &hi) && lo > r->len && hi > r->len)
+            SetProcessWorkingSetSize(self, lo - r->len, hi - r->len);
+#else
+        munlock(r->p, r->len);
+#endif
+    }
+    rt->n_regions = 0;
+    rt->locked_bytes = 0;
+}
+
+#endif /* XYSCOPE_REALTIME_H */
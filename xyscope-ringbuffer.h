@@ -3,6 +3,9 @@
 
 #include <stdlib.h>
 #include <string.h>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
 
 /* Memory barrier helpers for SPSC correctness on ARM (Apple Silicon).
  * On x86 these compile to plain loads/stores. */
@@ -25,120 +28,182 @@
     ((_ReadWriteBarrier()), *(ptr))
 #endif
 
+/* Destructive-interference distance.  Apple Silicon pairs 128-byte
+ * lines for coherence, everything else we run on uses 64. */
+#if defined(__APPLE__) && defined(__aarch64__)
+#define RB_CACHE_LINE 128
+#else
+#define RB_CACHE_LINE 64
+#endif
+
+/* Each side's index lives on its own cache line, so a store to one
+ * doesn't invalidate the line the other side keeps polling.
+ *
+ * The reader also keeps a copy of write_ptr next to its own index and
+ * only goes to the writer's line when that copy shows too little data,
+ * as in Rigtorp's and Vyukov's SPSC queues.  The writer only moves
+ * forward, so a stale copy can only under-report.  The writer gets no
+ * such copy: the reader seeks backwards (ringbuffer_read_advance()), and
+ * a stale read_ptr would let the writer overrun what it is about to
+ * re-read, so every write space check loads the real one. */
 typedef struct {
-    char   *buf;
+    /* Read-only after ringbuffer_create() */
+    alignas(RB_CACHE_LINE) char *buf;
     size_t  size;
-    size_t  write_ptr;
-    size_t  read_ptr;
+
+    /* Writer-owned */
+    alignas(RB_CACHE_LINE) size_t write_ptr;
+
+    /* Reader-owned */
+    alignas(RB_CACHE_LINE) size_t read_ptr;
+    size_t  write_cache;     /* reader's last view of write_ptr */
 } ringbuffer_t;
 
+/* One contiguous region of ring storage, as handed out by
+ * ringbuffer_write_reserve(). */
+typedef struct {
+    char   *buf;
+    size_t  len;
+} ringbuffer_data_t;
+
+/* The struct is over-aligned, so it can't come from plain malloc() */
+static inline void *rb_aligned_alloc(size_t size) {
+#ifdef _WIN32
+    return _aligned_malloc(size, RB_CACHE_LINE);
+#else
+    void *p = NULL;
+    if (posix_memalign(&p, RB_CACHE_LINE, size) != 0) return NULL;
+    return p;
+#endif
+}
+
+static inline void rb_aligned_free(void *p) {
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
 static inline ringbuffer_t *ringbuffer_create(size_t size) {
-    ringbuffer_t *rb = (ringbuffer_t *)malloc(sizeof(ringbuffer_t));
+    ringbuffer_t *rb = (ringbuffer_t *)rb_aligned_alloc(sizeof(ringbuffer_t));
     size_t power_of_two = 1;
     while (power_of_two < size) power_of_two <<= 1;
+    memset(rb, 0, sizeof(*rb));
     rb->size = power_of_two;
     rb->buf = (char *)malloc(rb->size);
-    rb->write_ptr = 0;
-    rb->read_ptr = 0;
     return rb;
 }
 
 static inline void ringbuffer_free(ringbuffer_t *rb) {
     if (rb) {
         free(rb->buf);
-        free(rb);
+        rb_aligned_free(rb);
     }
 }
 
-static inline size_t ringbuffer_write_space(ringbuffer_t *rb) {
-    size_t w = rb->write_ptr;
-    size_t r = rb_load_acquire(&rb->read_ptr);
-    if (w > r) {
-        return ((r - w + rb->size) & (rb->size - 1)) - 1;
-    } else if (w < r) {
-        return (r - w) - 1;
-    } else {
-        return rb->size - 1;
-    }
+/* Free space given a read index; one slot is kept empty so a full ring
+ * can be told from an empty one. */
+static inline size_t rb_space_from(const ringbuffer_t *rb, size_t w, size_t r) {
+    return (r - w - 1) & (rb->size - 1);
+}
+
+static inline size_t ringbuffer_write_space(const ringbuffer_t *rb) {
+    return rb_space_from(rb, rb->write_ptr, rb_load_acquire(&rb->read_ptr));
 }
 
+/* Exact fill level: always reloads write_ptr (and refreshes the cache) */
 static inline size_t ringbuffer_read_space(ringbuffer_t *rb) {
-    size_t w = rb_load_acquire(&rb->write_ptr);
-    size_t r = rb->read_ptr;
-    if (w > r) {
-        return w - r;
-    } else {
-        return (w - r + rb->size) & (rb->size - 1);
-    }
+    rb->write_cache = rb_load_acquire(&rb->write_ptr);
+    return (rb->write_cache - rb->read_ptr) & (rb->size - 1);
+}
+
+/* Fill level for a cnt-byte read, trusting the cached write index
+ * first and only going to the writer's cache line when it falls short */
+static inline size_t rb_read_avail(ringbuffer_t *rb, size_t cnt) {
+    size_t avail = (rb->write_cache - rb->read_ptr) & (rb->size - 1);
+    if (avail < cnt)
+        avail = ringbuffer_read_space(rb);
+    return avail;
 }
 
 static inline size_t ringbuffer_write(ringbuffer_t *rb, const char *src, size_t cnt) {
-    size_t free_cnt;
-    size_t cnt2;
-    size_t to_write;
-    size_t n1, n2;
+    size_t w = rb->write_ptr;
+    size_t free_cnt = ringbuffer_write_space(rb);
+    size_t to_write = cnt > free_cnt ? free_cnt : cnt;
+    size_t n1 = to_write;
 
-    free_cnt = ringbuffer_write_space(rb);
-    if (free_cnt == 0) return 0;
+    if (to_write == 0) return 0;
+    if (w + to_write > rb->size)
+        n1 = rb->size - w;
+    memcpy(rb->buf + w, src, n1);
+    if (to_write > n1)
+        memcpy(rb->buf, src + n1, to_write - n1);
 
-    to_write = cnt > free_cnt ? free_cnt : cnt;
-    cnt2 = rb->write_ptr + to_write;
+    /* Release barrier: ensure memcpy is visible before advancing write_ptr */
+    rb_store_release(&rb->write_ptr, (w + to_write) & (rb->size - 1));
+    return to_write;
+}
 
-    if (cnt2 > rb->size) {
-        n1 = rb->size - rb->write_ptr;
-        n2 = cnt2 & (rb->size - 1);
-    } else {
-        n1 = to_write;
-        n2 = 0;
-    }
+/* Zero-copy write: reserve up to cnt bytes of free space and describe
+ * it as one or two contiguous regions (vec[1] is only non-empty when
+ * the reservation wraps past the end of the buffer), in the spirit of
+ * jack_ringbuffer_get_write_vector().  The caller fills the regions in
+ * place and then publishes however much it wrote with a single
+ * ringbuffer_write_commit().  Returns the number of bytes reserved. */
+static inline size_t ringbuffer_write_reserve(ringbuffer_t *rb, size_t cnt,
+                                              ringbuffer_data_t vec[2]) {
+    size_t free_cnt = ringbuffer_write_space(rb);
+    size_t to_write = cnt > free_cnt ? free_cnt : cnt;
+    size_t w = rb->write_ptr;
 
-    memcpy(rb->buf + rb->write_ptr, src, n1);
-    if (n2) {
-        size_t wrap = (rb->write_ptr + n1) & (rb->size - 1);
-        memcpy(rb->buf + wrap, src + n1, n2);
+    if (w + to_write > rb->size) {
+        vec[0].buf = rb->buf + w;
+        vec[0].len = rb->size - w;
+        vec[1].buf = rb->buf;
+        vec[1].len = to_write - vec[0].len;
+    } else {
+        vec[0].buf = rb->buf + w;
+        vec[0].len = to_write;
+        vec[1].buf = NULL;
+        vec[1].len = 0;
     }
+    return to_write;
+}
 
-    /* Release barrier: ensure memcpy is visible before advancing write_ptr */
+/* Publish cnt bytes previously filled through ringbuffer_write_reserve() */
+static inline void ringbuffer_write_commit(ringbuffer_t *rb, size_t cnt) {
     rb_store_release(&rb->write_ptr,
-        (rb->write_ptr + to_write) & (rb->size - 1));
-
-    return to_write;
+        (rb->write_ptr + cnt) & (rb->size - 1));
 }
 
 static inline size_t ringbuffer_read(ringbuffer_t *rb, char *dest, size_t cnt) {
-    size_t free_cnt;
-    size_t cnt2;
-    size_t to_read;
-    size_t n1, n2;
-
-    free_cnt = ringbuffer_read_space(rb);
-    if (free_cnt == 0) return 0;
-
-    to_read = cnt > free_cnt ? free_cnt : cnt;
-    cnt2 = rb->read_ptr + to_read;
-
-    if (cnt2 > rb->size) {
-        n1 = rb->size - rb->read_ptr;
-        n2 = cnt2 & (rb->size - 1);
-    } else {
-        n1 = to_read;
-        n2 = 0;
-    }
+    size_t r = rb->read_ptr;
+    size_t avail = rb_read_avail(rb, cnt);
+    size_t to_read = cnt > avail ? avail : cnt;
+    size_t n1 = to_read;
 
-    memcpy(dest, rb->buf + rb->read_ptr, n1);
-    if (n2) {
-        size_t wrap = (rb->read_ptr + n1) & (rb->size - 1);
-        memcpy(dest + n1, rb->buf + wrap, n2);
-    }
+    if (to_read == 0) return 0;
+    if (r + to_read > rb->size)
+        n1 = rb->size - r;
+    memcpy(dest, rb->buf + r, n1);
+    if (to_read > n1)
+        memcpy(dest + n1, rb->buf, to_read - n1);
 
     /* Release barrier: ensure memcpy is done before advancing read_ptr */
-    rb_store_release(&rb->read_ptr,
-        (rb->read_ptr + to_read) & (rb->size - 1));
-
+    rb_store_release(&rb->read_ptr, (r + to_read) & (rb->size - 1));
     return to_read;
 }
 
+/* Move the read index by cnt bytes, modulo the ring size.  drawPlot()
+ * passes a "negative" cnt to re-read the tail of the previous window
+ * when less than a full window has arrived, so this is a seek rather
+ * than a consume.  The writer sees the new read_ptr on its next space
+ * check and is bounded by it from then on; the reader's cached write
+ * index is refreshed so it stays valid from the new position.  (Paused rewinding no longer
+ * seeks the ring at all; it decodes from xyscope-history.h.) */
 static inline void ringbuffer_read_advance(ringbuffer_t *rb, size_t cnt) {
+    rb->write_cache = rb_load_acquire(&rb->write_ptr);
     rb_store_release(&rb->read_ptr,
         (rb->read_ptr + cnt) & (rb->size - 1));
 }
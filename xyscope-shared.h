@@ -74,6 +74,7 @@ static inline int clock_gettime(int clk_id, struct timespec *ts) {
 #else
 /* ---- POSIX ---- */
 #include <sys/time.h>
+#include <time.h>
 #endif /* _WIN32 */
 
 
@@ -158,6 +159,13 @@ typedef struct _presets_t {
 
 typedef struct _app_config_t {
     char target[256];
+    char pw_profile[32];       /* Pipewire stream profile name, "" = default */
+    unsigned int pw_quantum;   /* override at 48 kHz, 0 = the profile's */
+    unsigned int pw_rate;      /* forced graph rate, 0 = the profile's */
+    char profile[32];          /* buffering profile name, "" = default */
+    double history_seconds;    /* rewind history, 0 = the profile's */
+    unsigned int draw_each;    /* draws per frame, 0 = the profile's */
+    unsigned int frame_limit;  /* 0 = the profile's, 1 = on, 2 = off */
 } app_config_t;
 
 
@@ -168,6 +176,25 @@ static inline double timeDiff(struct timeval a, struct timeval b) {
             ((double)(b.tv_usec - a.tv_usec) * .000001));
 }
 
+/* Monotonic nanoseconds, for intervals measured across threads (the
+ * wall clock behind gettimeofday() can step) */
+static inline unsigned long long monotonic_ns(void) {
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+    if (freq.QuadPart == 0)
+        QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (unsigned long long)(now.QuadPart / freq.QuadPart) * 1000000000ULL +
+           (unsigned long long)(now.QuadPart % freq.QuadPart) * 1000000000ULL /
+           (unsigned long long)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+#endif
+}
+
 static inline void wrapValue(double *val, double max) {
     if (*val > max) *val -= max * 2;
     if (*val <= -max) *val += max * 2;
@@ -326,6 +353,13 @@ static inline bool save_config(const preferences_t *prefs,
     write_prefs_section(fp, "settings", prefs);
     if (app && app->target[0])
         fprintf(fp, "target=%s\n\n", app->target);
+    if (app && (app->pw_profile[0] || app->pw_quantum || app->pw_rate))
+        fprintf(fp, "pw_profile=%s\npw_quantum=%u\npw_rate=%u\n\n",
+                app->pw_profile, app->pw_quantum, app->pw_rate);
+    if (app && (app->profile[0] || app->history_seconds > 0.0 || app->draw_each
+                || app->frame_limit))
+        fprintf(fp, "profile=%s\nhistory_seconds=%.17g\ndraw_each=%u\nframe_limit=%u\n\n",
+                app->profile, app->history_seconds, app->draw_each, app->frame_limit);
     for (int i = 0; i < NUM_PRESETS; i++) {
         if (presets->saved[i]) {
             char section[16];
@@ -432,6 +466,20 @@ static inline bool load_config(preferences_t *prefs, presets_t *presets,
 
         if (in_settings && app && !strcmp(key, "target"))
             snprintf(app->target, sizeof(app->target), "%s", val);
+        else if (in_settings && app && !strcmp(key, "pw_profile"))
+            snprintf(app->pw_profile, sizeof(app->pw_profile), "%s", val);
+        else if (in_settings && app && !strcmp(key, "pw_quantum"))
+            app->pw_quantum = (unsigned int)atoi(val);
+        else if (in_settings && app && !strcmp(key, "pw_rate"))
+            app->pw_rate = (unsigned int)atoi(val);
+        else if (in_settings && app && !strcmp(key, "profile"))
+            snprintf(app->profile, sizeof(app->profile), "%s", val);
+        else if (in_settings && app && !strcmp(key, "history_seconds"))
+            app->history_seconds = atof(val);
+        else if (in_settings && app && !strcmp(key, "draw_each"))
+            app->draw_each = (unsigned int)atoi(val);
+        else if (in_settings && app && !strcmp(key, "frame_limit"))
+            app->frame_limit = (unsigned int)atoi(val);
         else if (current_prefs)
             parse_prefs_key(current_prefs, key, val);
     }
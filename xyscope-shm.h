@@ -0,0 +1,470 @@
+/*
+ *  xyscope-shm.h
+ *  Shared-memory XY stream: the downmixed frames the scope draws, in a
+ *  broadcast ring any local process can map read-only (--shm-publish),
+ *  and the reader that lets a source be one of those rings (--shm-input).
+ *
+ *  Copyright (c) 2006-2007 by Chris Reaume <chris@flatlan.net>
+ *    All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+
+#ifndef XYSCOPE_SHM_H
+#define XYSCOPE_SHM_H
+
+#include <stdint.h>
+#include <errno.h>
+#include "xyscope-shared.h"
+#include "xyscope-broadcast.h"
+#include "xyscope-metrics.h"
+#include "xyscope-notify.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#if !defined(__APPLE__) && !defined(_WIN32)
+#include <limits.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+#define SHM_MAGIC   "XYSCOPE"
+#define SHM_VERSION 2
+#define SHM_POLL_NS 1000000ULL        /* wait step without a shared futex  */
+#define SHM_STALE_NS 2000000000ULL    /* no publish this long, writer gone */
+
+/* The mapping is this header, then `size` bytes of ring at data_offset.
+ * Everything is native-endian and the layout is fixed, so a consumer
+ * in any language can use it without this file.
+ *
+ * The ring follows the xyscope-broadcast.h protocol.  Positions are
+ * byte counts since the ring was created, and the data for position p
+ * is at data_offset + (p & (size - 1)).  Before writing, the writer
+ * stores claim (the end of what it is about to overwrite), then copies
+ * the frames, then stores head.  A reader copies what it wants from
+ * below head and then re-reads claim.  If claim - start > size, some of
+ * the copy was overwritten and the reader should skip ahead.  A reader
+ * that falls more than `size` behind head has been lapped.
+ *
+ * Frames are frame_t: float left, float right, at sample_rate, exactly
+ * as the scope draws them (after --display-rate decimation).  head_ns
+ * is the capture time of the frame just before head, on
+ * CLOCK_MONOTONIC (QPC on Windows), or 0 if it isn't known.  It is
+ * stored before head, so it is never older than the head a reader sees.
+ *
+ * After every publish the writer stores the low 32 bits of head in
+ * `wake` and, on Linux, does a shared FUTEX_WAKE on it.  A reader with
+ * nothing to read can FUTEX_WAIT (not _PRIVATE) on `wake` for the value
+ * it last saw.  That needs only read access, so the writer never has to
+ * know who is listening.  Elsewhere readers poll. */
+typedef struct {
+    /* Written once, before magic */
+    char magic[8];                    /* "XYSCOPE\0", set last             */
+    uint32_t version;                 /* SHM_VERSION                       */
+    uint32_t data_offset;             /* ring start, from the mapping's    */
+    uint64_t size;                    /* ring bytes, a power of two        */
+    uint32_t frame_size;              /* sizeof(frame_t)                   */
+    uint32_t channels;                /* 2: x (left), y (right)            */
+    uint32_t pid;                     /* the publishing process            */
+    uint32_t source;                  /* 1-based capture source            */
+
+    /* Writer-owned, updated after every publish */
+    alignas(64) uint64_t head;        /* bytes published                   */
+    uint64_t claim;                   /* head + bytes being written        */
+    uint64_t head_ns;                 /* capture time of frame head - 1    */
+    uint64_t update_ns;               /* when head last moved              */
+    uint32_t sample_rate;             /* of the frames; can change         */
+    uint32_t rate_changes;            /* bumped with every change          */
+
+    alignas(64) uint32_t wake;        /* (uint32_t)head, futex word        */
+} shm_header_t;
+
+/* Publisher side: one per source, fed by the acquisition thread from
+ * its own cursor on the source's ring, so the capture callback never
+ * touches the mapping and a slow consumer costs it nothing. */
+typedef struct {
+    shm_header_t *hdr;
+    char *buf;
+    size_t map_len;
+    char name[256];
+    bcast_reader_t src;               /* cursor on the source's ring       */
+#ifdef _WIN32
+    HANDLE mapping;
+#endif
+} shm_writer_t;
+
+/* Tell every reader the segment is finished: magic goes first, then a
+ * bump of `wake` gets anyone asleep on it up to notice.  Readers keep
+ * their mapping of an unlinked segment, so without this they would
+ * wait on it forever instead of reattaching to its successor. */
+static inline void shm_retire(shm_header_t *h)
+{
+    memset(h->magic, 0, sizeof(h->magic));
+    bcast_fence_release();
+    notify_store(&h->wake, h->wake + 1);
+#if !defined(__APPLE__) && !defined(_WIN32)
+    syscall(SYS_futex, &h->wake, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#endif
+}
+
+static inline void shm_writer_close(shm_writer_t *w)
+{
+    if (w->hdr)
+        shm_retire(w->hdr);
+#ifdef _WIN32
+    if (w->hdr)
+        UnmapViewOfFile(w->hdr);
+    if (w->mapping)
+        CloseHandle(w->mapping);
+#else
+    if (w->hdr) {
+        munmap(w->hdr, w->map_len);
+        shm_unlink(w->name);
+    }
+#endif
+    memset(w, 0, sizeof(*w));
+}
+
+#ifndef _WIN32
+/* A segment left under our name by a run that crashed: retire it for
+ * anyone still attached, then unlink it, so the new one is a separate
+ * object and never a resize of a mapping somebody is reading */
+static inline void shm_writer_takeover(const char *name)
+{
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0)
+        return;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(shm_header_t)) {
+        void *m = mmap(NULL, sizeof(shm_header_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (m != MAP_FAILED) {
+            shm_retire((shm_header_t *)m);
+            munmap(m, sizeof(shm_header_t));
+        }
+    }
+    close(fd);
+    shm_unlink(name);
+}
+#endif
+
+/* Create the named segment with a ring of at least `bytes`, retiring
+ * any segment a crashed run left under the name.  POSIX names start with a slash, which is added if missing;
+ * on Windows it is a Local\ section.  The name is unlinked again by
+ * shm_writer_close().  Errors are reported on stderr. */
+static inline bool shm_writer_open(shm_writer_t *w, const char *name, size_t bytes,
+                                   unsigned int source)
+{
+    memset(w, 0, sizeof(*w));
+    size_t size = 1;
+    while (size < bytes) size <<= 1;
+    size_t data_offset = (sizeof(shm_header_t) + 4095) & ~(size_t)4095;
+    w->map_len = data_offset + size;
+
+#ifdef _WIN32
+    snprintf(w->name, sizeof(w->name), "Local\\%s", name[0] == '/' ? name + 1 : name);
+    w->mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+                                    (DWORD)((unsigned long long)w->map_len >> 32),
+                                    (DWORD)(w->map_len & 0xffffffffu), w->name);
+    if (w->mapping)
+        w->hdr = (shm_header_t *)MapViewOfFile(w->mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+#else
+    snprintf(w->name, sizeof(w->name), "%s%s", name[0] == '/' ? "" : "/", name);
+    shm_writer_takeover(w->name);
+    int fd = shm_open(w->name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "%s: cannot create shared memory: %s\n", w->name, strerror(errno));
+        return false;
+    }
+    if (ftruncate(fd, (off_t)w->map_len) == 0) {
+        void *m = mmap(NULL, w->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (m != MAP_FAILED)
+            w->hdr = (shm_header_t *)m;
+    }
+    close(fd);
+#endif
+    if (!w->hdr) {
+        fprintf(stderr, "%s: cannot map %.1f MB of shared memory\n", w->name, w->map_len / 1e6);
+        shm_writer_close(w);
+        return false;
+    }
+
+    /* magic stays clear until the header is filled in (on Windows a
+     * section still open elsewhere is reused as it is) */
+    shm_header_t *h = w->hdr;
+    memset(h->magic, 0, sizeof(h->magic));
+    bcast_fence_release();
+    h->version     = SHM_VERSION;
+    h->data_offset = (uint32_t)data_offset;
+    h->size        = size;
+    h->frame_size  = sizeof(frame_t);
+    h->channels    = 2;
+#ifdef _WIN32
+    h->pid         = (uint32_t)GetCurrentProcessId();
+#else
+    h->pid         = (uint32_t)getpid();
+#endif
+    h->source      = source + 1;
+    h->head = h->claim = h->head_ns = h->update_ns = 0;
+    h->sample_rate = 0;
+    h->rate_changes = 0;
+    h->wake        = 0;
+    w->buf = (char *)h + data_offset;
+    bcast_fence_release();
+    memcpy(h->magic, SHM_MAGIC, sizeof(SHM_MAGIC));
+    return true;
+}
+
+static inline void shm_set_rate(shm_header_t *h, int sample_rate)
+{
+    if ((uint32_t)sample_rate != h->sample_rate) {
+        h->sample_rate = (uint32_t)sample_rate;
+        h->rate_changes++;
+        bcast_fence_release();
+    }
+}
+
+/* Tell readers head has moved */
+static inline void shm_wake(shm_header_t *h)
+{
+    bcast_store(&h->update_ns, monotonic_ns());
+    notify_store(&h->wake, (uint32_t)h->head);
+#if !defined(__APPLE__) && !defined(_WIN32)
+    syscall(SYS_futex, &h->wake, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#endif
+}
+
+/* Acquisition thread: copy everything new on the source's ring into the
+ * segment, straight from one ring's storage to the other's, and stamp
+ * the new head from the source's block tags. */
+static inline void shm_publish(shm_writer_t *w, const bcast_ring_t *ring,
+                               int sample_rate, const tag_log_t *tags)
+{
+    shm_header_t *h = w->hdr;
+    if (w->src.ring != ring)
+        bcast_reader_init(&w->src, ring);
+    shm_set_rate(h, sample_rate);
+
+    size_t avail = bcast_read_space(&w->src);
+    bool moved = false;
+    while (avail) {
+        /* whole frames, at most half the segment per pass */
+        size_t n = avail < h->size / 2 ? avail : (size_t)(h->size / 2);
+        n -= n % sizeof(frame_t);
+        if (n == 0)
+            break;
+
+        size_t off = (size_t)(h->head & (h->size - 1));
+        size_t n0  = off + n > h->size ? (size_t)(h->size - off) : n;
+        bcast_store(&h->claim, h->head + n);
+        bcast_fence_release();        /* claim lands before the data */
+
+        size_t got = bcast_read(&w->src, w->buf + off, n0);
+        if (got == n0 && n0 < n)
+            got += bcast_read(&w->src, w->buf, n - n0);
+        if (got == 0) {
+            avail = bcast_read_space(&w->src);
+            continue;                 /* torn source read; it skipped ahead */
+        }
+        unsigned long long ns = 0;
+        unsigned long long f  = w->src.pos / sizeof(frame_t);
+        if (f && tags)
+            tag_log_time(tags, f - 1, sample_rate, &ns);
+        bcast_store(&h->head_ns, ns);
+        rb_store_release(&h->head, h->head + got);
+        moved = true;
+        avail -= got < avail ? got : avail;
+    }
+    if (moved)
+        shm_wake(h);
+}
+
+
+/* ---- Reader (--shm-input) ---- */
+
+typedef struct {
+    const shm_header_t *hdr;
+    const char *buf;
+    size_t map_len;
+    uint64_t size;
+    uint64_t pos;                     /* next byte to read                 */
+    uint32_t seen;                    /* wake value of the last wait       */
+    unsigned long long overruns;      /* times the writer lapped us        */
+    unsigned long long lost;          /* bytes overwritten before reading  */
+#ifdef _WIN32
+    HANDLE mapping;
+#endif
+} shm_reader_t;
+
+static inline void shm_reader_close(shm_reader_t *r)
+{
+#ifdef _WIN32
+    if (r->hdr)
+        UnmapViewOfFile(r->hdr);
+    if (r->mapping)
+        CloseHandle(r->mapping);
+#else
+    if (r->hdr)
+        munmap((void *)r->hdr, r->map_len);
+#endif
+    memset(r, 0, sizeof(*r));
+}
+
+/* A segment's header is valid once magic is set; cleared again when
+ * its writer closes or a new writer replaces it */
+static inline bool shm_reader_valid(const shm_reader_t *r)
+{
+    return r->hdr && !memcmp((const char *)r->hdr->magic, SHM_MAGIC, sizeof(SHM_MAGIC));
+}
+
+static inline bool shm_pid_gone(uint32_t pid)
+{
+#ifdef _WIN32
+    HANDLE p = OpenProcess(SYNCHRONIZE, FALSE, (DWORD)pid);
+    if (!p)
+        return GetLastError() == ERROR_INVALID_PARAMETER;
+    bool gone = WaitForSingleObject(p, 0) == WAIT_OBJECT_0;
+    CloseHandle(p);
+    return gone;
+#else
+    return kill((pid_t)pid, 0) != 0 && errno == ESRCH;
+#endif
+}
+
+/* A writer that died without shm_writer_close() leaves magic set.  Its
+ * segment is stale once the pid is gone and nothing has been published
+ * for SHM_STALE_NS; both, because a writer in another pid namespace
+ * looks gone while it is still publishing, and a live one can go quiet
+ * while paused. */
+static inline bool shm_reader_stale(const shm_reader_t *r)
+{
+    uint64_t updated = bcast_load(&r->hdr->update_ns);
+    unsigned long long now = monotonic_ns();
+    return now - updated > SHM_STALE_NS && shm_pid_gone(r->hdr->pid);
+}
+
+/* Map the named segment read-only and attach at its head.  Quietly
+ * returns false if it doesn't exist (yet), isn't an xyscope ring, or
+ * was left behind by a writer that died. */
+static inline bool shm_reader_open(shm_reader_t *r, const char *name)
+{
+    char path[256];
+    memset(r, 0, sizeof(*r));
+#ifdef _WIN32
+    snprintf(path, sizeof(path), "Local\\%s", name[0] == '/' ? name + 1 : name);
+    r->mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, path);
+    if (r->mapping) {
+        r->hdr = (const shm_header_t *)MapViewOfFile(r->mapping, FILE_MAP_READ, 0, 0, 0);
+        MEMORY_BASIC_INFORMATION mi;
+        if (r->hdr && VirtualQuery(r->hdr, &mi, sizeof(mi)))
+            r->map_len = mi.RegionSize;
+    }
+#else
+    snprintf(path, sizeof(path), "%s%s", name[0] == '/' ? "" : "/", name);
+    int fd = shm_open(path, O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(shm_header_t)) {
+        void *m = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (m != MAP_FAILED) {
+            r->hdr     = (const shm_header_t *)m;
+            r->map_len = (size_t)st.st_size;
+        }
+    }
+    close(fd);
+#endif
+    const shm_header_t *h = r->hdr;
+    if (!shm_reader_valid(r) || shm_reader_stale(r) || h->version != SHM_VERSION
+        || h->frame_size != sizeof(frame_t) || h->size == 0 || (h->size & (h->size - 1))
+        || h->data_offset + h->size > r->map_len) {
+        shm_reader_close(r);
+        return false;
+    }
+    bcast_fence_acquire();
+    r->size = h->size;
+    r->buf  = (const char *)h + h->data_offset;
+    r->pos  = rb_load_acquire(&h->head);
+    r->seen = (uint32_t)r->pos;
+    return true;
+}
+
+/* Move the cursor back to the oldest data still safe to read: most of
+ * the ring, leaving an eighth of it as slack for the writer */
+static inline void shm_reader_rewind(shm_reader_t *r)
+{
+    uint64_t head = rb_load_acquire(&r->hdr->head);
+    uint64_t keep = r->size - r->size / 8;
+    keep -= keep % sizeof(frame_t);
+    r->pos = head > keep ? head - keep : 0;
+}
+
+/* Bytes readable from the cursor, skipping ahead (and counting an
+ * overrun) if the writer has lapped it */
+static inline size_t shm_read_space(shm_reader_t *r)
+{
+    uint64_t head = rb_load_acquire(&r->hdr->head);
+    if (head - r->pos > r->size) {
+        uint64_t to = head - r->size / 2;
+        r->overruns++;
+        r->lost += to - r->pos;
+        r->pos = to;
+    }
+    return (size_t)(head - r->pos);
+}
+
+/* Copy up to cnt bytes from the cursor, as bcast_read(): 0 and an
+ * overrun if any of them were overwritten while being copied */
+static inline size_t shm_read(shm_reader_t *r, char *dest, size_t cnt)
+{
+    size_t avail = shm_read_space(r);
+    size_t n = cnt > avail ? avail : cnt;
+    if (n == 0)
+        return 0;
+
+    size_t p  = (size_t)(r->pos & (r->size - 1));
+    size_t n1 = p + n > r->size ? (size_t)(r->size - p) : n;
+    memcpy(dest, r->buf + p, n1);
+    if (n1 < n)
+        memcpy(dest + n1, r->buf, n - n1);
+
+    bcast_fence_acquire();
+    uint64_t claim = bcast_load(&r->hdr->claim);
+    if (claim - r->pos > r->size) {
+        uint64_t to = claim - r->size / 2;
+        r->overruns++;
+        r->lost += to - r->pos;
+        r->pos = to;
+        return 0;
+    }
+    r->pos += n;
+    return n;
+}
+
+/* Sleep until the writer publishes again, or timeout_ns passes */
+static inline void shm_wait(shm_reader_t *r, unsigned long long timeout_ns)
+{
+    uint32_t wake = notify_load((uint32_t *)&r->hdr->wake);
+    if (wake != r->seen) {
+        r->seen = wake;
+        return;
+    }
+#if !defined(__APPLE__) && !defined(_WIN32)
+    struct timespec ts;
+    ts.tv_sec  = (time_t)(timeout_ns / 1000000000ULL);
+    ts.tv_nsec = (long)(timeout_ns % 1000000000ULL);
+    syscall(SYS_futex, &r->hdr->wake, FUTEX_WAIT, r->seen, &ts, NULL, 0);
+#else
+    usleep((useconds_t)((timeout_ns < SHM_POLL_NS ? timeout_ns : SHM_POLL_NS) / 1000));
+#endif
+    r->seen = notify_load((uint32_t *)&r->hdr->wake);
+}
+
+#endif /* XYSCOPE_SHM_H */
@@ -0,0 +1,289 @@
+/*
+ *  xyscope-spool.h
+ *  Disk-backed extension of the rewind history (--spool): a memory-
+ *  mapped segment file filled by a background writer thread.
+ *
+ *  Copyright (c) 2006-2007 by Chris Reaume <chris@flatlan.net>
+ *    All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+
+#ifndef XYSCOPE_SPOOL_H
+#define XYSCOPE_SPOOL_H
+
+#include <stdint.h>
+#include "xyscope-shared.h"
+#include "xyscope-ringbuffer.h"
+#include "xyscope-broadcast.h"
+#include "xyscope-notify.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#endif
+
+#define SPOOL_PAGE      4096
+#define SPOOL_MIN_BATCH (1 << 20)     /* smallest write, bytes             */
+
+/* The file is a ring of fixed-size blocks (whatever the history stores,
+ * opaque here), grouped into batches whose byte size is a whole number
+ * of pages.  The writer only ever copies a complete batch into the
+ * mapping, one page-aligned span of a megabyte or more, so dirty pages
+ * go back to disk in large sequential runs.  The file never grows past
+ * n_batches, and index[] records which batch each slot holds: finding
+ * block n is a division and one table lookup.
+ *
+ * The render thread hands blocks over through an SPSC ring and never
+ * waits; if the disk falls far enough behind to fill it, blocks are
+ * dropped and the batch they belonged to is skipped. */
+typedef struct {
+    unsigned char *map;
+    size_t map_len;
+    size_t block_bytes;
+    size_t batch_blocks;              /* blocks per batch                  */
+    size_t batch_bytes;
+    size_t n_batches;                 /* slots in the file                 */
+    size_t *index;                    /* batch + 1 held per slot, 0 empty  */
+    volatile size_t newest;           /* batch + 1 most recently written   */
+
+    /* render thread -> writer */
+    ringbuffer_t *staging;            /* records: block number, block data */
+    unsigned char *record;            /* one record of scratch             */
+    unsigned long long dropped;
+    notify_t ready;
+
+    /* writer thread */
+    pthread_t thread;
+    volatile bool quit;
+    unsigned char *batch;             /* batch being assembled             */
+
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+} spool_t;
+
+static inline size_t spool_record_bytes(const spool_t *s)
+{
+    return sizeof(unsigned long long) + s->block_bytes;
+}
+
+/* Copy one complete batch into its slot.  The slot is marked empty
+ * while it is being overwritten. */
+static inline void spool_flush(spool_t *s, size_t batch)
+{
+    size_t slot = batch % s->n_batches;
+    unsigned char *dst = s->map + slot * s->batch_bytes;
+
+    rb_store_release(&s->index[slot], (size_t)0);
+    bcast_fence_release();            /* empty before any of the new data */
+    memcpy(dst, s->batch, s->batch_bytes);
+#ifdef _WIN32
+    FlushViewOfFile(dst, s->batch_bytes);
+#else
+    msync(dst, s->batch_bytes, MS_ASYNC);
+#endif
+    rb_store_release(&s->index[slot], batch + 1);
+    rb_store_release(&s->newest, batch + 1);
+}
+
+static inline void *spool_writer(void *arg)
+{
+    spool_t *s = (spool_t *)arg;
+    const size_t rec = spool_record_bytes(s);
+    unsigned char *buf = (unsigned char *)malloc(rec);
+    size_t batch = (size_t)-1, fill = 0;
+    bool whole = false;
+
+    while (!s->quit) {
+        notify_wait(&s->ready, 250000000ULL);
+        while (buf && ringbuffer_read_space(s->staging) >= rec) {
+            unsigned long long no;
+            ringbuffer_read(s->staging, (char *)buf, rec);
+            memcpy(&no, buf, sizeof(no));
+
+            size_t b   = (size_t)(no / s->batch_blocks);
+            size_t pos = (size_t)(no % s->batch_blocks);
+            if (b != batch) {
+                batch = b;
+                fill  = 0;
+                whole = true;
+            }
+            if (pos != fill)
+                whole = false;        /* a block was dropped */
+            memcpy(s->batch + pos * s->block_bytes, buf + sizeof(no), s->block_bytes);
+            fill = pos + 1;
+            if (fill == s->batch_blocks) {
+                if (whole)
+                    spool_flush(s, batch);
+                batch = (size_t)-1;
+            }
+        }
+    }
+    free(buf);
+    return NULL;
+}
+
+static inline void spool_close(spool_t *s)
+{
+    if (s->staging) {
+        s->quit = true;
+        notify_post(&s->ready, 0xffffffffu, monotonic_ns());
+        pthread_join(s->thread, NULL);
+        notify_destroy(&s->ready);
+        ringbuffer_free(s->staging);
+    }
+#ifdef _WIN32
+    if (s->map)
+        UnmapViewOfFile(s->map);
+    if (s->mapping)
+        CloseHandle(s->mapping);
+    if (s->file && s->file != INVALID_HANDLE_VALUE)
+        CloseHandle(s->file);
+#else
+    if (s->map)
+        munmap(s->map, s->map_len);
+#endif
+    free(s->index);
+    free(s->record);
+    free(s->batch);
+    memset(s, 0, sizeof(*s));
+}
+
+/* Create the segment file at path, sized for at least `blocks` blocks
+ * of block_bytes each, and start the writer.  The file is unlinked (or
+ * delete-on-close) as soon as it is mapped, so it never outlives the
+ * process.  Errors are reported on stderr. */
+static inline bool spool_open(spool_t *s, const char *path, size_t blocks,
+                              size_t block_bytes)
+{
+    memset(s, 0, sizeof(*s));
+    s->block_bytes  = block_bytes;
+
+    /* smallest block count whose bytes are page-aligned, then doubled
+     * up to the minimum write size */
+    size_t g = block_bytes, p = SPOOL_PAGE;
+    while (p) { size_t t = g % p; g = p; p = t; }
+    s->batch_blocks = SPOOL_PAGE / g;
+    while (s->batch_blocks * block_bytes < SPOOL_MIN_BATCH)
+        s->batch_blocks *= 2;
+    s->batch_bytes  = s->batch_blocks * block_bytes;
+
+    /* one extra slot: the oldest batch is never read (see spool_block) */
+    s->n_batches = (blocks + s->batch_blocks - 1) / s->batch_blocks + 1;
+    if (s->n_batches < 3)
+        s->n_batches = 3;
+    s->map_len = s->n_batches * s->batch_bytes;
+
+#ifdef _WIN32
+    s->file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                          FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+    if (s->file == INVALID_HANDLE_VALUE) {
+        fprintf(stderr, "%s: cannot create spool file\n", path);
+        spool_close(s);
+        return false;
+    }
+    s->mapping = CreateFileMappingA(s->file, NULL, PAGE_READWRITE,
+                                    (DWORD)((unsigned long long)s->map_len >> 32),
+                                    (DWORD)(s->map_len & 0xffffffffu), NULL);
+    if (s->mapping)
+        s->map = (unsigned char *)MapViewOfFile(s->mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+#else
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        fprintf(stderr, "%s: cannot create spool file\n", path);
+        spool_close(s);
+        return false;
+    }
+    unlink(path);
+    if (ftruncate(fd, (off_t)s->map_len) == 0) {
+        void *m = mmap(NULL, s->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (m != MAP_FAILED)
+            s->map = (unsigned char *)m;
+    }
+    close(fd);
+#endif
+    if (!s->map) {
+        fprintf(stderr, "%s: cannot map %.0f MB spool file\n", path, s->map_len / 1e6);
+        spool_close(s);
+        return false;
+    }
+
+    s->index   = (size_t *)calloc(s->n_batches, sizeof(size_t));
+    s->record  = (unsigned char *)malloc(spool_record_bytes(s));
+    s->batch   = (unsigned char *)malloc(s->batch_bytes);
+    s->staging = ringbuffer_create(2 * s->batch_blocks * spool_record_bytes(s));
+    if (!s->index || !s->record || !s->batch || !s->staging || !s->staging->buf) {
+        fprintf(stderr, "%s: out of memory for spool\n", path);
+        spool_close(s);
+        return false;
+    }
+    notify_init(&s->ready);
+    pthread_create(&s->thread, NULL, spool_writer, (void *)s);
+    return true;
+}
+
+/* Render thread: queue block number `no`.  Never blocks. */
+static inline void spool_push(spool_t *s, unsigned long long no, const void *block)
+{
+    const size_t rec = spool_record_bytes(s);
+
+    if (ringbuffer_write_space(s->staging) < rec) {
+        s->dropped++;
+        return;
+    }
+    memcpy(s->record, &no, sizeof(no));
+    memcpy(s->record + sizeof(no), block, s->block_bytes);
+    ringbuffer_write(s->staging, (const char *)s->record, rec);
+
+    /* the writer only has work once a batch is complete */
+    if ((no + 1) % s->batch_blocks == 0)
+        notify_post(&s->ready, (uint32_t)no, monotonic_ns());
+}
+
+/* Oldest block number spool_block() can return */
+static inline unsigned long long spool_begin(const spool_t *s)
+{
+    size_t newest = rb_load_acquire(&s->newest);
+    if (newest == 0)
+        return (unsigned long long)-1;
+    size_t first = newest + 1 > s->n_batches ? newest + 1 - s->n_batches : 0;
+    return (unsigned long long)first * s->batch_blocks;
+}
+
+/* Block `no`, or NULL if it isn't on disk.  The oldest batch in the
+ * file is treated as gone, which keeps readers off the slot the writer
+ * fills next, but a reader that stalls can still be overtaken: copy the
+ * block out with spool_copy_block() rather than decoding in place. */
+static inline const void *spool_block(const spool_t *s, unsigned long long no)
+{
+    if (!s->map || no < spool_begin(s))
+        return NULL;
+    size_t batch = (size_t)(no / s->batch_blocks);
+    size_t slot  = batch % s->n_batches;
+    if (rb_load_acquire(&s->index[slot]) != batch + 1)
+        return NULL;
+    return s->map + slot * s->batch_bytes + (no % s->batch_blocks) * s->block_bytes;
+}
+
+/* Copy block `no` into dst.  The slot's index is checked again after
+ * the copy, as with a seqlock, so a flush that started meanwhile turns
+ * the copy into a miss.  Returns false on a miss. */
+static inline bool spool_copy_block(const spool_t *s, unsigned long long no, void *dst)
+{
+    const void *src = spool_block(s, no);
+    if (!src)
+        return false;
+    memcpy(dst, src, s->block_bytes);
+    bcast_fence_acquire();            /* the copy happens before the check */
+    size_t batch = (size_t)(no / s->batch_blocks);
+    return rb_load_acquire(&s->index[batch % s->n_batches]) == batch + 1;
+}
+
+#endif /* XYSCOPE_SPOOL_H */
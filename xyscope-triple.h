@@ -0,0 +1,101 @@
+/*
+ *  xyscope-triple.h
+ *  Lock-free triple buffer: a producer hands the newest of a stream of
+ *  complete objects to a consumer, without either side ever waiting.
+ *
+ *  Copyright (c) 2006-2007 by Chris Reaume <chris@flatlan.net>
+ *    All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+
+#ifndef XYSCOPE_TRIPLE_H
+#define XYSCOPE_TRIPLE_H
+
+#include <stdint.h>
+#include "xyscope-shared.h"
+#include "xyscope-ringbuffer.h"
+
+#if defined(__GNUC__) || defined(__clang__)
+#define triple_exchange(ptr, v) __atomic_exchange_n(ptr, v, __ATOMIC_ACQ_REL)
+#define triple_load(ptr)        __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#else
+#define triple_exchange(ptr, v) ((uint32_t)InterlockedExchange((volatile LONG *)(ptr), (LONG)(v)))
+#define triple_load(ptr)        ((uint32_t)InterlockedCompareExchange((volatile LONG *)(ptr), 0, 0))
+#endif
+
+#define TRIPLE_FRESH 4u               /* middle slot not yet taken         */
+
+/* Three slots: the producer fills `back`, the consumer holds `front`,
+ * and `middle` is the newest complete one.  Publishing swaps back with
+ * middle; taking swaps front with middle only when middle is fresh, so
+ * the consumer always gets the newest complete slot and neither side
+ * can ever touch the slot the other is using.
+ *
+ * Each side counts what the other missed: windows replaced in the
+ * middle before anyone took them (dropped), and takes that found
+ * nothing new and handed back the previous slot (repeated). */
+typedef struct {
+    void *slot[3];
+
+    /* Producer-owned */
+    alignas(RB_CACHE_LINE) unsigned int back;
+    unsigned long long published;
+    unsigned long long dropped;
+
+    /* Index of the middle slot, plus TRIPLE_FRESH */
+    alignas(RB_CACHE_LINE) uint32_t middle;
+
+    /* Consumer-owned */
+    alignas(RB_CACHE_LINE) unsigned int front;
+    unsigned long long taken;
+    unsigned long long repeated;
+} triple_t;
+
+/* The consumer starts out holding c, which should be a valid (empty)
+ * object, since a take before the first publish returns it */
+static inline void triple_init(triple_t *t, void *a, void *b, void *c)
+{
+    memset(t, 0, sizeof(*t));
+    t->slot[0] = a;
+    t->slot[1] = b;
+    t->slot[2] = c;
+    t->back    = 0;
+    t->middle  = 1;
+    t->front   = 2;
+}
+
+/* The slot the producer is free to fill */
+static inline void *triple_back(const triple_t *t)
+{
+    return t->slot[t->back];
+}
+
+/* Make the back slot the newest, and take whatever was in the middle
+ * as the next one to fill */
+static inline void triple_publish(triple_t *t)
+{
+    uint32_t old = triple_exchange(&t->middle, (uint32_t)t->back | TRIPLE_FRESH);
+    if (old & TRIPLE_FRESH)
+        t->dropped++;
+    t->back = old & (TRIPLE_FRESH - 1);
+    t->published++;
+}
+
+/* The newest published slot, owned by the consumer until its next take */
+static inline void *triple_take(triple_t *t)
+{
+    if (!(triple_load(&t->middle) & TRIPLE_FRESH)) {
+        t->repeated++;
+        return t->slot[t->front];
+    }
+    uint32_t old = triple_exchange(&t->middle, (uint32_t)t->front);
+    t->front = old & (TRIPLE_FRESH - 1);
+    t->taken++;
+    return t->slot[t->front];
+}
+
+#endif /* XYSCOPE_TRIPLE_H */
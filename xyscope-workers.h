@@ -0,0 +1,165 @@
+/*
+ *  xyscope-workers.h
+ *  Small fixed thread pool for running per-source DSP in parallel.
+ *
+ *  Copyright (c) 2006-2007 by Chris Reaume <chris@flatlan.net>
+ *    All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+
+#ifndef XYSCOPE_WORKERS_H
+#define XYSCOPE_WORKERS_H
+
+#include <stdint.h>
+#include "xyscope-shared.h"
+#include "xyscope-notify.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <pthread.h>
+#endif
+
+#define WORKERS_MAX 8
+
+#if defined(__GNUC__) || defined(__clang__)
+#define workers_fetch_add(ptr, v) __atomic_fetch_add(ptr, v, __ATOMIC_ACQ_REL)
+#define workers_store(ptr, v)     __atomic_store_n(ptr, v, __ATOMIC_RELEASE)
+#define workers_load(ptr)         __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#else
+#define workers_fetch_add(ptr, v) ((uint64_t)InterlockedExchangeAdd64((volatile LONG64 *)(ptr), (LONG64)(v)))
+#define workers_store(ptr, v)     InterlockedExchange64((volatile LONG64 *)(ptr), (LONG64)(v))
+#define workers_load(ptr)         ((uint64_t)InterlockedCompareExchange64((volatile LONG64 *)(ptr), 0, 0))
+#endif
+
+typedef void (*worker_fn_t)(void *ctx, unsigned int job);
+
+typedef struct worker_pool worker_pool_t;
+
+typedef struct {
+    worker_pool_t *pool;
+    pthread_t thread;
+    notify_t start;                   /* posted once per workers_run()     */
+} worker_t;
+
+/* workers_run() hands out jobs from one 64-bit ticket counter holding
+ * the job count in the high half and the next job in the low half, so a
+ * worker that wakes late and draws a ticket left over from the previous
+ * run sees that run's count and does nothing.  The caller runs jobs too
+ * and only sleeps if a worker still holds the last one. */
+struct worker_pool {
+    worker_t workers[WORKERS_MAX];
+    unsigned int n_workers;
+    worker_fn_t fn;
+    void *ctx;
+    uint64_t ticket;
+    uint64_t done;
+    uint32_t generation;
+    notify_t finished;                /* last job done by a worker         */
+    volatile bool quit;
+    void (*thread_hook)(uint32_t *seen);  /* run by each worker on waking,
+                                         with its own state (--realtime)   */
+};
+
+static inline unsigned int workers_cpu_count(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    return (unsigned int)si.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (unsigned int)n : 1;
+#endif
+}
+
+/* Take tickets until they run out.  Returns true if this thread
+ * finished the run's last job. */
+static inline bool workers_drain(worker_pool_t *p)
+{
+    bool last = false;
+    for (;;) {
+        uint64_t t = workers_fetch_add(&p->ticket, (uint64_t)1);
+        uint32_t n = (uint32_t)(t >> 32), job = (uint32_t)t;
+        if (job >= n)
+            return last;
+        p->fn(p->ctx, job);
+        last = workers_fetch_add(&p->done, (uint64_t)1) + 1 == n;
+    }
+}
+
+static inline void *workers_thread(void *arg)
+{
+    worker_t *w = (worker_t *)arg;
+    worker_pool_t *p = w->pool;
+    uint32_t seen = 0;
+
+    while (!p->quit) {
+        if (!notify_wait(&w->start, 250000000ULL) || p->quit)
+            continue;
+        if (p->thread_hook)
+            p->thread_hook(&seen);
+        if (workers_drain(p))
+            notify_post(&p->finished, p->generation, monotonic_ns());
+    }
+    return NULL;
+}
+
+/* Start up to n threads (capped at WORKERS_MAX and the core count less
+ * the caller's own) */
+static inline void workers_init(worker_pool_t *p, unsigned int n)
+{
+    unsigned int cpus = workers_cpu_count();
+
+    memset(p, 0, sizeof(*p));
+    if (n > WORKERS_MAX)
+        n = WORKERS_MAX;
+    if (cpus > 1 && n > cpus - 1)
+        n = cpus - 1;
+    notify_init(&p->finished);
+    for (unsigned int i = 0; i < n; i++) {
+        worker_t *w = &p->workers[i];
+        w->pool = p;
+        notify_init(&w->start);
+        pthread_create(&w->thread, NULL, workers_thread, (void *)w);
+    }
+    p->n_workers = n;
+}
+
+static inline void workers_destroy(worker_pool_t *p)
+{
+    p->quit = true;
+    for (unsigned int i = 0; i < p->n_workers; i++) {
+        notify_post(&p->workers[i].start, ++p->generation, monotonic_ns());
+        pthread_join(p->workers[i].thread, NULL);
+        notify_destroy(&p->workers[i].start);
+    }
+    notify_destroy(&p->finished);
+    p->n_workers = 0;
+}
+
+/* Call fn(ctx, job) for every job in [0, n) and return once all are done */
+static inline void workers_run(worker_pool_t *p, worker_fn_t fn, void *ctx,
+                               unsigned int n)
+{
+    if (n == 0)
+        return;
+    p->fn  = fn;
+    p->ctx = ctx;
+    workers_store(&p->done, (uint64_t)0);
+    p->generation++;
+    workers_store(&p->ticket, (uint64_t)n << 32);
+
+    unsigned int wake = n - 1 < p->n_workers ? n - 1 : p->n_workers;
+    for (unsigned int i = 0; i < wake; i++)
+        notify_post(&p->workers[i].start, p->generation, monotonic_ns());
+
+    workers_drain(p);
+    while (workers_load(&p->done) < n)
+        notify_wait(&p->finished, 1000000ULL);
+}
+
+#endif /* XYSCOPE_WORKERS_H */
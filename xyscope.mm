@@ -58,12 +58,20 @@
 #include <math.h>
 #include "xyscope-shared.h"
 #include "xyscope-ringbuffer.h"
+#include "xyscope-broadcast.h"
 #include "xyscope-draw.h"
 #include "xyscope-hdr.h"
 #include "xyscope-bloom.h"
 
 #include "xyscope-compat.h"
 #include "xyscope-audio.h"
+#include "xyscope-history.h"
+#include "xyscope-workers.h"
+#include "xyscope-metrics.h"
+#include "xyscope-triple.h"
+#include "xyscope-clock.h"
+#include "xyscope-shm.h"
+#include "xyscope-realtime.h"
 
 #ifdef _WIN32
 /* Forward declarations — defined after scene class */
@@ -73,43 +81,152 @@ extern HWND fs_cover_hwnd;
 extern bool wayland_hdr_active;
 #endif
 
-/* Audio sample rate and display frame rate — detected at runtime */
-int sample_rate = 96000;
-int frame_rate  = 120;
-
-/* ringbuffer size in seconds; expect memory usage to exceed:
- *
- * (sample_rate * BUFFER_SECONDS + sample_rate / frame_rate) * sizeof(frame_t)
+/* Audio sample rate and display frame rate — detected at runtime.
+ * sample_rate is what the ring carries: the primary source's
+ * capture_rate, divided down by the decimator when --display-rate asks
+ * for it (see xyscope-decimate.h).  Everything derived from it (buffer
+ * sizes, STFT window, band edges, delay) follows the decimated rate. */
+int sample_rate  = 96000;
+int capture_rate = 96000;
+int display_rate = 0;
+int frame_rate   = 120;
+
+/* rewind history in seconds (--history, --profile); kept as
+ * block-floating-point int16 (see xyscope-history.h), so expect memory
+ * usage to approach:
  *
- * That being said, the custom ringbuffer will round up to the next
- * power of two.
+ * (sample_rate * buffer_seconds + sample_rate / frame_rate) * 4 bytes
  */
-#define BUFFER_SECONDS 60.0
-
-/* How many times to draw each frame */
-#define DRAW_EACH_FRAME 2
+#define MIN_BUFFER_SECONDS 1.0
+#define MAX_BUFFER_SECONDS 3600.0
+double buffer_seconds = 60.0;
+
+/* live float32 broadcast ring in seconds, between the capture callback
+ * and its readers (each trace's windows and history); it is rounded up
+ * to the next power of two.  Display delays longer than half of it are
+ * drawn from the history. */
+#define LIVE_BUFFER_SECONDS 2.0
+
+/* How many times to draw each frame (--draw-each, --profile) */
+#define MAX_DRAW_EACH_FRAME 8
+int draw_each_frame = 2;
+
+/* whether to limit frame rate (--frame-limit, --profile) */
+bool limit_frame_rate = true;
+
+/* --profile: the three above together, for what the machine is for.
+ * Any of them given on its own (or saved in the config) wins over the
+ * profile's. */
+typedef struct {
+    const char *name;
+    double buffer_seconds;
+    int draw_each_frame;
+    bool limit_frame_rate;
+} buffer_profile_t;
+
+static const buffer_profile_t buffer_profiles[] = {
+    { "default",  60.0,  2, true },
+    { "kiosk",    10.0,  1, true },   /* about 4 MB of history at 96 kHz */
+    { "analysis", 600.0, 2, true },   /* ten minutes without a --spool   */
+};
+#define NUM_BUFFER_PROFILES (sizeof(buffer_profiles) / sizeof(buffer_profiles[0]))
 
-/* whether to limit frame rate */
-#define RESPONSIBLE_FOR_FRAME_RATE true
+/* Named profile, then the config's overrides on top.  Returns false
+ * for an unknown name, leaving the default profile. */
+static bool buffer_profile_resolve(const app_config_t *app, buffer_profile_t *out)
+{
+    bool found = false;
+    *out = buffer_profiles[0];
+    for (unsigned int i = 0; i < NUM_BUFFER_PROFILES; i++) {
+        if (!strcmp(app->profile, buffer_profiles[i].name)) {
+            *out = buffer_profiles[i];
+            found = true;
+        }
+    }
+    if (app->history_seconds > 0.0)
+        out->buffer_seconds = app->history_seconds;
+    if (app->draw_each)
+        out->draw_each_frame = (int)app->draw_each;
+    if (app->frame_limit)
+        out->limit_frame_rate = app->frame_limit == 1;
+    if (out->buffer_seconds < MIN_BUFFER_SECONDS) out->buffer_seconds = MIN_BUFFER_SECONDS;
+    if (out->buffer_seconds > MAX_BUFFER_SECONDS) out->buffer_seconds = MAX_BUFFER_SECONDS;
+    if (out->draw_each_frame < 1) out->draw_each_frame = 1;
+    if (out->draw_each_frame > MAX_DRAW_EACH_FRAME) out->draw_each_frame = MAX_DRAW_EACH_FRAME;
+    return found || !app->profile[0];
+}
 
 
 /* End of easily configurable settings */
 
 
-/* Derived from sample_rate, frame_rate, DRAW_EACH_FRAME, BUFFER_SECONDS */
+/* Derived from sample_rate, frame_rate, draw_each_frame, buffer_seconds */
 int frames_per_buf;
 int draw_frames;
+int window_frames;
 int default_rb_size;
+int live_rb_size;
+
+/* Capture sources (-t / --input / --shm-input, repeatable); sources[0] is the primary */
+source_t sources[MAX_SOURCES];
+unsigned int n_sources = 0;
+
+/* File input backend (--input), see audioInput::runFileInput() */
+bool input_fast = false;
+bool input_loop = false;
+
+/* Capture callbacks only copy interleaved quanta; the acquisition
+ * thread downmixes them (--raw-capture, see drain_raw()) */
+bool raw_capture = false;
+
+/* Sample format asked of Pipewire (--capture-format); float unless the
+ * device is known to be integer-native, see xyscope-convert.h */
+sample_format_t capture_format = SampleF32;
+
+/* Resolved from scn.app's pw_profile / pw_quantum / pw_rate before the
+ * streams are created, see xyscope-audio.h */
+pw_stream_profile_t pw_profile = { "default", 0, false, 0 };
+
+/* Once-a-second latency / wakeup summary as JSON lines (--metrics-file) */
+FILE *metrics_file = NULL;
+
+/* Frames the DSP stage runs ahead of drawing (--dsp-depth); 0 runs it
+ * inline in drawPlot, each step adds one frame of latency */
+#define DSP_MAX_DEPTH 3
+int dsp_depth = 0;
+
+/* Draw every captured frame (--lossless): a frame that falls behind
+ * grows its window, up to lossless_cap windows, rather than skipping
+ * ahead; see scene::catchUp() */
+#define LOSSLESS_MAX_CAP 64
+bool lossless = false;
+int lossless_cap = 8;
+
+/* Realtime scheduling, locked memory and CPU pinning (--realtime,
+ * --rt-priority, --cpus), see xyscope-realtime.h */
+realtime_t realtime = { false, RT_DEFAULT_PRIORITY };
+
+/* Disk-backed history beyond buffer_seconds (--spool), see xyscope-spool.h */
+const char *spool_path = NULL;
+double spool_minutes = 60.0;
+
+/* Shared-memory copy of each source's frames for other local tools
+ * (--shm-publish), see xyscope-shm.h */
+const char *shm_name = NULL;
 
 static void compute_derived_rates() {
-    frames_per_buf  = (sample_rate / frame_rate) * DRAW_EACH_FRAME;
+    frames_per_buf  = (sample_rate / frame_rate) * draw_each_frame;
     draw_frames     = frames_per_buf;
-    default_rb_size = (int)(sample_rate * BUFFER_SECONDS + frames_per_buf);
+    /* live windows carry 50 ms ahead of draw_frames, for the clock
+     * recovery to place each frame's window within (see xyscope-clock.h) */
+    window_frames   = draw_frames + sample_rate / 20;
+    default_rb_size = (int)(sample_rate * buffer_seconds + frames_per_buf);
+    live_rb_size    = (int)(sample_rate * LIVE_BUFFER_SECONDS + frames_per_buf);
 }
 
 
 
-thread_data_t Thread_Data;
+thread_data_t Thread_Data[MAX_SOURCES];
 
 #define LEFT_PORT  0
 #define RIGHT_PORT 1
@@ -144,27 +261,130 @@ static GLint  spline_loc_positions = -1;
 static GLint  spline_loc_colors = -1;
 static GLint  spline_loc_num_samples = -1;
 static GLint  spline_loc_spline_steps = -1;
+static GLint  spline_loc_base = -1;
+static GLint  spline_max_texels = 0;
 static GLuint spline_pos_tex[2] = {0, 0};
 static GLuint spline_col_tex[2] = {0, 0};
 static GLuint spline_index_vbo = 0;
 static unsigned int spline_index_alloc = 0;
 
+class scene;
+
+/* One ready-to-draw live window, built by a trace's acquisition thread
+ * and handed to drawPlot through the trace's triple buffer.  It is
+ * longer than a frame's worth: readTrace picks the draw_frames in it
+ * that the trace's clock recovery says this frame should show. */
+typedef struct {
+    frame_t *frames;             /* window_frames long */
+    size_t n_frames;             /* 0 until the source has data */
+    unsigned long long end;      /* ring frame just past frames[n_frames - 1] */
+    unsigned long long newest_ns;  /* capture time of the newest frame, 0 if unknown */
+} window_t;
+
+/* One source's share of a DSP frame */
+typedef struct {
+    frame_t *frames;             /* a copy: the window itself moves on
+                                    before a pipelined frame is drawn */
+    size_t frames_read;
+    unsigned long long newest_ns;  /* capture time of the newest frame, 0 if unknown */
+    double hue;
+    double dt;
+    double *spectrum_colors;
+    unsigned int base;           /* first sample in the shared spline textures */
+} trace_frame_t;
+
+/* Everything drawPlot needs from the samples for one frame, computed by
+ * the DSP stage from a snapshot of the settings taken when drawPlot
+ * queued it */
+typedef struct {
+    preferences_t prefs;
+    int offset;                  /* paused view position */
+    bool paused;
+    unsigned int window_size;    /* STFT window and overlap */
+    unsigned int overlap_size;
+    trace_frame_t trace[MAX_SOURCES];
+    double peak;                 /* largest |sample|, for autoScale() */
+    bool gpu;                    /* pos/col hold the spline textures */
+    float *pos;
+    float *col;
+    unsigned int total_samples;
+    unsigned int samp_alloc;
+} dsp_frame_t;
+
 class scene
 {
 public:
-    audioInput* ai;
+    audioInput* ai;          /* traces[0].ai, the primary source */
     size_t frame_size;
     size_t bytes_per_buf;
-    frame_t *framebuf;
-    int offset;
-    int bump;
+    int offset;              /* paused view: window end relative to pause_anchor, minus frames_per_buf */
+
+    /* One per capture source.  traces[0] is the primary: its stream
+     * paces drawPlot, and it drives the sample rate, latency stats and
+     * the paused timeline.
+     *
+     * While live, each trace's acquisition thread owns its cursors on
+     * the source's ring (one for windows, the history's own), the
+     * history and the tags, and publishes finished windows into
+     * `windows`; drawPlot only ever takes the newest one.  Pausing hands
+     * the history to the render thread (see togglePaused). */
+    typedef struct {
+        audioInput *ai;
+        scene *owner;
+        history_t history;
+        spool_t spool;           /* --spool: history older than buffer_seconds */
+        long long live_end;      /* history frame index just past the last live window */
+        long long pause_anchor;  /* live_end (or history end) when pause began */
+        tag_log_t tags;          /* newest capture-clock block tags */
+        bcast_reader_t reader;   /* live window cursor on the source's ring */
+        clock_dll_t clock;       /* samples per refresh, touched only by readTrace */
+        advance_stats_t advance; /* how far each live window moved, ditto */
+        bcast_reader_t catchup;  /* --lossless cursor on the source's ring, ditto */
+        shm_writer_t shm;        /* --shm-publish segment, fed by acquireWindow */
+
+        /* acquisition thread and its handoff to the renderer */
+        pthread_t acquire_thread;
+        bool acquiring;
+        volatile bool acquire_quit;
+        uint32_t acquire_busy;   /* set while it may touch the history */
+        window_t window[3];
+        triple_t windows;
+        notify_t window_ready;   /* posted after every publish */
+
+        /* FFT state for prepareTrace(), touched only by the DSP stage */
+#ifdef __APPLE__
+        FFTSetup fft;            /* cached for fft_n points */
+#else
+        fftw_plan fft;           /* in place on fft_buf, cached for fft_n points */
+        fftw_complex *fft_buf;
+#endif
+        unsigned int fft_n;
+    } trace_t;
+    trace_t traces[MAX_SOURCES];
+    unsigned int n_traces;
+    bool tile_traces;        /* --layout tile: one grid cell per source */
+    worker_pool_t dsp_workers;
+
+    /* DSP stage, see nextDspFrame().  drawPlot queues requests into
+     * dsp_frames round-robin and draws them in order; with --dsp-depth
+     * the DSP thread fills them, otherwise drawPlot does. */
+    dsp_frame_t dsp_frames[DSP_MAX_DEPTH + 1];
+    dsp_frame_t *dsp_current;    /* the frame prepareJob() works on */
+    unsigned int dsp_slots;
+    unsigned int dsp_submitted;  /* requests queued by drawPlot */
+    unsigned int dsp_completed;  /* of those, finished by the DSP stage */
+    unsigned int dsp_drawn;
+    pthread_t dsp_thread;
+    bool dsp_running;
+    volatile bool dsp_quit;
+    notify_t dsp_kick;           /* drawPlot -> DSP thread: new request */
+    notify_t dsp_done;           /* DSP thread -> drawPlot: frame finished */
 #ifdef __APPLE__
     FFTSetup fft_setup;
     DSPSplitComplex fft_out;
 #else
     fftw_complex* fft_out;
 #endif
-    size_t frames_read;
 
     double mouse[4];
     GLuint textures;
@@ -174,14 +394,21 @@ public:
     app_config_t app;
 
     double target_side[4];
-    double latency;
+    latency_window_t latency;  /* capture-to-draw, primary source */
+    double latency_p50;      /* refreshed once a second, usec */
+    double latency_p99;
+    double latency_max;
     double fps;
+    double wake_max;         /* worst notify wake latency over the last second, usec */
     double max_sample_value;
     double top_offset;
     double vertical_increment;
     double color_delta;
     double color_threshold;
     unsigned int frame_count;
+    bool rt_requested;       /* --realtime: see pollRealtime() */
+    uint32_t rt_seen;
+    unsigned long long rt_lock_due;
     unsigned int vertex_count;
     bool window_is_dirty;
     bool mouse_is_dirty;
@@ -190,9 +417,22 @@ public:
     bool show_help;
     bool show_mouse;
     bool dj_mode;
-
-    #define NUM_TEXT_TIMERS 20
-    #define NUM_AUTO_TEXT_TIMERS 16
+    bool scrubbing;          /* dragging on the paused timeline strip */
+
+    /* Paused timeline overview: one peak/RMS pair per column, rebuilt
+     * from the history pyramid only when the paused range changes */
+    #define TIMELINE_COLUMNS 512
+    #define TIMELINE_LEFT   -0.9
+    #define TIMELINE_RIGHT   0.9
+    #define TIMELINE_BOTTOM -0.95
+    #define TIMELINE_TOP    -0.85
+    float timeline_peak[TIMELINE_COLUMNS];
+    float timeline_rms[TIMELINE_COLUMNS];
+    long long timeline_begin;
+    long long timeline_end;
+
+    #define NUM_TEXT_TIMERS 21
+    #define NUM_AUTO_TEXT_TIMERS 17
     typedef struct _text_timer_t {
         bool show;
         timeval time;
@@ -218,11 +458,12 @@ public:
         BloomRadiusTimer = 13,
         SampleRateTimer  = 14,
         FrameRateTimer   = 15,
+        BufferingTimer   = 16,
         /* End of text timers automatically included in stats display */
-        PresetTimer      = 16,
-        PausedTimer      = 17,
-        ScaleTimer       = 18,
-        CounterTimer     = 19
+        PresetTimer      = 17,
+        PausedTimer      = 18,
+        ScaleTimer       = 19,
+        CounterTimer     = 20
     } text_timer_handles;
     text_timer_t text_timer[NUM_TEXT_TIMERS];
     timeval show_intro_time;
@@ -242,14 +483,26 @@ public:
     scene()
     {
         frame_size         = sizeof(frame_t);
-        framebuf           = NULL;
         ai                 = NULL;
         offset             = 0;
-        bump               = 0;
+        memset(traces, 0, sizeof(traces));
+        n_traces           = 0;
+        tile_traces        = false;
+        memset(dsp_frames, 0, sizeof(dsp_frames));
+        dsp_current        = NULL;
+        dsp_slots          = 0;
+        dsp_submitted = dsp_completed = dsp_drawn = 0;
+        dsp_running        = false;
+        dsp_quit           = false;
         bytes_per_buf      = 0;
-        latency            = 0.0;
+        latency_reset(&latency);
+        latency_p50 = latency_p99 = latency_max = 0.0;
         fps                = 0.0;
+        wake_max           = 0.0;
         frame_count        = 0;
+        rt_requested       = false;
+        rt_seen            = 0;
+        rt_lock_due        = 0;
         vertex_count       = 0;
         window_is_dirty    = true;
         mouse_is_dirty     = true;
@@ -262,6 +515,9 @@ public:
         show_help          = false;
         show_mouse         = true;
         dj_mode            = false;
+        scrubbing          = false;
+        timeline_begin     = 0;
+        timeline_end       = 0;
         memset(&prefs,   0, sizeof(prefs));
         memset(&presets, 0, sizeof(presets));
         memset(&app,     0, sizeof(app));
@@ -282,9 +538,7 @@ public:
     void init()
     {
         bytes_per_buf = draw_frames * frame_size;
-        framebuf      = (frame_t *) malloc(bytes_per_buf);
         offset        = -frames_per_buf;
-        bump          = -draw_frames;
 #ifdef __APPLE__
         int log2n     = 0;
         int n         = draw_frames;
@@ -295,17 +549,127 @@ public:
 #else
         fft_out       = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * draw_frames);
 #endif
-        ai = new audioInput(app.target);
+
+        /* no -t / -i: one live source on the saved target */
+        if (n_sources == 0) {
+            sources[0].target = app.target;
+            n_sources = 1;
+        }
+        n_traces = n_sources;
+        for (unsigned int i = 0; i < n_traces; i++) {
+            trace_t *tr = &traces[i];
+            openHistory(i);
+            openShm(i);
+            notify_init(&tr->window_ready);
+            tr->ai = new audioInput(i, sources[i].target, sources[i].file, sources[i].shm);
+        }
+        ai = traces[0].ai;
+        notify_init(&dsp_kick);
+        notify_init(&dsp_done);
+        startAcquire();
+        startDsp();
+        if (n_traces > 1) {
+            workers_init(&dsp_workers, n_traces - 1);
+            dsp_workers.thread_hook = workerRealtime;
+        }
     }
 
-    void reinit_frame_rate(int new_rate)
+    /* Window buffers and acquisition threads for every trace.  Stopped
+     * around anything that resizes the windows or restarts a history. */
+    void startAcquire()
     {
-        frame_rate = new_rate;
-        compute_derived_rates();
+        for (unsigned int i = 0; i < n_traces; i++) {
+            trace_t *tr = &traces[i];
+            for (unsigned int k = 0; k < 3; k++) {
+                tr->window[k].frames    = (frame_t *) malloc(window_frames * frame_size);
+                tr->window[k].n_frames  = 0;
+                tr->window[k].end       = 0;
+                tr->window[k].newest_ns = 0;
+            }
+            triple_init(&tr->windows, &tr->window[0], &tr->window[1], &tr->window[2]);
+            clock_dll_init(&tr->clock, sample_rate, frame_rate);
+            tr->advance.last_end = 0;
+            tr->catchup.ring = NULL;
+            tr->owner        = this;
+            tr->acquire_quit = false;
+            tr->acquire_busy = 0;
+            if (pthread_create(&tr->acquire_thread, NULL, acquireThread, (void *) tr) != 0) {
+                fprintf(stderr, "Failed to start acquisition thread for source %u\n", i + 1);
+                exit(1);
+            }
+            tr->acquiring = true;
+        }
+    }
 
+    void stopAcquire()
+    {
+        for (unsigned int i = 0; i < n_traces; i++) {
+            trace_t *tr = &traces[i];
+            if (!tr->acquiring)
+                continue;
+            tr->acquire_quit = true;
+            pthread_join(tr->acquire_thread, NULL);
+            tr->acquiring = false;
+            for (unsigned int k = 0; k < 3; k++)
+                free(tr->window[k].frames);
+        }
+    }
+
+    /* DSP frame buffers, and the DSP thread when --dsp-depth asks for
+     * one.  Stopped and restarted with the acquisition threads. */
+    void startDsp()
+    {
+        dsp_slots = dsp_depth + 1;
+        dsp_submitted = dsp_completed = dsp_drawn = 0;
+        for (unsigned int k = 0; k < dsp_slots; k++) {
+            dsp_frame_t *f = &dsp_frames[k];
+            for (unsigned int i = 0; i < n_traces; i++) {
+                f->trace[i].frames = (frame_t *) malloc(bytes_per_buf
+                                                        * (lossless ? lossless_cap : 1));
+                f->trace[i].frames_read = 0;
+                f->trace[i].spectrum_colors = NULL;
+            }
+        }
+        if (dsp_depth == 0)
+            return;
+        dsp_quit = false;
+        if (pthread_create(&dsp_thread, NULL, dspThread, (void *) this) != 0) {
+            fprintf(stderr, "Failed to start DSP thread\n");
+            exit(1);
+        }
+        dsp_running = true;
+    }
+
+    void stopDsp()
+    {
+        if (dsp_running) {
+            dsp_quit = true;
+            pthread_join(dsp_thread, NULL);
+            dsp_running = false;
+        }
+        for (unsigned int k = 0; k < dsp_slots; k++) {
+            dsp_frame_t *f = &dsp_frames[k];
+            for (unsigned int i = 0; i < n_traces; i++) {
+                free(f->trace[i].frames);
+                delete[] f->trace[i].spectrum_colors;
+                f->trace[i].frames = NULL;
+                f->trace[i].spectrum_colors = NULL;
+            }
+            free(f->pos);
+            free(f->col);
+            f->pos = f->col = NULL;
+            f->samp_alloc = 0;
+        }
+        dsp_slots = 0;
+    }
+
+    /* The per-frame buffers sized from draw_frames, after
+     * compute_derived_rates(); the DSP frames follow in startDsp() */
+    void resizeFrameBuffers()
+    {
         bytes_per_buf = draw_frames * frame_size;
-        free(framebuf);
-        framebuf = (frame_t *) malloc(bytes_per_buf);
+        if (rt_requested)
+            rt_lock_due = monotonic_ns() + 1000000000ULL;
 
 #ifdef __APPLE__
         vDSP_destroy_fftsetup(fft_setup);
@@ -321,9 +685,19 @@ public:
         fftw_free(fft_out);
         fft_out = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * draw_frames);
 #endif
+    }
+
+    void reinit_frame_rate(int new_rate)
+    {
+        stopDsp();
+        stopAcquire();
+        frame_rate = new_rate;
+        compute_derived_rates();
 
+        resizeFrameBuffers();
         offset = -frames_per_buf;
-        bump   = -draw_frames;
+        startAcquire();
+        startDsp();
 
         printf("Display changed: frame rate now %d fps, frames_per_buf: %d\n",
                frame_rate, frames_per_buf);
@@ -332,40 +706,83 @@ public:
 
     void reinit_sample_rate(int new_rate)
     {
+        stopDsp();
+        stopAcquire();
         sample_rate = new_rate;
         compute_derived_rates();
 
-        bytes_per_buf = draw_frames * frame_size;
-        free(framebuf);
-        framebuf = (frame_t *) malloc(bytes_per_buf);
-
-#ifdef __APPLE__
-        vDSP_destroy_fftsetup(fft_setup);
-        free(fft_out.realp);
-        free(fft_out.imagp);
-        int log2n = 0;
-        int n = draw_frames;
-        while (n > 1) { n >>= 1; log2n++; }
-        fft_setup     = vDSP_create_fftsetup(log2n, FFT_RADIX2);
-        fft_out.realp = (float *) malloc(draw_frames/2 * sizeof(float));
-        fft_out.imagp = (float *) malloc(draw_frames/2 * sizeof(float));
-#else
-        fftw_free(fft_out);
-        fft_out = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * draw_frames);
-#endif
-
+        resizeFrameBuffers();
         offset = -frames_per_buf;
-        bump   = -draw_frames;
+
+        /* old blocks are at the old rate; start the history over */
+        for (unsigned int i = 0; i < n_traces; i++) {
+            openHistory(i);
+            traces[i].live_end = traces[i].pause_anchor = 0;
+        }
+        startAcquire();
+        startDsp();
 
         printf("Sample rate changed: %d Hz, frames_per_buf: %d\n",
                sample_rate, frames_per_buf);
         showSampleRate(TIMED);
     }
 
+    /* Apply a buffering profile while running: the capture streams and
+     * their rings carry on, only what is sized from the profile is
+     * rebuilt.  A new history length starts the history over. */
+    void reinit_buffering(const buffer_profile_t *bp)
+    {
+        bool new_history = bp->buffer_seconds != buffer_seconds;
+        stopDsp();
+        stopAcquire();
+        buffer_seconds   = bp->buffer_seconds;
+        draw_each_frame  = bp->draw_each_frame;
+        limit_frame_rate = bp->limit_frame_rate;
+        compute_derived_rates();
+        resizeFrameBuffers();
+        offset = -frames_per_buf;
+
+        if (new_history) {
+            for (unsigned int i = 0; i < n_traces; i++) {
+                openHistory(i);
+                traces[i].live_end = traces[i].pause_anchor = 0;
+            }
+        }
+        startAcquire();
+        startDsp();
+
+        printf("Buffering: %s, %.0f s history, draw each frame %dx, frame limit %s\n",
+               bp->name, buffer_seconds, draw_each_frame, limit_frame_rate ? "on" : "off");
+        showBuffering(TIMED);
+    }
+
+    /* Next profile in buffer_profiles, dropping any per-setting overrides */
+    void cycleBufferProfile()
+    {
+        unsigned int next = 0;
+        for (unsigned int i = 0; i < NUM_BUFFER_PROFILES; i++) {
+            if (!strcmp(app.profile, buffer_profiles[i].name))
+                next = (i + 1) % NUM_BUFFER_PROFILES;
+        }
+        if (!app.profile[0])
+            next = 1;
+        snprintf(app.profile, sizeof(app.profile), "%s", buffer_profiles[next].name);
+        app.history_seconds = 0.0;
+        app.draw_each = app.frame_limit = 0;
+        buffer_profile_t bp;
+        buffer_profile_resolve(&app, &bp);
+        reinit_buffering(&bp);
+    }
+
     ~scene()
     {
         save_config(&prefs, &presets, &app);
-        delete ai;
+        stopDsp();
+        stopAcquire();
+        if (n_traces > 1)
+            workers_destroy(&dsp_workers);
+        for (unsigned int i = 0; i < n_traces; i++)
+            delete traces[i].ai;
 #ifdef __APPLE__
         vDSP_destroy_fftsetup(fft_setup);
         free(fft_out.realp);
@@ -373,136 +790,79 @@ public:
 #else
         fftw_free(fft_out);
 #endif
-        free(framebuf);
-    }
-
-    void drawPlot()
-    {
-        thread_data_t *t_data = ai->getThreadData();
-        size_t bytes_ready = 0, bytes_read = 0;
-        double dt  = 0.0;
-        signed int distance = 0;
-
-        /* FFT stuff */
-        unsigned int window_size, overlap_size;
-        if (prefs.display_mode == DisplaySpectrumMode) {
-            /* Spectrum mode: color_range indexes octaves of window_size
-             * so each integer step of color_range doubles the FFT
-             * window (and halves the bin width). Floor is 1.
-             *
-             *   color_range  1   2   3   4   5
-             *   window_size  128 256 512 1024 2048
-             *
-             * Default color_range=1 gives window_size=128, bin_width
-             * 750 Hz. Cranks above that give progressively finer
-             * frequency resolution at the cost of fewer STFT windows
-             * per frame.
-             *
-             * overlap_size = 0 means windows tile (stride = window_size)
-             * rather than 50%-overlapping. That halves the FFT count
-             * per frame at small window sizes without meaningfully
-             * reducing color variation, and when frames_read isn't a
-             * clean multiple of window_size the aggregation adds one
-             * "nudged" STFT at frames_read-window_size to cover the
-             * trailing samples. */
-            /* Base window scales with sample rate so the same
-             * color_range gives the same bin width at any rate.
-             * At 96 kHz base=64 → color_range 1=128, 2=256, etc.
-             * At 192 kHz base=128 → color_range 1=256, 2=512, etc.
-             * At 48 kHz base=32 → color_range 1=64, 2=128, etc. */
-            unsigned int base = 1;
-            while (base * 2 <= (unsigned int)(64 * sample_rate / 96000))
-                base *= 2;
-            int steps = (int)prefs.color_range;
-            if (steps < 0)  steps = 0;
-            if (steps > 10) steps = 10;
-            window_size = base;
-            for (int i = 0; i < steps; i++) {
-                unsigned int next = window_size * 2;
-                if (next > (unsigned int)draw_frames || next > 2048) break;
-                window_size = next;
-            }
-            overlap_size = 0;
-        } else {
-            window_size  = draw_frames / 100;
-            overlap_size = draw_frames / 200;
-            if (window_size < 2) window_size = 2;
-            if (overlap_size >= window_size) overlap_size = window_size / 2;
+        for (unsigned int i = 0; i < n_traces; i++) {
+            trace_t *tr = &traces[i];
+            notify_destroy(&tr->window_ready);
+            history_free(&tr->history);
+            spool_close(&tr->spool);
+            shm_writer_close(&tr->shm);
+            releaseFft(tr);
         }
-        double* spectrum_colors = NULL;  /* per-window RGB triples for DisplaySpectrumMode */
-        double** stft_results;
-#ifndef __APPLE__
-        fftw_plan fft_plan;
-#endif
-
-        /* if the scope is paused or audio not initialized, there are no samples available;
-         * therefore we should not wait for the reader thread */
-        if (! t_data->pause_scope && t_data->can_process) {
-            pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, NULL);
-            pthread_mutex_lock(&t_data->ringbuffer_lock);
-
-            // Use timed wait to avoid hanging forever if audio fails
-            struct timespec ts;
-            clock_gettime(CLOCK_REALTIME, &ts);
-            ts.tv_nsec += 1000000000 / frame_rate;
-            if (ts.tv_nsec >= 1000000000) {
-                ts.tv_sec  += 1;
-                ts.tv_nsec -= 1000000000;
-            }
-            pthread_cond_timedwait(&t_data->data_ready, &t_data->ringbuffer_lock, &ts);
+        if (n_traces) {
+            notify_destroy(&dsp_kick);
+            notify_destroy(&dsp_done);
         }
+    }
 
-
-        /* Read data from the ring buffer */
-        if (t_data->pause_scope) {
-            distance = bump * frame_size;
-            bump     = -draw_frames;
-        }
-        else if (t_data->ringbuffer) {
-            int delay_frames = (int)(prefs.delay * 0.001 * sample_rate);
-            int delay_bytes  = delay_frames * frame_size;
-            bytes_ready = ringbuffer_read_space(t_data->ringbuffer);
-            if (bytes_ready != (size_t)(bytes_per_buf + delay_bytes))
-                distance = bytes_ready - bytes_per_buf - delay_bytes;
+    /* (Re)create a trace's rewind history, with the disk spool behind
+     * it when --spool was given (FILE, FILE.2, ... per source).  Block
+     * numbers restart, so the spool does too. */
+    void openHistory(unsigned int i)
+    {
+        trace_t *tr = &traces[i];
+        history_free(&tr->history);
+        spool_close(&tr->spool);
+        history_init(&tr->history, default_rb_size);
+        if (spool_path) {
+            char path[1024];
+            if (i == 0)
+                snprintf(path, sizeof(path), "%s", spool_path);
+            else
+                snprintf(path, sizeof(path), "%s.%u", spool_path, i + 1);
+            size_t blocks = (size_t)(spool_minutes * 60.0 * sample_rate / HISTORY_BLOCK);
+            if (spool_open(&tr->spool, path, blocks, sizeof(history_block_t)))
+                tr->history.spool = &tr->spool;
+            else
+                fprintf(stderr, "Continuing without a history spool\n");
         }
-        if (distance != 0 && t_data->ringbuffer)
-            ringbuffer_read_advance(t_data->ringbuffer, distance);
-        if (t_data->ringbuffer)
-            bytes_read = ringbuffer_read(t_data->ringbuffer,
-                                          (char *) framebuf,
-                                          bytes_per_buf);
-
-        if (! t_data->pause_scope)
-            pthread_mutex_unlock(&t_data->ringbuffer_lock);
-
-        frames_read = bytes_read / frame_size;
-
-
-        /* prescans the framebuf in order to auto-scale */
-        if (prefs.auto_scale)
-            autoScale();
-
+    }
 
-        /* set up the OpenGL */
-        glMatrixMode(GL_PROJECTION);
-        glLoadIdentity();
+    /* --shm-publish: NAME, NAME.2, ... per source, holding the live
+     * ring's two seconds */
+    void openShm(unsigned int i)
+    {
+        if (!shm_name)
+            return;
+        char name[200];
+        if (i == 0)
+            snprintf(name, sizeof(name), "%s", shm_name);
+        else
+            snprintf(name, sizeof(name), "%s.%u", shm_name, i + 1);
+        if (shm_writer_open(&traces[i].shm, name, live_rb_size * frame_size, i))
+            printf("Publishing source %u in shared memory %s\n", i + 1, traces[i].shm.name);
+        else
+            fprintf(stderr, "Continuing without shared memory for source %u\n", i + 1);
+    }
 
-        glOrtho(prefs.side[3], prefs.side[2],
-                 prefs.side[1], prefs.side[0],
-                 -10.0, 10.0);
-        glMatrixMode(GL_MODELVIEW);
-        glPushMatrix();
-        glLoadIdentity();
-        if (prefs.particles) {
-            glPointSize((GLfloat) prefs.line_width);
-        }
-        else {
-            glLineWidth((GLfloat) prefs.line_width);
-        }
+    /* Per-source CPU work for one frame: the STFT colors in spectrum
+     * mode, the color-delta accumulator and, on the GPU spline path,
+     * this trace's slice of the shared sample arrays.  It reads only
+     * prefs and its own trace, so traces can run on separate cores. */
+    void prepareTrace(trace_t *tr, trace_frame_t *tf)
+    {
+        const dsp_frame_t *f      = dsp_current;
+        const preferences_t *fp   = &f->prefs;
+        const frame_t *framebuf   = tf->frames;
+        size_t frames_read        = tf->frames_read;
+        unsigned int window_size  = f->window_size;
+        unsigned int overlap_size = f->overlap_size;
+        double* spectrum_colors = NULL;  /* per-window RGB triples for DisplaySpectrumMode */
+        double** stft_results;
+        double dt = 0.0;
 
         /* FFT setup for spectrum mode — runs on raw samples before
          * spline interpolation so it sees the original signal. */
-        if (prefs.display_mode == DisplaySpectrumMode) {
+        if (fp->display_mode == DisplaySpectrumMode) {
                 unsigned int fft_count = frames_read;
                 unsigned int window_size_fft = window_size;
                 unsigned int overlap_size_fft = overlap_size;
@@ -527,22 +887,22 @@ public:
                     stft_results[i] = new double[window_size_fft]();
                 }
 #ifdef __APPLE__
-                // Set up vDSP FFT once outside loop (performance optimization)
+                // vDSP FFT setup cached per trace by ensureFft()
                 int log2n_win = 0;
                 int n_win = window_size_fft;
                 while (n_win > 1) { n_win >>= 1; log2n_win++; }
-                FFTSetup fft_setup_local = vDSP_create_fftsetup(log2n_win, FFT_RADIX2);
+                FFTSetup fft_setup_local = tr->fft;
                 DSPSplitComplex fft_data;
                 /* Full N for complex FFT (spectrum), N/2 for real FFT (frequency) */
-                unsigned int fft_alloc = (prefs.display_mode == DisplaySpectrumMode)
+                unsigned int fft_alloc = (fp->display_mode == DisplaySpectrumMode)
                     ? window_size_fft : window_size_fft / 2;
                 fft_data.realp = new float[fft_alloc];
                 fft_data.imagp = new float[fft_alloc];
 #else
-                fftw_complex *fft_out_local =
-                    (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * window_size_fft);
+                /* in-place plan and buffer cached per trace by ensureFft() */
+                fftw_complex *fft_out_local = tr->fft_buf;
 #endif
-                bool spectrum = (prefs.display_mode == DisplaySpectrumMode);
+                bool spectrum = (fp->display_mode == DisplaySpectrumMode);
 
                 auto compute_fft_at = [&](unsigned int start_i, unsigned int target_slot) {
 #ifdef __APPLE__
@@ -585,15 +945,13 @@ public:
                         stft_results[target_slot][j] = sqrt(mag);
                     }
 #else
-                    double (*temp_data)[2] = new double[window_size_fft][2];
                     for (unsigned int j = 0; j < window_size_fft; j++) {
-                        temp_data[j][0] = fft_input[start_i + j];
-                        temp_data[j][1] = spectrum
+                        fft_out_local[j][0] = fft_input[start_i + j];
+                        fft_out_local[j][1] = spectrum
                             ? framebuf[start_i + j].right_channel
                             : 0.0;
                     }
-                    fft_plan = fftw_plan_dft_1d(window_size_fft, temp_data, fft_out_local, FFTW_FORWARD, FFTW_ESTIMATE);
-                    fftw_execute(fft_plan);
+                    fftw_execute(tr->fft);
                     for (unsigned int j = 0; j < window_size_fft/2; j++) {
                         double rp = fft_out_local[j][0];
                         double ip = fft_out_local[j][1];
@@ -606,8 +964,6 @@ public:
                         }
                         stft_results[target_slot][j] = sqrt(mag);
                     }
-                    fftw_destroy_plan(fft_plan);
-                    delete[] temp_data;
 #endif
                 };
 
@@ -624,7 +980,7 @@ public:
                  * slot n_windows_audio (the last allocated slot), which
                  * is exactly where vertex indexing sends the trailing
                  * vertices via `i / stride`. */
-                if (prefs.display_mode == DisplaySpectrumMode && w_idx > 0) {
+                if (fp->display_mode == DisplaySpectrumMode && w_idx > 0) {
                     unsigned int last_end = (w_idx - 1) * stride_fft + window_size_fft;
                     if (last_end < fft_count) {
                         compute_fft_at(fft_count - window_size_fft, n_windows_audio);
@@ -632,12 +988,8 @@ public:
                 }
                 delete[] fft_input;
 #ifdef __APPLE__
-                // Clean up FFT resources after loop
-                vDSP_destroy_fftsetup(fft_setup_local);
                 delete[] fft_data.realp;
                 delete[] fft_data.imagp;
-#else
-                fftw_free(fft_out_local);
 #endif
 
                 unsigned int n_windows = frames_read / (window_size - overlap_size);
@@ -735,115 +1087,629 @@ public:
                 delete[] stft_results;
         }
 
-        /* Compute color delta accumulator for ColorDeltaMode */
-        if (prefs.color_mode == ColorDeltaMode) {
-            double olc = 0.0, orc = 0.0;
-            for (unsigned int i = 0; i < frames_read; i++) {
-                double lc = framebuf[i].left_channel;
-                double rc = framebuf[i].right_channel;
-                dt += hypot(lc - olc, rc - orc) / SQRT_TWO;
-                olc = lc;
-                orc = rc;
+        /* Compute color delta accumulator for ColorDeltaMode */
+        if (fp->color_mode == ColorDeltaMode) {
+            double olc = 0.0, orc = 0.0;
+            for (unsigned int i = 0; i < frames_read; i++) {
+                double lc = framebuf[i].left_channel;
+                double rc = framebuf[i].right_channel;
+                dt += hypot(lc - olc, rc - orc) / SQRT_TWO;
+                olc = lc;
+                orc = rc;
+            }
+        }
+
+        if (f->gpu) {
+            /* Compute per-sample colors on CPU (~1600 iterations) */
+            float *s_pos = f->pos + tf->base * 4;
+            float *s_col = f->col + tf->base * 4;
+
+            unsigned int spl_stride = (window_size > overlap_size) ? (window_size - overlap_size) : 1;
+            double h = -1.0, s = 1.0, v = 1.0, a = 1.0;
+            double r = 1.0, g = 1.0, b = 1.0;
+            double olc = 0.0, orc = 0.0;
+            if (fp->display_mode == DisplayStandardMode)
+                HSVtoRGB(&r, &g, &b, tf->hue, s, v);
+
+            for (unsigned int i = 0; i < frames_read; i++) {
+                double lc = framebuf[i].left_channel;
+                double rc = framebuf[i].right_channel;
+                double d = hypot(lc - olc, rc - orc) / SQRT_TWO;
+                if (fp->velocity_dim > 0.0)
+                    a = 1.0 / (1.0 + d * 10.0 * fp->velocity_dim * fp->scale_factor);
+                else
+                    a = 1.0;
+
+                bool color_set = false;
+                switch (fp->display_mode) {
+                    case DisplayStandardMode: break;
+                    case DisplayRadiusMode:
+                        h = ((hypot(lc, rc) / SQRT_TWO) * 360.0 * fp->color_range * fp->scale_factor) + tf->hue;
+                        break;
+                    case DisplaySpectrumMode:
+                        if (spectrum_colors) {
+                            unsigned int w = i / spl_stride;
+                            double sr = spectrum_colors[w * 3 + 0];
+                            double sg = spectrum_colors[w * 3 + 1];
+                            double sb = spectrum_colors[w * 3 + 2];
+                            double sh, ss, sv;
+                            RGBtoHSV(sr, sg, sb, &sh, &ss, &sv);
+                            ss *= 1.25; if (ss > 1.0) ss = 1.0;
+                            double v_floor = 0.5 / fp->brightness;
+                            if (v_floor > 0.5) v_floor = 0.5;
+                            sv = sv * (1.0 - v_floor) + v_floor;
+                            HSVtoRGB(&r, &g, &b, sh, ss, sv);
+                            color_set = true;
+                        }
+                        break;
+                }
+                if (!color_set) {
+                    if (h > -1.0 && fp->display_mode != DisplayStandardMode)
+                        h = normalizeHue(h);
+                    if (h > -1.0)
+                        HSVtoRGB(&r, &g, &b, h, s, v);
+                    else if (fp->velocity_dim > 0.0)
+                        HSVtoRGB(&r, &g, &b, tf->hue, s, v);
+                }
+
+                s_pos[i * 4 + 0] = (float)lc;
+                s_pos[i * 4 + 1] = (float)rc;
+                s_pos[i * 4 + 2] = 0.0f;
+                s_pos[i * 4 + 3] = 0.0f;
+                s_col[i * 4 + 0] = (float)(r * fp->brightness);
+                s_col[i * 4 + 1] = (float)(g * fp->brightness);
+                s_col[i * 4 + 2] = (float)(b * fp->brightness);
+                s_col[i * 4 + 3] = (float)a;
+                olc = lc; orc = rc;
+            }
+        }
+
+        tf->spectrum_colors = spectrum_colors;
+        tf->dt = dt;
+    }
+
+    static void prepareJob(void *ctx, unsigned int job)
+    {
+        scene *s = (scene *)ctx;
+        s->prepareTrace(&s->traces[job], &s->dsp_current->trace[job]);
+    }
+
+    /* FFT setup for one window size, cached per trace.  Called on the
+     * render thread before the DSP jobs start: the FFTW planner isn't
+     * thread-safe, but executing separate plans concurrently is. */
+    void ensureFft(trace_t *tr, unsigned int n)
+    {
+        if (tr->fft_n == n)
+            return;
+        releaseFft(tr);
+#ifdef __APPLE__
+        int log2n = 0;
+        while ((1u << log2n) < n) log2n++;
+        tr->fft = vDSP_create_fftsetup(log2n, FFT_RADIX2);
+#else
+        tr->fft_buf = (fftw_complex *) fftw_malloc(sizeof(fftw_complex) * n);
+        tr->fft     = fftw_plan_dft_1d(n, tr->fft_buf, tr->fft_buf, FFTW_FORWARD, FFTW_ESTIMATE);
+#endif
+        tr->fft_n = n;
+    }
+
+    void releaseFft(trace_t *tr)
+    {
+        if (!tr->fft_n)
+            return;
+#ifdef __APPLE__
+        vDSP_destroy_fftsetup(tr->fft);
+#else
+        fftw_destroy_plan(tr->fft);
+        fftw_free(tr->fft_buf);
+#endif
+        tr->fft_n = 0;
+    }
+
+    /* Overlay draws every trace in the same frame; tile gives each a
+     * grid cell, scaled about the view centre.  Pair with glPopMatrix(). */
+    void pushTraceTransform(unsigned int i)
+    {
+        glPushMatrix();
+        if (!tile_traces || n_traces < 2)
+            return;
+        unsigned int cols = (unsigned int) ceil(sqrt((double) n_traces));
+        unsigned int rows = (n_traces + cols - 1) / cols;
+        double k  = (double) max(cols, rows);
+        double w  = prefs.side[2] - prefs.side[3];
+        double h  = prefs.side[0] - prefs.side[1];
+        double cx = prefs.side[3] + (i % cols + 0.5) * w / cols;
+        double cy = prefs.side[0] - (i / cols + 0.5) * h / rows;
+        glTranslated(cx, cy, 0.0);
+        glScaled(1.0 / k, 1.0 / k, 1.0);
+        glTranslated(-(prefs.side[2] + prefs.side[3]) / 2.0,
+                     -(prefs.side[0] + prefs.side[1]) / 2.0, 0.0);
+    }
+
+    /* Build the next live window into the back slot and publish it.
+     * With --raw-capture, the quanta the callback recorded are first
+     * downmixed into the frame ring here, off the realtime thread.
+     * Everything new in the ring goes into the history first, through
+     * its own cursor; the window cursor then just seeks to wherever the
+     * display delay puts the window.  The history is the ring's gate, so
+     * --input-fast feeds the file no faster than it is recorded. */
+    void acquireWindow(trace_t *tr)
+    {
+        thread_data_t *t_data = tr->ai->getThreadData();
+        bcast_ring_t *rb = t_data->ringbuffer;
+        bcast_reader_t *rd = &tr->reader;
+        window_t *win = (window_t *) triple_back(&tr->windows);
+        size_t bytes_read = 0;
+
+        if (rd->ring != rb) {
+            bcast_reader_init(rd, rb);
+            rb->gate = &tr->history.reader.pos;
+        }
+        if (t_data->raw)
+            drain_raw(t_data);
+
+        int delay_frames = (int)(prefs.delay * 0.001 * sample_rate);
+        int delay_bytes  = delay_frames * frame_size;
+        history_ingest(&tr->history, rb);
+        uint64_t head = tr->history.reader.head_cache;
+        tr->live_end = history_live_end(&tr->history) - delay_frames;
+
+        /* tags are written before their data, so every frame up to
+         * head has one; ring positions are frame counts */
+        unsigned long long w = head / frame_size;
+        win->newest_ns = 0;
+        if (t_data->tags) {
+            tag_log_drain(&tr->tags, t_data->tags);
+            if (w > (unsigned long long)delay_frames)
+                tag_log_time(&tr->tags, w - delay_frames - 1, sample_rate, &win->newest_ns);
+        }
+        if (tr->shm.hdr)
+            shm_publish(&tr->shm, rb, sample_rate, t_data->tags ? &tr->tags : NULL);
+
+        size_t window_bytes = window_frames * frame_size;
+        bcast_read_space(rd);
+        if (window_bytes + delay_bytes <= rb->size / 2) {
+            uint64_t want = window_bytes + delay_bytes;
+            bcast_seek(rd, head > want ? head - want : 0);
+            bytes_read = bcast_read(rd, (char *) win->frames, window_bytes);
+            win->end   = rd->pos / frame_size;
+        }
+        else {
+            /* delayed further back than the live ring reaches */
+            bcast_seek(rd, head);
+            bytes_read = history_read(&tr->history, tr->live_end - window_frames,
+                                      win->frames, window_frames) * frame_size;
+            win->end   = w > (unsigned long long)delay_frames ? w - delay_frames : 0;
+        }
+
+        win->n_frames = bytes_read / frame_size;
+        triple_publish(&tr->windows);
+        notify_post(&tr->window_ready, (uint32_t) tr->windows.published, monotonic_ns());
+    }
+
+    /* One thread per trace: a window per capture wakeup (or per frame
+     * period if the source stalls), never waiting on the renderer.
+     * acquire_busy brackets every pass that could touch the history,
+     * so togglePaused can tell when the history is its own. */
+    void acquireLoop(trace_t *tr)
+    {
+        thread_data_t *t_data = tr->ai->getThreadData();
+        uint32_t rt_seen = 0;
+
+        while (! tr->acquire_quit) {
+            rt_thread_poll(&realtime, &rt_seen, realtime.priority + RT_ACQUIRE_BOOST);
+            notify_store(&tr->acquire_busy, 1);
+            notify_fence();
+            if (! t_data->pause_scope && t_data->can_process && t_data->ringbuffer)
+                acquireWindow(tr);
+            notify_store(&tr->acquire_busy, 0);
+            notify_wait(&t_data->data_ready, 1000000000ULL / frame_rate);
+        }
+    }
+
+    static void *acquireThread(void *arg)
+    {
+        trace_t *tr = (trace_t *) arg;
+        tr->owner->acquireLoop(tr);
+        return NULL;
+    }
+
+    /* --lossless: draw from wherever the last frame stopped, not from
+     * where the clock says, reading the source's ring through the
+     * trace's own cursor.  Caught up, that is the usual draw_frames
+     * ending at `end`; behind, the window grows (up to lossless_cap
+     * windows, and what the spline textures hold) until it catches up.
+     * Returns the frames copied into tf, 0 if the ring can't serve it
+     * and the published window should be used. */
+    size_t catchUp(trace_t *tr, unsigned long long end, trace_frame_t *tf)
+    {
+        const bcast_ring_t *rb = tr->ai->getThreadData()->ringbuffer;
+        bcast_reader_t *rd = &tr->catchup;
+        uint64_t to   = end * frame_size;
+        uint64_t span = (uint64_t)draw_frames * frame_size;
+        size_t cap    = (size_t)lossless_cap * draw_frames;
+
+        if (!rb)
+            return 0;
+        if (spline_max_texels > 0 && cap > (size_t)spline_max_texels / n_traces)
+            cap = (size_t)spline_max_texels / n_traces;
+        if (cap < (size_t)draw_frames)
+            cap = draw_frames;
+        if (rd->ring != rb) {
+            bcast_reader_init(rd, rb);
+            rd->pos = to > span ? to - span : 0;
+        }
+
+        for (int attempt = 0; attempt < 2; attempt++) {
+            /* lapped: bcast_read_space counts the loss and moves on */
+            bcast_read_space(rd);
+            if (to > rd->head_cache)
+                to = rd->head_cache;
+            uint64_t from = to > span ? to - span : 0;
+            if (rd->pos < from)
+                from = rd->pos;
+            size_t want = (size_t)(to - from);
+            if (want > cap * frame_size)
+                want = cap * frame_size;
+            bcast_seek(rd, from);
+            size_t got = bcast_read(rd, (char *) tf->frames, want);
+            if (got) {
+                unsigned long long backlog = (to - rd->pos) / frame_size;
+                tr->advance.backlog = backlog;
+                if (backlog > tr->advance.backlog_max)
+                    tr->advance.backlog_max = backlog;
+                if (got > span)
+                    tr->advance.grown++;
+                return got / frame_size;
+            }
+        }
+        return 0;
+    }
+
+    /* Copy this frame's window for one source into tf: draw_frames of
+     * the newest published one while live, taken without waiting, ending
+     * where the trace's clock recovery has got to (or, with --lossless,
+     * everything since the last frame, see catchUp); or one decoded from
+     * the compressed history while paused. */
+    void readTrace(trace_t *tr, const dsp_frame_t *f, trace_frame_t *tf)
+    {
+        if (f->paused) {
+            long long end = tr->pause_anchor + f->offset + frames_per_buf;
+            tr->advance.last_end = 0;
+            tr->catchup.ring = NULL;
+            tf->frames_read = history_read(&tr->history, end - draw_frames,
+                                           tf->frames, draw_frames);
+            tf->newest_ns   = 0;
+        }
+        else {
+            const window_t *win = (const window_t *) triple_take(&tr->windows);
+            size_t n = win->n_frames, first = 0;
+            tf->newest_ns = win->newest_ns;
+            if (n > (size_t)draw_frames) {
+                /* clamped to the window: past its end is a repeat, before
+                 * its start a skip, and either means the loop is relocking */
+                double end = clock_dll_update(&tr->clock, win->end);
+                double lo  = (double)(win->end - n + draw_frames);
+                bool clamped = end > (double)win->end || end < lo;
+                if (end > (double)win->end) end = (double)win->end;
+                if (end < lo)               end = lo;
+                unsigned long long behind = win->end - (unsigned long long)end;
+                size_t got = lossless ? catchUp(tr, win->end - behind, tf) : 0;
+                if (got) {
+                    unsigned long long drawn = tr->catchup.pos / frame_size;
+                    advance_add(&tr->advance, drawn, got, clamped);
+                    tf->frames_read = got;
+                    if (tf->newest_ns)
+                        tf->newest_ns -= (unsigned long long)((win->end - drawn) * 1e9 / sample_rate);
+                    return;
+                }
+                advance_add(&tr->advance, win->end - behind, draw_frames, clamped);
+                first = n - draw_frames - behind;
+                n     = draw_frames;
+                if (tf->newest_ns)
+                    tf->newest_ns -= (unsigned long long)(behind * 1e9 / sample_rate);
+            }
+            memcpy(tf->frames, win->frames + first, n * frame_size);
+            tf->frames_read = n;
+        }
+    }
+
+    /* Fill one DSP frame: each source's window, the autoscale peak, and
+     * the per-source DSP (on the worker pool when there are several). */
+    void dspFrame(dsp_frame_t *f)
+    {
+        thread_data_t *t_data = ai->getThreadData();
+
+        /* FFT stuff */
+        unsigned int window_size, overlap_size;
+        const preferences_t *fp = &f->prefs;
+        if (fp->display_mode == DisplaySpectrumMode) {
+            /* Spectrum mode: color_range indexes octaves of window_size
+             * so each integer step of color_range doubles the FFT
+             * window (and halves the bin width). Floor is 1.
+             *
+             *   color_range  1   2   3   4   5
+             *   window_size  128 256 512 1024 2048
+             *
+             * Default color_range=1 gives window_size=128, bin_width
+             * 750 Hz. Cranks above that give progressively finer
+             * frequency resolution at the cost of fewer STFT windows
+             * per frame.
+             *
+             * overlap_size = 0 means windows tile (stride = window_size)
+             * rather than 50%-overlapping. That halves the FFT count
+             * per frame at small window sizes without meaningfully
+             * reducing color variation, and when frames_read isn't a
+             * clean multiple of window_size the aggregation adds one
+             * "nudged" STFT at frames_read-window_size to cover the
+             * trailing samples. */
+            /* Base window scales with sample rate so the same
+             * color_range gives the same bin width at any rate.
+             * At 96 kHz base=64 → color_range 1=128, 2=256, etc.
+             * At 192 kHz base=128 → color_range 1=256, 2=512, etc.
+             * At 48 kHz base=32 → color_range 1=64, 2=128, etc. */
+            unsigned int base = 1;
+            while (base * 2 <= (unsigned int)(64 * sample_rate / 96000))
+                base *= 2;
+            int steps = (int)fp->color_range;
+            if (steps < 0)  steps = 0;
+            if (steps > 10) steps = 10;
+            window_size = base;
+            for (int i = 0; i < steps; i++) {
+                unsigned int next = window_size * 2;
+                if (next > (unsigned int)draw_frames || next > 2048) break;
+                window_size = next;
+            }
+            overlap_size = 0;
+        } else {
+            window_size  = draw_frames / 100;
+            overlap_size = draw_frames / 200;
+            if (window_size < 2) window_size = 2;
+            if (overlap_size >= window_size) overlap_size = window_size / 2;
+        }
+        f->window_size  = window_size;
+        f->overlap_size = overlap_size;
+
+        /* if the scope is paused or audio not initialized, there are no samples available;
+         * therefore we should not wait for the acquisition thread.  Otherwise park until it
+         * publishes a new window, or one frame period passes so we keep drawing if audio
+         * stalls. */
+        if (! f->paused && t_data->can_process)
+            notify_wait(&traces[0].window_ready, 1000000000ULL / frame_rate);
+
+        /* each source's newest window, or its history while paused.
+         * All sources share one pair of sample textures: each trace's
+         * samples start at its own base, so the upload is one call per
+         * texture however many sources there are. */
+        unsigned int total_samples = 0;
+        f->peak = 0.0;
+        for (unsigned int i = 0; i < n_traces; i++) {
+            trace_frame_t *tf = &f->trace[i];
+            readTrace(&traces[i], f, tf);
+            tf->base = total_samples;
+            tf->hue  = normalizeHue(fp->hue + 360.0 * i / n_traces);
+            total_samples += tf->frames_read;
+            if (fp->auto_scale) {
+                for (unsigned int k = 0; k < tf->frames_read; k++)
+                    f->peak = max(f->peak, max(fabs(tf->frames[k].left_channel),
+                                               fabs(tf->frames[k].right_channel)));
+            }
+        }
+        f->total_samples = total_samples;
+
+        /* GPU spline path: upload raw samples as textures, vertex
+         * shader does Catmull-Rom.  At spline_steps=1 the shader
+         * evaluates at t=0 per vertex, which degenerates to the raw
+         * sample positions — unifies the code path so brightness
+         * is consistent across all spline counts.  Falls back to CPU
+         * only if the shader didn't compile. */
+        f->gpu = (spline_shader_prog != 0
+                  && f->trace[0].frames_read > 4
+                  && p_glBindBuffer_ && p_glBufferData_);
+        if (spline_max_texels > 0 && total_samples > (unsigned int)spline_max_texels)
+            f->gpu = false;
+        if (f->gpu && total_samples > f->samp_alloc) {
+            free(f->pos); free(f->col);
+            f->pos = (float *)malloc(total_samples * 4 * sizeof(float));
+            f->col = (float *)malloc(total_samples * 4 * sizeof(float));
+            f->samp_alloc = total_samples;
+        }
+
+        /* Per-source DSP: the planner runs here, the transforms and
+         * color passes on the worker pool (this thread takes a share) */
+        if (fp->display_mode == DisplaySpectrumMode) {
+            for (unsigned int i = 0; i < n_traces; i++)
+                ensureFft(&traces[i], window_size);
+        }
+        dsp_current = f;
+        if (n_traces > 1)
+            workers_run(&dsp_workers, prepareJob, this, n_traces);
+        else
+            prepareTrace(&traces[0], &f->trace[0]);
+    }
+
+    /* With --dsp-depth: fill requests in order as drawPlot queues them */
+    void dspLoop()
+    {
+        unsigned int done = 0;
+        uint32_t rt_seen = 0;
+
+        while (! dsp_quit) {
+            rt_thread_poll(&realtime, &rt_seen, realtime.priority);
+            if (done == rb_load_acquire(&dsp_submitted)) {
+                notify_wait(&dsp_kick, 100000000ULL);
+                continue;
+            }
+            dspFrame(&dsp_frames[done % dsp_slots]);
+            done++;
+            rb_store_release(&dsp_completed, done);
+            notify_post(&dsp_done, done, monotonic_ns());
+        }
+    }
+
+    static void *dspThread(void *arg)
+    {
+        ((scene *) arg)->dspLoop();
+        return NULL;
+    }
+
+    static void workerRealtime(uint32_t *seen)
+    {
+        rt_thread_poll(&realtime, seen, realtime.priority);
+    }
+
+    /* --realtime, from the main loop: once the primary source is up,
+     * ask every thread to promote itself (this one included); a second
+     * later, when the lazily grown vertex buffers have reached their
+     * size, lock and fault in the memory.  Reconfiguring allocates
+     * afresh, so resizeFrameBuffers() has it locked again after. */
+    void pollRealtime()
+    {
+        if (!rt_requested) {
+            if (!ai->getThreadData()->can_process)
+                return;
+            realtime.period_ns = 1000000000ULL / frame_rate;
+            rt_request(&realtime);
+            rt_requested = true;
+            rt_lock_due  = monotonic_ns() + 1000000000ULL;
+        }
+        rt_thread_poll(&realtime, &rt_seen, realtime.priority);
+        if (rt_lock_due && monotonic_ns() >= rt_lock_due) {
+            rt_lock_due = 0;
+            lockMemory();
+        }
+    }
+
+    /* Everything with mlockall() where it works; otherwise the memory
+     * touched every frame: the live rings, windows, history blocks and
+     * DSP frames.  After a reconfiguration the previous set is unlocked
+     * first, so locked_bytes counts what is actually held. */
+    void lockMemory()
+    {
+        if (!rt_lock_all(&realtime)) {
+            rt_unlock_regions(&realtime);
+            for (unsigned int i = 0; i < n_traces; i++) {
+                trace_t *tr = &traces[i];
+                const bcast_ring_t *rb = tr->ai->getThreadData()->ringbuffer;
+                if (rb)
+                    rt_lock_region(&realtime, rb->buf, rb->size);
+                for (unsigned int k = 0; k < 3; k++)
+                    rt_lock_region(&realtime, tr->window[k].frames, window_frames * frame_size);
+                rt_lock_region(&realtime, tr->history.blocks,
+                               tr->history.n_blocks * sizeof(history_block_t));
+            }
+            for (unsigned int k = 0; k < dsp_slots; k++) {
+                dsp_frame_t *f = &dsp_frames[k];
+                for (unsigned int i = 0; i < n_traces; i++)
+                    rt_lock_region(&realtime, f->trace[i].frames,
+                                   bytes_per_buf * (lossless ? lossless_cap : 1));
+                rt_lock_region(&realtime, f->pos, f->samp_alloc * 4 * sizeof(float));
+                rt_lock_region(&realtime, f->col, f->samp_alloc * 4 * sizeof(float));
             }
         }
+        printf("Realtime: %u of %u threads promoted (%u through rtkit), %u pinned, %s\n",
+               realtime.threads_rt + realtime.threads_rtkit, realtime.threads,
+               realtime.threads_rtkit, realtime.threads_pinned,
+               realtime.locked_all ? "all memory locked"
+                                   : realtime.locked_bytes ? "hot buffers locked"
+                                                           : "memory not locked");
+    }
+
+    /* Snapshot what the DSP stage reads from the UI side, so a key
+     * press mid-frame can't give one frame two settings */
+    void queueDspFrame()
+    {
+        dsp_frame_t *f = &dsp_frames[dsp_submitted % dsp_slots];
+        f->prefs  = prefs;
+        f->offset = offset;
+        f->paused = ai->getThreadData()->pause_scope;
+        rb_store_release(&dsp_submitted, dsp_submitted + 1);
+        if (dsp_depth > 0)
+            notify_post(&dsp_kick, dsp_submitted, monotonic_ns());
+    }
+
+    /* The frame to draw now.  At depth 0 it is computed on the spot.
+     * Otherwise the queue is kept dsp_depth requests ahead of drawing,
+     * so the DSP thread fills the next frames while this one is drawn,
+     * and this only waits if it has fallen behind. */
+    dsp_frame_t *nextDspFrame()
+    {
+        if (dsp_depth == 0) {
+            queueDspFrame();
+            dsp_frame_t *f = &dsp_frames[0];
+            dspFrame(f);
+            dsp_completed = dsp_submitted;
+            dsp_drawn++;
+            return f;
+        }
+        while (dsp_submitted - dsp_drawn <= (unsigned int) dsp_depth)
+            queueDspFrame();
+        while (rb_load_acquire(&dsp_completed) == dsp_drawn)
+            notify_wait(&dsp_done, 1000000000ULL / frame_rate);
+        return &dsp_frames[dsp_drawn++ % dsp_slots];
+    }
+
+    /* Wait until every queued request has been filled */
+    void dspDrain()
+    {
+        while (rb_load_acquire(&dsp_completed) != dsp_submitted)
+            notify_wait(&dsp_done, 1000000ULL);
+    }
+
+    void drawPlot()
+    {
+        /* this frame's samples and DSP results, computed now or (with
+         * --dsp-depth) while the previous frames were being drawn */
+        dsp_frame_t *f = nextDspFrame();
+        unsigned int window_size  = f->window_size;
+        unsigned int overlap_size = f->overlap_size;
+        double dt = f->trace[0].dt;
+
+
+        /* the DSP stage prescanned the samples for their peak */
+        if (f->prefs.auto_scale)
+            autoScale(f->peak);
+
+
+        /* set up the OpenGL */
+        glMatrixMode(GL_PROJECTION);
+        glLoadIdentity();
+
+        glOrtho(prefs.side[3], prefs.side[2],
+                 prefs.side[1], prefs.side[0],
+                 -10.0, 10.0);
+        glMatrixMode(GL_MODELVIEW);
+        glPushMatrix();
+        glLoadIdentity();
+        if (f->prefs.particles) {
+            glPointSize((GLfloat) f->prefs.line_width);
+        }
+        else {
+            glLineWidth((GLfloat) f->prefs.line_width);
+        }
 
         /* Particles: depth test rejects overlapping fragments before
          * they reach the ROP — Hi-Z early rejection.  Alpha blend
          * gives soft edges for the one fragment that survives.
          * Lines: additive blending for glowy accumulation. */
-        if (prefs.particles) {
+        if (f->prefs.particles) {
             glClear(GL_DEPTH_BUFFER_BIT);
             glEnable(GL_DEPTH_TEST);
             glDepthFunc(GL_LESS);
             glEnable(GL_BLEND);
             glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
         }
-        else if (prefs.velocity_dim > 0.0) {
+        else if (f->prefs.velocity_dim > 0.0) {
             glEnable(GL_BLEND);
             glBlendFunc(GL_SRC_ALPHA, GL_ONE);
         }
 
-        /* GPU spline path: upload raw samples as textures, vertex
-         * shader does Catmull-Rom.  At spline_steps=1 the shader
-         * evaluates at t=0 per vertex, which degenerates to the raw
-         * sample positions — unifies the code path so brightness
-         * is consistent across all spline counts.  Falls back to CPU
-         * only if the shader didn't compile. */
-        bool use_gpu_spline = (spline_shader_prog != 0
-                               && frames_read > 4
-                               && p_glBindBuffer_ && p_glBufferData_);
+        bool use_gpu_spline = f->gpu;
+        unsigned int total_samples = f->total_samples;
+        const float *s_pos = f->pos;
+        const float *s_col = f->col;
 
         if (use_gpu_spline) {
-            /* Compute per-sample colors on CPU (~1600 iterations) */
-            static float *s_pos = NULL;
-            static float *s_col = NULL;
-            static unsigned int s_samp_alloc = 0;
-            if (frames_read > s_samp_alloc) {
-                free(s_pos); free(s_col);
-                s_pos = (float *)malloc(frames_read * 4 * sizeof(float));
-                s_col = (float *)malloc(frames_read * 4 * sizeof(float));
-                s_samp_alloc = frames_read;
-            }
-
-            unsigned int spl_stride = (window_size > overlap_size) ? (window_size - overlap_size) : 1;
-            double h = -1.0, s = 1.0, v = 1.0, a = 1.0;
-            double r = 1.0, g = 1.0, b = 1.0;
-            double olc = 0.0, orc = 0.0;
-            if (prefs.display_mode == DisplayStandardMode)
-                HSVtoRGB(&r, &g, &b, prefs.hue, s, v);
-
-            for (unsigned int i = 0; i < frames_read; i++) {
-                double lc = framebuf[i].left_channel;
-                double rc = framebuf[i].right_channel;
-                double d = hypot(lc - olc, rc - orc) / SQRT_TWO;
-                if (prefs.velocity_dim > 0.0)
-                    a = 1.0 / (1.0 + d * 10.0 * prefs.velocity_dim * prefs.scale_factor);
-                else
-                    a = 1.0;
-
-                bool color_set = false;
-                switch (prefs.display_mode) {
-                    case DisplayStandardMode: break;
-                    case DisplayRadiusMode:
-                        h = ((hypot(lc, rc) / SQRT_TWO) * 360.0 * prefs.color_range * prefs.scale_factor) + prefs.hue;
-                        break;
-                    case DisplaySpectrumMode:
-                        if (spectrum_colors) {
-                            unsigned int w = i / spl_stride;
-                            double sr = spectrum_colors[w * 3 + 0];
-                            double sg = spectrum_colors[w * 3 + 1];
-                            double sb = spectrum_colors[w * 3 + 2];
-                            double sh, ss, sv;
-                            RGBtoHSV(sr, sg, sb, &sh, &ss, &sv);
-                            ss *= 1.25; if (ss > 1.0) ss = 1.0;
-                            double v_floor = 0.5 / prefs.brightness;
-                            if (v_floor > 0.5) v_floor = 0.5;
-                            sv = sv * (1.0 - v_floor) + v_floor;
-                            HSVtoRGB(&r, &g, &b, sh, ss, sv);
-                            color_set = true;
-                        }
-                        break;
-                }
-                if (!color_set) {
-                    if (h > -1.0 && prefs.display_mode != DisplayStandardMode)
-                        h = normalizeHue(h);
-                    if (h > -1.0)
-                        HSVtoRGB(&r, &g, &b, h, s, v);
-                    else if (prefs.velocity_dim > 0.0)
-                        HSVtoRGB(&r, &g, &b, prefs.hue, s, v);
-                }
-
-                s_pos[i * 4 + 0] = (float)lc;
-                s_pos[i * 4 + 1] = (float)rc;
-                s_pos[i * 4 + 2] = 0.0f;
-                s_pos[i * 4 + 3] = 0.0f;
-                s_col[i * 4 + 0] = (float)(r * prefs.brightness);
-                s_col[i * 4 + 1] = (float)(g * prefs.brightness);
-                s_col[i * 4 + 2] = (float)(b * prefs.brightness);
-                s_col[i * 4 + 3] = (float)a;
-                olc = lc; orc = rc;
-            }
-
             /* Double-buffered texture upload: alternate between
              * two texture pairs each frame so this frame's upload
              * doesn't stall waiting for last frame's draw to finish
@@ -855,27 +1721,31 @@ public:
 
             p_glActiveTexture(GL_TEXTURE0);
             glBindTexture(GL_TEXTURE_1D, spline_pos_tex[tex]);
-            if (frames_read > s_tex_alloc[tex]) {
-                glTexImage1D(GL_TEXTURE_1D, 0, GL_RGBA16F, frames_read, 0, GL_RGBA, GL_FLOAT, s_pos);
+            if (total_samples > s_tex_alloc[tex]) {
+                glTexImage1D(GL_TEXTURE_1D, 0, GL_RGBA16F, total_samples, 0, GL_RGBA, GL_FLOAT, s_pos);
                 glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
                 glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
                 p_glActiveTexture(GL_TEXTURE1);
                 glBindTexture(GL_TEXTURE_1D, spline_col_tex[tex]);
-                glTexImage1D(GL_TEXTURE_1D, 0, GL_RGBA16F, frames_read, 0, GL_RGBA, GL_FLOAT, s_col);
+                glTexImage1D(GL_TEXTURE_1D, 0, GL_RGBA16F, total_samples, 0, GL_RGBA, GL_FLOAT, s_col);
                 glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
                 glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-                s_tex_alloc[tex] = frames_read;
+                s_tex_alloc[tex] = total_samples;
             } else {
-                glTexSubImage1D(GL_TEXTURE_1D, 0, 0, frames_read, GL_RGBA, GL_FLOAT, s_pos);
+                glTexSubImage1D(GL_TEXTURE_1D, 0, 0, total_samples, GL_RGBA, GL_FLOAT, s_pos);
                 p_glActiveTexture(GL_TEXTURE1);
                 glBindTexture(GL_TEXTURE_1D, spline_col_tex[tex]);
-                glTexSubImage1D(GL_TEXTURE_1D, 0, 0, frames_read, GL_RGBA, GL_FLOAT, s_col);
+                glTexSubImage1D(GL_TEXTURE_1D, 0, 0, total_samples, GL_RGBA, GL_FLOAT, s_col);
             }
 
-            /* Ensure index VBO is large enough.  Standard Catmull-Rom:
-             * (frames_read - 3) usable segments, spline_steps verts each,
-             * plus 1 for the final endpoint. */
-            unsigned int n_spline_verts = (frames_read - 3) * prefs.spline_steps + 1;
+            /* Ensure index VBO is large enough for the longest trace.
+             * Standard Catmull-Rom: (frames_read - 3) usable segments,
+             * spline_steps verts each, plus 1 for the final endpoint.
+             * Every trace draws from the same index buffer. */
+            size_t longest = 0;
+            for (unsigned int i = 0; i < n_traces; i++)
+                longest = max(longest, f->trace[i].frames_read);
+            unsigned int n_spline_verts = (longest - 3) * f->prefs.spline_steps + 1;
             if (n_spline_verts > spline_index_alloc) {
                 float *indices = (float *)malloc(n_spline_verts * 2 * sizeof(float));
                 for (unsigned int i = 0; i < n_spline_verts; i++) {
@@ -895,13 +1765,23 @@ public:
             p_glUseProgram(spline_shader_prog);
             p_glUniform1i(spline_loc_positions, 0);
             p_glUniform1i(spline_loc_colors, 1);
-            p_glUniform1f(spline_loc_num_samples, (float)frames_read);
-            p_glUniform1f(spline_loc_spline_steps, (float)prefs.spline_steps);
+            p_glUniform1f(spline_loc_num_samples, (float)s_tex_alloc[tex]);
+            p_glUniform1f(spline_loc_spline_steps, (float)f->prefs.spline_steps);
 
             glEnableClientState(GL_VERTEX_ARRAY);
             p_glBindBuffer_(GL_ARRAY_BUFFER, spline_index_vbo);
             glVertexPointer(2, GL_FLOAT, 0, 0);
-            glDrawArrays(prefs.particles ? GL_POINTS : GL_LINE_STRIP, 0, n_spline_verts);
+            vertex_count = 0;
+            for (unsigned int i = 0; i < n_traces; i++) {
+                if (f->trace[i].frames_read <= 4)
+                    continue;
+                unsigned int n_verts = (f->trace[i].frames_read - 3) * f->prefs.spline_steps + 1;
+                p_glUniform1f(spline_loc_base, (float)f->trace[i].base);
+                pushTraceTransform(i);
+                glDrawArrays(f->prefs.particles ? GL_POINTS : GL_LINE_STRIP, 0, n_verts);
+                glPopMatrix();
+                vertex_count += n_verts;
+            }
             p_glBindBuffer_(GL_ARRAY_BUFFER, 0);
             glDisableClientState(GL_VERTEX_ARRAY);
 
@@ -910,41 +1790,54 @@ public:
             glBindTexture(GL_TEXTURE_1D, 0);
             p_glActiveTexture(GL_TEXTURE0);
             glBindTexture(GL_TEXTURE_1D, 0);
-
-            vertex_count = n_spline_verts;
         } else {
             /* CPU fallback */
-            bool gpu_color = (prefs.display_mode == DisplaySpectrumMode
+            bool gpu_color = (f->prefs.display_mode == DisplaySpectrumMode
                               && spectrum_shader_prog != 0);
             if (gpu_color) {
                 p_glUseProgram(spectrum_shader_prog);
-                p_glUniform1f(spectrum_brightness_loc, (float)prefs.brightness);
+                p_glUniform1f(spectrum_brightness_loc, (float)f->prefs.brightness);
             }
 
-            vertex_count = draw_xy_vertices(
-                framebuf, frames_read,
-                prefs.display_mode, prefs.color_mode,
-                prefs.hue, prefs.color_range, prefs.scale_factor,
-                prefs.spline_steps,
-                window_size, overlap_size,
-                prefs.brightness, prefs.velocity_dim,
-                spectrum_colors,
-                prefs.particles,
-                gpu_color);
+            vertex_count = 0;
+            for (unsigned int i = 0; i < n_traces; i++) {
+                pushTraceTransform(i);
+                vertex_count += draw_xy_vertices(
+                    f->trace[i].frames, f->trace[i].frames_read,
+                    f->prefs.display_mode, f->prefs.color_mode,
+                    f->trace[i].hue, f->prefs.color_range, f->prefs.scale_factor,
+                    f->prefs.spline_steps,
+                    window_size, overlap_size,
+                    f->prefs.brightness, f->prefs.velocity_dim,
+                    f->trace[i].spectrum_colors,
+                    f->prefs.particles,
+                    gpu_color);
+                glPopMatrix();
+            }
 
             if (gpu_color)
                 p_glUseProgram(0);
         }
 
-        if (prefs.particles) {
+        if (f->prefs.particles) {
             glDisable(GL_DEPTH_TEST);
             glDisable(GL_BLEND);
         }
-        else if (prefs.velocity_dim > 0.0)
+        else if (f->prefs.velocity_dim > 0.0)
             glDisable(GL_BLEND);
         glPopMatrix();
-        if (prefs.display_mode == DisplaySpectrumMode)
-            delete[] spectrum_colors;
+        for (unsigned int i = 0; i < n_traces; i++) {
+            delete[] f->trace[i].spectrum_colors;
+            f->trace[i].spectrum_colors = NULL;
+        }
+
+        /* age of the newest sample drawn, from its block's capture time */
+        unsigned long long captured = f->trace[0].newest_ns;
+        if (captured) {
+            unsigned long long now = monotonic_ns();
+            latency_add(&latency, now > captured ? (now - captured) * 1e-3f : 0.0f);
+        }
+
 
         switch (prefs.color_mode) {
             case ColorStandardMode:
@@ -1114,6 +2007,7 @@ public:
         { "g and G",           "Adjust bloom radius" },
         { "j/k and J/K",       "Adjust display delay" },
         { "n/m and N/M",       "Adjust velocity dim" },
+        { "o",                 "Cycle buffering profile" },
         { "r",                 "Recenter" },
         { "s and S",           "Show/Hide statistics" },
         { "w and W",           "Adjust line width" },
@@ -1160,6 +2054,22 @@ public:
         }
     }
 
+    /* The primary source's drop counters, see drop_counts_t */
+    void dropCounts(drop_counts_t *d)
+    {
+        const thread_data_t *t_data = traces[0].ai->getThreadData();
+        d->xruns        = t_data->xruns;
+        d->xrun_frames  = t_data->xrun_frames;
+        d->drained      = t_data->drained;
+        d->dropped      = t_data->dropped;
+        d->overruns     = traces[0].history.reader.overruns + traces[0].reader.overruns
+                        + t_data->raw_reader.overruns + traces[0].catchup.overruns;
+        d->lost         = traces[0].history.reader.lost / frame_size + t_data->raw_lost
+                        + t_data->shm_lost + traces[0].catchup.lost / frame_size;
+        d->tags_dropped = t_data->tags_dropped;
+        d->advance      = &traces[0].advance;
+    }
+
     void drawStats()
     {
         thread_data_t *t_data = ai->getThreadData();
@@ -1169,6 +2079,21 @@ public:
         char fps_string[64];
         char vps_string[64];
         char time_string[64];
+        char wake_string[64];
+        char window_string[64];
+        char ring_string[64];
+        char format_string[64];
+#if !defined(__APPLE__) && !defined(_WIN32)
+        char quantum_string[64];
+#endif
+        char clock_string[80];
+        char xrun_string[128];
+        char lost_string[96];
+        char backlog_string[96];
+        char rt_string[96];
+        char lock_string[64];
+        notify_t *wake = &t_data->data_ready;
+        const triple_t *windows = &traces[0].windows;
 
         /* Frame counting — always runs, needed by frame rate limiter */
         gettimeofday(&this_frame_time, NULL);
@@ -1178,6 +2103,18 @@ public:
             fps = frame_count / elapsed_time;
             reset_frame_time = this_frame_time;
             frame_count = 0;
+            wake_max = wake->lat_max_ns * 0.001;
+            wake->lat_max_ns = 0;
+            latency_p50 = latency_percentile(&latency, 0.5);
+            latency_p99 = latency_percentile(&latency, 0.99);
+            latency_max = ::latency_max(&latency);
+            if (metrics_file && ! t_data->pause_scope) {
+                drop_counts_t drops;
+                dropCounts(&drops);
+                latency_dump(metrics_file, &latency, monotonic_ns(), fps,
+                             wake->lat_avg_ns * 0.001, wake_max, wake->lost,
+                             windows->dropped, windows->repeated, &drops);
+            }
         }
         last_frame_time = this_frame_time;
 
@@ -1188,19 +2125,95 @@ public:
             drawString(-80.0, -100.0, vps_string);
         }
 
-        /* calculate latency */
-        gettimeofday(&this_frame_time, NULL);
-        elapsed_time = timeDiff(t_data->last_write, this_frame_time);
-        if (elapsed_time > latency)
-            latency = elapsed_time;
-        else
-            smooth(&latency, elapsed_time, 0.01);
-        if (latency < 0.0)
-            latency = 0.0;
-        if (! t_data->pause_scope) {
-            snprintf(time_string, sizeof(time_string), "%.0f usec", latency * 100000.0);
+        /* capture-to-draw latency of the newest sample on screen, over
+         * the last LATENCY_WINDOW frames */
+        if (! t_data->pause_scope && latency.n > 0) {
+            snprintf(time_string, sizeof(time_string), "%.1f / %.1f / %.1f ms",
+                     latency_p50 * 0.001, latency_p99 * 0.001, latency_max * 0.001);
             drawString(-80.0, 60.0, time_string);
         }
+
+        /* acquisition-thread wakeups: average / worst latency from the
+         * capture callback's post, and wakes that only came via the
+         * timeout.  Then the windows it published that were replaced
+         * before drawPlot took one, and frames that redrew the last.  Then
+         * how often a ring's writer lapped the history's cursor, the raw
+         * capture cursor, or tore a window mid-copy.  And what the primary
+         * source's callback is actually handed, and (Pipewire) the graph
+         * quantum and rate it runs at, live.  Last, the samples per
+         * refresh the clock recovery has measured, and its drift from
+         * sample_rate / frame_rate. */
+        if (! t_data->pause_scope && (show_intro || (prefs.show_stats > 0 && prefs.show_stats < 3))) {
+            snprintf(wake_string, sizeof(wake_string), "wake %.0f/%.0f usec, %llu lost",
+                     wake->lat_avg_ns * 0.001, wake_max, wake->lost);
+            drawString(-80.0, 120.0, wake_string);
+            snprintf(window_string, sizeof(window_string), "windows %llu dropped, %llu repeated",
+                     windows->dropped, windows->repeated);
+            drawString(-80.0, 180.0, window_string);
+            snprintf(ring_string, sizeof(ring_string), "ring %llu overruns",
+                     traces[0].history.reader.overruns + traces[0].reader.overruns
+                     + t_data->raw_reader.overruns + traces[0].catchup.overruns);
+            drawString(-80.0, 240.0, ring_string);
+            snprintf(format_string, sizeof(format_string), "%s %u ch %d Hz",
+                     sample_format_name(t_data->sample_format), t_data->channels,
+                     t_data->negotiated_sample_rate > 0 ? t_data->negotiated_sample_rate
+                                                        : capture_rate);
+            drawString(-80.0, 300.0, format_string);
+#if !defined(__APPLE__) && !defined(_WIN32)
+            if (t_data->graph_quantum) {
+                snprintf(quantum_string, sizeof(quantum_string), "quantum %u @ %u Hz, %s",
+                         t_data->graph_quantum, t_data->graph_rate, pw_profile.name);
+                drawString(-80.0, 360.0, quantum_string);
+            }
+#endif
+            snprintf(clock_string, sizeof(clock_string), "%.3f frames/refresh, %+.0f ppm, %llu relocks",
+                     traces[0].clock.rate, clock_dll_ppm(&traces[0].clock), traces[0].clock.relocks);
+            drawString(-80.0, 420.0, clock_string);
+
+            /* drop accounting: frames lost before the ring (device or
+             * graph xruns, a full ring or tag ring), in it (lapped before
+             * the history or raw drain got them), and between it and the
+             * screen (window advance) */
+            drop_counts_t drops;
+            dropCounts(&drops);
+            snprintf(xrun_string, sizeof(xrun_string), "xruns %llu (%llu frames), %llu drained, %llu frames dropped, %llu tags dropped",
+                     drops.xruns, drops.xrun_frames, drops.drained, drops.dropped, drops.tags_dropped);
+            drawString(-80.0, 480.0, xrun_string);
+            snprintf(lost_string, sizeof(lost_string), "%llu lost, %llu skipped, %llu repeated, %llu clamped",
+                     drops.lost, drops.advance->skipped, drops.advance->repeated, drops.advance->clamped);
+            drawString(-80.0, 540.0, lost_string);
+            double y = 600.0;
+            if (lossless) {
+                snprintf(backlog_string, sizeof(backlog_string), "backlog %llu frames (%.0f ms), max %llu, %llu grown",
+                         drops.advance->backlog, drops.advance->backlog * 1000.0 / sample_rate,
+                         drops.advance->backlog_max, drops.advance->grown);
+                drawString(-80.0, y, backlog_string);
+                y += 60.0;
+            }
+
+            /* --realtime: what the OS granted, see xyscope-realtime.h */
+            if (realtime.enabled) {
+                snprintf(rt_string, sizeof(rt_string), "realtime %u/%u threads (%u rtkit), %u pinned",
+                         realtime.threads_rt + realtime.threads_rtkit, realtime.threads,
+                         realtime.threads_rtkit, realtime.threads_pinned);
+                if (realtime.threads_rt + realtime.threads_rtkit < realtime.threads
+                    || (realtime.cpu_mask && realtime.threads_pinned < realtime.threads)) {
+                    size_t len = strlen(rt_string);
+                    snprintf(rt_string + len, sizeof(rt_string) - len, " (error %d/%d)",
+                             realtime.sched_errno, realtime.pin_errno);
+                }
+                drawString(-80.0, y, rt_string);
+                if (realtime.locked_all)
+                    snprintf(lock_string, sizeof(lock_string), "memory locked");
+                else if (realtime.locked_bytes)
+                    snprintf(lock_string, sizeof(lock_string), "%.1f MB locked (error %d)",
+                             realtime.locked_bytes / 1048576.0, realtime.lock_errno);
+                else
+                    snprintf(lock_string, sizeof(lock_string), "memory %s",
+                             rt_lock_due || !rt_requested ? "not locked yet" : "not locked");
+                drawString(-80.0, y + 60.0, lock_string);
+            }
+        }
     }
 
     void drawText(void)
@@ -1237,8 +2250,10 @@ public:
             if (text_timer[i].show)
                 show_timer = true;
         }
-        if (show_intro || show_help || show_timer || prefs.show_stats) {
+        if (show_intro || show_help || show_timer || prefs.show_stats || t_data->pause_scope) {
             beginText();
+            if (t_data->pause_scope)
+                drawTimeline();
             if (show_intro || show_help)
                 drawHelp();
             if (show_timer)
@@ -1249,6 +2264,137 @@ public:
         }
     }
 
+    /* Overview of the whole rewind history while paused.  Each column
+     * is one O(log n) pyramid query, so drawing it never touches the
+     * samples themselves; the current window is highlighted.  Shows
+     * the primary source. */
+    void drawTimeline()
+    {
+        const history_t *history = &traces[0].history;
+        long long begin = history_begin(history);
+        long long end   = traces[0].pause_anchor;
+        if (end <= begin)
+            return;
+
+        if (begin != timeline_begin || end != timeline_end) {
+            float peak = 0.0f;
+            for (int i = 0; i < TIMELINE_COLUMNS; i++) {
+                long long s = begin + (end - begin) * i / TIMELINE_COLUMNS;
+                long long e = begin + (end - begin) * (i + 1) / TIMELINE_COLUMNS;
+                pyramid_node_t n;
+                float p = 0.0f, r = 0.0f;
+                if (history_summary(history, s, e, &n)) {
+                    p = max(max(-n.min[0], n.max[0]), max(-n.min[1], n.max[1]));
+                    r = sqrtf(0.5f * (n.ms[0] + n.ms[1]));
+                }
+                timeline_peak[i] = p;
+                timeline_rms[i]  = r;
+                if (p > peak)
+                    peak = p;
+            }
+            /* normalize so quiet material is still visible */
+            for (int i = 0; peak > 0.0f && i < TIMELINE_COLUMNS; i++) {
+                timeline_peak[i] /= peak;
+                timeline_rms[i]  /= peak;
+            }
+            timeline_begin = begin;
+            timeline_end   = end;
+        }
+
+        double mid  = (TIMELINE_TOP + TIMELINE_BOTTOM) / 2.0;
+        double half = (TIMELINE_TOP - TIMELINE_BOTTOM) / 2.0;
+        double col  = (TIMELINE_RIGHT - TIMELINE_LEFT) / TIMELINE_COLUMNS;
+
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glLineWidth(1.0f);
+
+        glColor4f(0.0f, 0.0f, 0.0f, 0.6f);
+        glBegin(GL_QUADS);
+        glVertex2d(TIMELINE_LEFT,  TIMELINE_BOTTOM);
+        glVertex2d(TIMELINE_RIGHT, TIMELINE_BOTTOM);
+        glVertex2d(TIMELINE_RIGHT, TIMELINE_TOP);
+        glVertex2d(TIMELINE_LEFT,  TIMELINE_TOP);
+        glEnd();
+
+        glBegin(GL_LINES);
+        for (int i = 0; i < TIMELINE_COLUMNS; i++) {
+            double x = TIMELINE_LEFT + (i + 0.5) * col;
+            glColor4f(0.4f, 0.4f, 0.4f, 1.0f);
+            glVertex2d(x, mid - timeline_peak[i] * half);
+            glVertex2d(x, mid + timeline_peak[i] * half);
+            glColor4f(0.8f, 0.8f, 0.8f, 1.0f);
+            glVertex2d(x, mid - timeline_rms[i] * half);
+            glVertex2d(x, mid + timeline_rms[i] * half);
+        }
+        glEnd();
+
+        /* the window currently on screen */
+        double span  = (double)(end - begin);
+        long long we = end + offset + frames_per_buf;
+        double x0 = TIMELINE_LEFT + (TIMELINE_RIGHT - TIMELINE_LEFT)
+                                    * (double)(we - draw_frames - begin) / span;
+        double x1 = TIMELINE_LEFT + (TIMELINE_RIGHT - TIMELINE_LEFT)
+                                    * (double)(we - begin) / span;
+        if (x1 - x0 < col) {
+            x0 -= col / 2.0;
+            x1  = x0 + col;
+        }
+        glColor4f(1.0f, 1.0f, 1.0f, 0.35f);
+        glBegin(GL_QUADS);
+        glVertex2d(x0, TIMELINE_BOTTOM);
+        glVertex2d(x1, TIMELINE_BOTTOM);
+        glVertex2d(x1, TIMELINE_TOP);
+        glVertex2d(x0, TIMELINE_TOP);
+        glEnd();
+
+        glDisable(GL_BLEND);
+    }
+
+    /* Timeline position (0..1, clamped) under window x, in points */
+    double timelinePos(int x)
+    {
+        int w = 0, h = 0;
+        SDL_GetWindowSize(window, &w, &h);
+        if (w < 1)
+            return 0.0;
+        double nx  = 2.0 * x / w - 1.0;
+        double pos = (nx - TIMELINE_LEFT) / (TIMELINE_RIGHT - TIMELINE_LEFT);
+        return pos < 0.0 ? 0.0 : pos > 1.0 ? 1.0 : pos;
+    }
+
+    bool inTimeline(int x, int y)
+    {
+        thread_data_t *t_data = ai->getThreadData();
+        int w = 0, h = 0;
+        if (! t_data->pause_scope || dj_mode)
+            return false;
+        SDL_GetWindowSize(window, &w, &h);
+        if (w < 1 || h < 1)
+            return false;
+        double nx = 2.0 * x / w - 1.0;
+        double ny = 1.0 - 2.0 * y / h;
+        return nx >= TIMELINE_LEFT && nx <= TIMELINE_RIGHT
+            && ny >= TIMELINE_BOTTOM && ny <= TIMELINE_TOP;
+    }
+
+    /* Centre the paused window on timeline position pos */
+    void seekTimeline(double pos)
+    {
+        long long begin  = history_begin(&traces[0].history);
+        long long pause_anchor = traces[0].pause_anchor;
+        long long target = begin + (long long)(pos * (double)(pause_anchor - begin))
+                         + draw_frames / 2;
+        long long o  = target - pause_anchor - frames_per_buf;
+        long long lo = begin + draw_frames - pause_anchor - frames_per_buf;
+        if (o > -frames_per_buf)
+            o = -frames_per_buf;
+        if (o < lo)
+            o = lo;
+        offset = (int)o;
+        showCounter(TIMED);
+    }
+
     void showTimedText(int timer_idx, bool auto_pos, bool timed, const char *fmt, ...)
     {
         text_timer_t *timer = &text_timer[timer_idx];
@@ -1287,8 +2433,21 @@ public:
 #endif
     }
     void showVelocityDim(bool t) { showTimedText(VelocityDimTimer, true, t, "Velocity dim: %.1f", prefs.velocity_dim); }
-    void showSampleRate(bool t) { showTimedText(SampleRateTimer, true, t, "Sample rate: %d Hz", sample_rate); }
+    void showSampleRate(bool t)
+    {
+        if (capture_rate != sample_rate)
+            showTimedText(SampleRateTimer, true, t, "Sample rate: %d Hz (%d Hz decimated)",
+                          capture_rate, sample_rate);
+        else
+            showTimedText(SampleRateTimer, true, t, "Sample rate: %d Hz", sample_rate);
+    }
     void showFrameRate(bool t) { showTimedText(FrameRateTimer, true, t, "Frame rate: %d fps", frame_rate); }
+    void showBuffering(bool t)
+    {
+        showTimedText(BufferingTimer, true, t, "Buffering: %s, %.0f s, %dx%s",
+                      app.profile[0] ? app.profile : "default", buffer_seconds,
+                      draw_each_frame, limit_frame_rate ? "" : ", unlimited");
+    }
 
     /* Other timers */
     void showPaused(bool t) { showTimedText(PausedTimer, true, t, "Paused"); }
@@ -1322,18 +2481,9 @@ public:
         mouse_is_dirty = true;
     }
 
-    void autoScale()
+    /* mv: the frame's largest |sample|, from dspFrame() */
+    void autoScale(double mv)
     {
-        double lc = 0.0;
-        double rc = 0.0;
-        double mv = 0.0;
-        double mt = 0.0;
-        for (unsigned int i = 0; i < frames_read; i++) {
-            lc = fabs(framebuf[i].left_channel);
-            rc = fabs(framebuf[i].right_channel);
-            mt = max(lc, rc);
-            mv = max(mv, mt);
-        }
         if (mv > max_sample_value)
             max_sample_value = mv;
         else if (mv < max_sample_value * (1.0 / 3.0))
@@ -1456,19 +2606,51 @@ public:
     void togglePaused(void)
     {
         thread_data_t *t_data = ai->getThreadData();
-        if (t_data->pause_scope) {
-            latency = 0.0;
+        bool paused = ! t_data->pause_scope;
+        uint64_t now = monotonic_ns();
+
+        /* frames queued while paused read the history, which is the
+         * acquisition threads' again once they see the resume */
+        if (! paused)
+            dspDrain();
+        for (unsigned int i = 0; i < n_traces; i++) {
+            thread_data_t *td = traces[i].ai->getThreadData();
+            td->pause_scope = paused;
+            td->last_write  = now;
+        }
+
+        if (! paused) {
+            latency_reset(&latency);
             text_timer[CounterTimer].show = false;
             text_timer[PausedTimer].show  = false;
+            return;
         }
-        else {
-            offset = -frames_per_buf;
-            bump   = -draw_frames;
-            showCounter(TIMED);
-            showPaused(TIMED);
+
+        /* Each acquisition thread sets acquire_busy before it checks
+         * pause_scope, and we set pause_scope before checking busy, so
+         * once busy reads clear it has seen the pause and the history
+         * is ours until resume.  At most one window's wait. */
+        notify_fence();
+        for (unsigned int i = 0; i < n_traces; i++) {
+            while (notify_load(&traces[i].acquire_busy))
+                usleep(50);
+        }
+
+        /* the newest frames may still be in a partial history block */
+        offset = -frames_per_buf;
+        for (unsigned int i = 0; i < n_traces; i++) {
+            trace_t *tr = &traces[i];
+            long long end = history_end(&tr->history);
+            tr->pause_anchor = tr->live_end < end ? tr->live_end : end;
         }
-        t_data->pause_scope = ! t_data->pause_scope;
-        gettimeofday(&t_data->last_write, NULL);
+        showCounter(TIMED);
+        showPaused(TIMED);
+    }
+
+    void quitNow(void)
+    {
+        for (unsigned int i = 0; i < n_traces; i++)
+            traces[i].ai->quitNow();
     }
 
     void recenter(void)
@@ -1517,7 +2699,7 @@ public:
     void nextStatsGroup(void)
     {
         // thread_data_t *t_data = ai->getThreadData();
-        // gettimeofday(&t_data->last_write, NULL);
+        // t_data->last_write = monotonic_ns();
         // latency = 0.0;
         prefs.show_stats++;
         if (prefs.show_stats > 3)
@@ -1536,11 +2718,11 @@ public:
     {
         thread_data_t *t_data = ai->getThreadData();
         if (t_data->pause_scope) {
-            int step = (frames_per_buf / DRAW_EACH_FRAME) * nbufs;
-            if ((offset - step) >= -default_rb_size) {
+            int step = (frames_per_buf / draw_each_frame) * nbufs;
+            long long start = traces[0].pause_anchor + (offset - step)
+                            + frames_per_buf - draw_frames;
+            if (start >= history_oldest(&traces[0].history))
                 offset -= step;
-                bump   -= step;
-            }
             showCounter(TIMED);
         }
     }
@@ -1549,11 +2731,9 @@ public:
     {
         thread_data_t *t_data = ai->getThreadData();
         if (t_data->pause_scope) {
-            int step = (frames_per_buf / DRAW_EACH_FRAME) * nbufs;
-            if (offset < -step) {
+            int step = (frames_per_buf / draw_each_frame) * nbufs;
+            if (offset < -step)
                 offset += step;
-                bump   += step;
-            }
             showCounter(TIMED);
         }
     }
@@ -1969,11 +3149,12 @@ static const char *SPLINE_VS_SRC =
     "uniform sampler1D u_colors;\n"
     "uniform float u_num_samples;\n"
     "uniform float u_spline_steps;\n"
+    "uniform float u_base;\n"
     "void main() {\n"
     "    float idx = gl_Vertex.x;\n"
     "    float seg = floor(idx / u_spline_steps);\n"
     "    float t = idx / u_spline_steps - seg;\n"
-    "    seg += 1.0;\n"
+    "    seg += u_base + 1.0;\n"
     "    float inv_n = 1.0 / u_num_samples;\n"
     "    vec4 s0 = texture1DLod(u_positions, (seg - 1.0 + 0.5) * inv_n, 0.0);\n"
     "    vec4 s1 = texture1DLod(u_positions, (seg + 0.5) * inv_n, 0.0);\n"
@@ -2053,7 +3234,7 @@ void idle(void)
         scn.mouse_is_dirty = false;
     }
 
-    if (RESPONSIBLE_FOR_FRAME_RATE) {
+    if (limit_frame_rate) {
         /* limit our framerate to frame_rate (e.g. 60) frames per second */
         elapsed_time = timeDiff(scn.reset_frame_time, scn.last_frame_time);
         if (elapsed_time < (scn.frame_count / (double) frame_rate)) {
@@ -2116,7 +3297,7 @@ void keyboard(unsigned char key, int xPos, int yPos)
 {
     switch (key) {
         case 27:                         /* escape */
-            scn.ai->quitNow();
+            scn.quitNow();
             exit(0);
         case '0': case '1': case '2': case '3': case '4':
         case '5': case '6': case '7': case '8': case '9':
@@ -2284,6 +3465,9 @@ void keyboard(unsigned char key, int xPos, int yPos)
         case 'M':
             scn.setVelocityDim(scn.prefs.velocity_dim + 0.1);
             break;
+        case 'o':
+            scn.cycleBufferProfile();
+            break;
         case '`':
             scn.loadDefaults();
             break;
@@ -2302,7 +3486,14 @@ void mouse(int button, int state, int x, int y)
     scn.mouse[0] = x;
     scn.mouse[1] = y;
     scn.mouse[2] = button;
-    if (button == 3 && state == 1) {
+    if (button == 0 && state == 0 && scn.inTimeline(x, y)) {
+        scn.scrubbing = true;
+        scn.seekTimeline(scn.timelinePos(x));
+    }
+    else if (button == 0 && state == 1) {
+        scn.scrubbing = false;
+    }
+    else if (button == 3 && state == 1) {
         scn.zoomIn();
     }
     else if (button == 4 && state == 1) {
@@ -2315,7 +3506,10 @@ void motion(int x, int y)
 {
     int dx = (int) (x - scn.mouse[0]);
     int dy = (int) (y - scn.mouse[1]);
-    if (scn.mouse[2] == 0) {
+    if (scn.scrubbing) {
+        scn.seekTimeline(scn.timelinePos(x));
+    }
+    else if (scn.mouse[2] == 0) {
         scn.move(0, - (double) dy / (double) scn.prefs.dim[1]);
         scn.move(1,   (double) dx / (double) scn.prefs.dim[0]);
     }
@@ -2401,12 +3595,56 @@ int main(int argc, char *argv[])
         }
 #if !defined(__APPLE__) && !defined(_WIN32)
         else if ((!strcmp(argv[i], "-t") || !strcmp(argv[i], "--target")) && i + 1 < argc) {
-            snprintf(scn.app.target, sizeof(scn.app.target), "%s", argv[++i]);
+            /* the first target is also remembered for next time */
+            const char *target = argv[++i];
+            bool first = true;
+            for (unsigned int s = 0; s < n_sources; s++)
+                first = first && (sources[s].file || sources[s].shm);
+            if (first)
+                snprintf(scn.app.target, sizeof(scn.app.target), "%s", target);
+            if (n_sources < MAX_SOURCES) {
+                sources[n_sources].target = target;
+                sources[n_sources].file   = NULL;
+                sources[n_sources].shm    = NULL;
+                n_sources++;
+            }
+            else
+                fprintf(stderr, "Ignoring %s: at most %d sources\n", target, MAX_SOURCES);
         }
         else if (!strcmp(argv[i], "-r") || !strcmp(argv[i], "--reset-target")) {
             scn.app.target[0] = '\0';
         }
+        /* Pipewire stream profile, remembered like the target */
+        else if (!strcmp(argv[i], "--pw-profile") && i + 1 < argc) {
+            snprintf(scn.app.pw_profile, sizeof(scn.app.pw_profile), "%s", argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--pw-quantum") && i + 1 < argc) {
+            int q = atoi(argv[++i]);
+            scn.app.pw_quantum = q > 0 ? (unsigned int) q : 0;
+        }
+        else if (!strcmp(argv[i], "--pw-rate") && i + 1 < argc) {
+            int r = atoi(argv[++i]);
+            scn.app.pw_rate = r > 0 ? (unsigned int) r : 0;
+        }
 #endif
+        /* buffering, remembered like the Pipewire profile */
+        else if (!strcmp(argv[i], "--profile") && i + 1 < argc) {
+            snprintf(scn.app.profile, sizeof(scn.app.profile), "%s", argv[++i]);
+            scn.app.history_seconds = 0.0;
+            scn.app.draw_each = scn.app.frame_limit = 0;
+        }
+        else if (!strcmp(argv[i], "--history") && i + 1 < argc) {
+            double sec = atof(argv[++i]);
+            scn.app.history_seconds = sec > 0.0 ? sec : 0.0;
+        }
+        else if (!strcmp(argv[i], "--draw-each") && i + 1 < argc) {
+            int n = atoi(argv[++i]);
+            scn.app.draw_each = n > 0 ? (unsigned int) n : 0;
+        }
+        else if (!strcmp(argv[i], "--frame-limit") && i + 1 < argc) {
+            const char *v = argv[++i];
+            scn.app.frame_limit = !strcmp(v, "off") || !strcmp(v, "0") ? 2 : 1;
+        }
         else if (!strcmp(argv[i], "--splines") && i + 1 < argc) {
             scn.prefs.spline_steps = atoi(argv[++i]);
         }
@@ -2458,12 +3696,124 @@ int main(int argc, char *argv[])
         else if (!strcmp(argv[i], "--dj")) {
             scn.dj_mode = true;
         }
+        else if ((!strcmp(argv[i], "-i") || !strcmp(argv[i], "--input")) && i + 1 < argc) {
+            const char *file = argv[++i];
+            if (n_sources < MAX_SOURCES) {
+                sources[n_sources].target = NULL;
+                sources[n_sources].file   = file;
+                sources[n_sources].shm    = NULL;
+                n_sources++;
+            }
+            else
+                fprintf(stderr, "Ignoring %s: at most %d sources\n", file, MAX_SOURCES);
+        }
+        else if (!strcmp(argv[i], "--lossless")) {
+            lossless = true;
+        }
+        else if (!strcmp(argv[i], "--lossless-cap") && i + 1 < argc) {
+            lossless = true;
+            lossless_cap = atoi(argv[++i]);
+            if (lossless_cap < 2) lossless_cap = 2;
+            if (lossless_cap > LOSSLESS_MAX_CAP) lossless_cap = LOSSLESS_MAX_CAP;
+        }
+        else if (!strcmp(argv[i], "--realtime")) {
+            realtime.enabled = true;
+        }
+        else if (!strcmp(argv[i], "--rt-priority") && i + 1 < argc) {
+            realtime.enabled  = true;
+            realtime.priority = atoi(argv[++i]);
+            if (realtime.priority < 1)  realtime.priority = 1;
+            if (realtime.priority > 80) realtime.priority = 80;
+        }
+        else if (!strcmp(argv[i], "--cpus") && i + 1 < argc) {
+            const char *list = argv[++i];
+            realtime.enabled = true;
+            if (rt_parse_cpus(list, &realtime.cpu_mask))
+                realtime.cpus = list;
+            else
+                fprintf(stderr, "Ignoring --cpus '%s': expected a list like 0-3,6 (CPUs below %d)\n",
+                        list, RT_MAX_CPUS);
+        }
+        else if (!strcmp(argv[i], "--shm-input") && i + 1 < argc) {
+            const char *name = argv[++i];
+            if (n_sources < MAX_SOURCES) {
+                sources[n_sources].target = NULL;
+                sources[n_sources].file   = NULL;
+                sources[n_sources].shm    = name;
+                n_sources++;
+            }
+            else
+                fprintf(stderr, "Ignoring %s: at most %d sources\n", name, MAX_SOURCES);
+        }
+        else if (!strcmp(argv[i], "--input-fast")) {
+            input_fast = true;
+        }
+        else if (!strcmp(argv[i], "--input-loop")) {
+            input_loop = true;
+        }
+        else if (!strcmp(argv[i], "--raw-capture")) {
+            raw_capture = true;
+        }
+        else if (!strcmp(argv[i], "--capture-format") && i + 1 < argc) {
+            const char *fmt = argv[++i];
+            if (!strcmp(fmt, "f32"))
+                capture_format = SampleF32;
+            else if (!strcmp(fmt, "s16"))
+                capture_format = SampleS16;
+            else if (!strcmp(fmt, "s24"))
+                capture_format = SampleS24_32;
+            else if (!strcmp(fmt, "s32"))
+                capture_format = SampleS32;
+            else
+                fprintf(stderr, "Unknown capture format '%s' (f32, s16, s24 or s32)\n", fmt);
+        }
+        else if (!strcmp(argv[i], "--spool") && i + 1 < argc) {
+            spool_path = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--spool-minutes") && i + 1 < argc) {
+            spool_minutes = atof(argv[++i]);
+            if (spool_minutes <= 0.0)
+                spool_minutes = 60.0;
+        }
+        else if (!strcmp(argv[i], "--shm-publish") && i + 1 < argc) {
+            shm_name = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--metrics-file") && i + 1 < argc) {
+            const char *path = argv[++i];
+            metrics_file = strcmp(path, "-") ? fopen(path, "a") : stdout;
+            if (!metrics_file)
+                fprintf(stderr, "%s: cannot open metrics file\n", path);
+        }
+        else if (!strcmp(argv[i], "--display-rate") && i + 1 < argc) {
+            display_rate = atoi(argv[++i]);
+            if (display_rate < 0)
+                display_rate = 0;
+        }
+        else if (!strcmp(argv[i], "--dsp-depth") && i + 1 < argc) {
+            dsp_depth = atoi(argv[++i]);
+            if (dsp_depth < 0)
+                dsp_depth = 0;
+            if (dsp_depth > DSP_MAX_DEPTH)
+                dsp_depth = DSP_MAX_DEPTH;
+        }
+        else if (!strcmp(argv[i], "--layout") && i + 1 < argc) {
+            const char *layout = argv[++i];
+            if (!strcmp(layout, "tile"))
+                scn.tile_traces = true;
+            else if (!strcmp(layout, "overlay"))
+                scn.tile_traces = false;
+            else
+                fprintf(stderr, "Unknown layout '%s' (overlay or tile)\n", layout);
+        }
         else if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
             printf("Usage: xyscope [options]\n\n");
             printf("  -p, --preset N       Load preset N (0-9) on startup\n");
 #if !defined(__APPLE__) && !defined(_WIN32)
-            printf("  -t, --target ID      Pipewire target node name or serial\n");
+            printf("  -t, --target ID      Pipewire target node name or serial (repeatable)\n");
             printf("  -r, --reset-target   Clear saved Pipewire target\n");
+            printf("  --pw-profile NAME    Stream profile: default, low-latency, throughput, power-save\n");
+            printf("  --pw-quantum N       Stream quantum in frames at 48 kHz (0 = the profile's)\n");
+            printf("  --pw-rate HZ         Force the graph rate and skip resampling (0 = off)\n");
 #endif
             printf("  --splines N          Spline interpolation steps (1-1024)\n");
             printf("  --display-mode N     0=standard, 1=radius, 2=spectrum\n");
@@ -2482,11 +3832,53 @@ int main(int argc, char *argv[])
             printf("  --fullscreen         Start in fullscreen\n");
             printf("  --windowed           Start in windowed mode\n");
             printf("  --dj                 DJ mode (hide all text)\n");
+            printf("  -i, --input FILE     Play a WAV/FLAC file instead of capturing (repeatable)\n");
+            printf("  --input-fast         Feed the file as fast as it is recorded\n");
+            printf("  --input-loop         Restart the file when it ends\n");
+            printf("  --spool FILE         Keep older rewind history in FILE\n");
+            printf("  --spool-minutes N    Rewind reach of the spool (default 60)\n");
+            printf("  --layout MODE        Several sources: overlay (default) or tile\n");
+            printf("  --display-rate HZ    Decimate sources running at 2x this or more\n");
+            printf("  --metrics-file FILE  Append latency stats as JSON lines (- for stdout)\n");
+            printf("  --dsp-depth N        Run DSP N frames ahead of drawing on its own thread (0-%d)\n", DSP_MAX_DEPTH);
+            printf("  --raw-capture        Copy all channels in the capture callback, downmix later\n");
+            printf("  --capture-format F   Ask Pipewire for f32 (default), s16, s24 or s32\n");
+            printf("  --shm-publish NAME   Publish the captured frames in shared memory NAME\n");
+            printf("  --shm-input NAME     Read frames from shared memory NAME (repeatable)\n");
+            printf("  --lossless           Draw every captured frame, growing windows to catch up\n");
+            printf("  --lossless-cap N     Grow a frame's window to at most N windows (2-%d, default 8)\n", LOSSLESS_MAX_CAP);
+            printf("  --realtime           Realtime priority for our threads, locked memory\n");
+            printf("  --rt-priority N      Render thread's SCHED_FIFO priority (default %d)\n", RT_DEFAULT_PRIORITY);
+            printf("  --cpus LIST          Pin our threads to these CPUs, e.g. 2-3 (implies --realtime)\n");
+            printf("  --profile NAME       Buffering: default, kiosk (low memory) or analysis (long history)\n");
+            printf("  --history SEC        Rewind history length (%.0f-%.0f, default: the profile's)\n",
+                   MIN_BUFFER_SECONDS, MAX_BUFFER_SECONDS);
+            printf("  --draw-each N        Draw each frame N times (1-%d, default: the profile's)\n",
+                   MAX_DRAW_EACH_FRAME);
+            printf("  --frame-limit on|off Limit drawing to the display's frame rate\n");
             printf("  -h, --help           Show this help\n");
             return 0;
         }
     }
 
+    if (!pw_profile_resolve(scn.app.pw_profile, scn.app.pw_quantum, scn.app.pw_rate,
+                            &pw_profile)) {
+        fprintf(stderr, "Unknown Pipewire profile '%s' (default, low-latency, throughput"
+                        " or power-save)\n", scn.app.pw_profile);
+        scn.app.pw_profile[0] = '\0';
+    }
+    {
+        buffer_profile_t bp;
+        if (!buffer_profile_resolve(&scn.app, &bp)) {
+            fprintf(stderr, "Unknown profile '%s' (default, kiosk or analysis)\n",
+                    scn.app.profile);
+            scn.app.profile[0] = '\0';
+        }
+        buffer_seconds   = bp.buffer_seconds;
+        draw_each_frame  = bp.draw_each_frame;
+        limit_frame_rate = bp.limit_frame_rate;
+    }
+
     // Validate loaded preferences
     scn.validate_prefs();
 
@@ -2712,6 +4104,8 @@ int main(int argc, char *argv[])
             spline_loc_colors       = p_glGetUniformLocation(spline_shader_prog, "u_colors");
             spline_loc_num_samples  = p_glGetUniformLocation(spline_shader_prog, "u_num_samples");
             spline_loc_spline_steps = p_glGetUniformLocation(spline_shader_prog, "u_spline_steps");
+            spline_loc_base         = p_glGetUniformLocation(spline_shader_prog, "u_base");
+            glGetIntegerv(GL_MAX_TEXTURE_SIZE, &spline_max_texels);
             /* Create 1D textures for sample data */
             glGenTextures(2, spline_pos_tex);
             glGenTextures(2, spline_col_tex);
@@ -2747,7 +4141,30 @@ int main(int argc, char *argv[])
             frame_rate = 60;
         }
     }
-    sample_rate = detect_sample_rate();
+    if (n_sources > 0 && sources[0].file) {
+        /* size buffers for the primary file's own rate up front */
+        audio_file_t probe;
+        if (!audio_file_open(&probe, sources[0].file))
+            return 1;
+        capture_rate = (int)probe.rate;
+        audio_file_close(&probe);
+    }
+    else if (n_sources > 0 && sources[0].shm) {
+        /* the writer's rate if it is already running; the source
+         * follows whatever it turns out to be either way */
+        shm_reader_t probe;
+        capture_rate = 0;
+        if (shm_reader_open(&probe, sources[0].shm)) {
+            capture_rate = (int)probe.hdr->sample_rate;
+            shm_reader_close(&probe);
+        }
+        if (capture_rate <= 0)
+            capture_rate = 48000;
+    }
+    else {
+        capture_rate = detect_sample_rate();
+    }
+    sample_rate = decimate_rate(capture_rate, display_rate);
     compute_derived_rates();
     printf("Using sample rate: %d Hz, frame rate: %d fps\n", sample_rate, frame_rate);
     printf("  frames_per_buf: %d, draw_frames: %d, rb_size: %d\n",
@@ -2865,10 +4282,18 @@ int main(int argc, char *argv[])
         // Check for sample rate change (Pipewire negotiation)
         {
             int negotiated = scn.ai->getThreadData()->negotiated_sample_rate;
-            if (negotiated > 0 && negotiated != sample_rate)
-                scn.reinit_sample_rate(negotiated);
+            if (negotiated > 0 && negotiated != capture_rate) {
+                capture_rate = negotiated;
+                int rate = decimate_rate(negotiated, display_rate);
+                if (rate != sample_rate)
+                    scn.reinit_sample_rate(rate);
+            }
         }
 
+        // --realtime
+        if (realtime.enabled)
+            scn.pollRealtime();
+
         // Idle processing
         idle();
 